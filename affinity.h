@@ -0,0 +1,75 @@
+#pragma once
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+// CPU and NUMA placement of threads and memory. Only Linux supports thread affinity and memory binding, elsewhere
+// pin() fails and the memory is placed by the OS.
+struct Affinity {
+    // pin the calling thread to the cpu, returns false if not supported or the cpu is not available
+    static bool pin(int cpu) {
+#ifdef __linux__
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+        return false;
+#endif
+    }
+
+    // the NUMA node of the cpu, 0 if unknown
+    static int nodeOf(int cpu) {
+#ifdef __linux__
+        auto path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+        auto dir = opendir(path.c_str());
+        if (!dir) return 0;
+        int node = 0;
+        while (auto entry = readdir(dir)) {
+            if (strncmp(entry->d_name, "node", 4) == 0 && isdigit(entry->d_name[4])) {
+                node = atoi(entry->d_name + 4);
+                break;
+            }
+        }
+        closedir(dir);
+        return node;
+#else
+        return 0;
+#endif
+    }
+
+    // Prefer the node for the pages of the mapping at p, which must be page aligned. Only pages not yet touched
+    // are affected, so call it before the memory is used.
+    static void bindToNode(void* p, size_t len, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+        if (node < 0 || node >= 64) return;
+        // MPOL_PREFERRED falls back to other nodes when the node is out of memory
+        const int MPOL_PREFERRED = 1;
+        unsigned long mask = 1UL << node;
+        (void)syscall(SYS_mbind, p, len, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+#endif
+    }
+
+    // the cpu which processed the last packets received by the socket, or -1 if not supported
+    static int incomingCpu(int socket) {
+#ifdef SO_INCOMING_CPU
+        int cpu = -1;
+        socklen_t len = sizeof(cpu);
+        if (getsockopt(socket, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0) return cpu;
+#endif
+        return -1;
+    }
+};
@@ -0,0 +1,547 @@
+#pragma once
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef AUDIT_ZLIB
+#include <zlib.h>
+#endif
+
+#include "framing.h"
+
+// The on disk format of the audit trail, shared by the AuditTrail writer and the AuditReader.
+//
+// A segment file audit-<utc time>.dat is a sequence of blocks, each a BlockHeader followed by the entries, compressed
+// with zlib if built with AUDIT_ZLIB (see the Makefile). An entry is an EntryHeader followed by the session id and
+// the message. The segment's .idx file is the sparse index, a text line per session and direction in each block:
+//
+//     <block offset> <session> <direction> <first seqnum> <last seqnum> <first time> <last time> <count>
+//
+// with the times in nanoseconds since the epoch. A segment holds at most one UTC day.
+struct AuditFormat {
+    enum Direction : uint8_t { INBOUND,
+                               OUTBOUND };
+    enum Codec : uint8_t { STORED,
+                           ZLIB };
+
+    static constexpr char MAGIC[4] = {'F', 'X', 'A', 'B'};
+
+    struct BlockHeader {
+        char magic[4];
+        Codec codec;
+        uint8_t reserved[3];
+        uint32_t rawLength;
+        uint32_t storedLength;
+    };
+    struct EntryHeader {
+        int64_t time;
+        uint32_t seqNum;
+        Direction direction;
+        uint8_t sessionLength;
+        uint16_t reserved;
+        uint32_t length;
+        uint32_t reserved2;
+    };
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+    static int64_t day(int64_t time) { return time / (86400LL * 1000000000LL); }
+};
+
+// the configuration of an AuditTrail
+struct AuditOptions {
+    std::string directory = ".";
+    // the uncompressed size at which a block is written
+    size_t blockSize = 64 * 1024;
+    // a block is also written once its first message is this old
+    std::chrono::milliseconds flushInterval{100};
+    // a new segment is started once a segment exceeds this size, or at midnight UTC
+    size_t segmentSize = 256 * 1024 * 1024;
+    // the size of each thread's ring, a power of 2
+    size_t ringSize = 1024 * 1024;
+    int compressionLevel = 1;
+};
+
+// Records every message sent and received by the sessions it is attached to, see EngineOptions::audit and
+// Initiator::setAudit(). The session's Socketbuf copies the bytes of each read and write into a ring owned by the
+// calling thread, and a background thread frames the messages, indexes them by session (the local
+// SenderCompID:TargetCompID), MsgSeqNum and time, and writes them to the segment files in the directory. A thread
+// whose ring is full waits for the writer, so no message is lost. The AuditTrail must outlive the sessions.
+class AuditTrail : public AuditFormat {
+   private:
+    enum Kind : uint8_t { IN = INBOUND,
+                          OUT = OUTBOUND,
+                          CLOSE,
+                          PAD };
+    // a read or write of a connection in a ring, followed by the bytes and padded to 8 bytes
+    struct Chunk {
+        uint32_t size;
+        Kind kind;
+        uint8_t reserved[3];
+        uint32_t length;
+        uint32_t reserved2;
+        uint64_t connection;
+        uint64_t sequence;
+        int64_t time;
+    };
+
+    // single producer, single consumer
+    struct Ring {
+        alignas(64) std::atomic<uint64_t> head{0};
+        alignas(64) std::atomic<uint64_t> tail{0};
+        std::vector<char> data;
+        Ring(size_t size) : data(size) {}
+    };
+
+   public:
+    // The audit state of a connection, owned by its Socketbuf. The reads and writes are each numbered, so the
+    // writer can order the chunks of a fiber which moved between threads.
+    class Connection {
+        AuditTrail& trail;
+        const uint64_t id;
+        uint64_t sequence[2] = {0, 0};
+
+       public:
+        Connection(AuditTrail& trail) : trail(trail), id(trail.nextConnection++) {}
+        ~Connection() { trail.append(id, CLOSE, sequence[INBOUND], reinterpret_cast<const char*>(&sequence[OUTBOUND]), sizeof(uint64_t)); }
+        void record(Direction direction, const char* p, size_t len) {
+            auto time = now();
+            // large reads are split, so a chunk always fits in a ring
+            for (size_t max = trail.options.ringSize / 4; len > 0;) {
+                auto n = std::min(len, max);
+                trail.append(id, Kind(direction), sequence[direction]++, p, n, time);
+                p += n;
+                len -= n;
+            }
+        }
+        void record(Direction direction, const struct iovec* iov, int count) {
+            for (int i = 0; i < count; i++) record(direction, static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+        }
+    };
+
+   private:
+    const AuditOptions options;
+    const uint64_t trailId;
+    std::atomic<uint64_t> nextConnection{0};
+    // the number of times a thread waited for space in its ring
+    std::atomic<uint64_t> stalls{0};
+
+    std::mutex lock;
+    std::condition_variable wakeup, flushDone;
+    std::vector<std::shared_ptr<Ring>> rings;
+    uint64_t flushRequested = 0, flushed = 0;
+    bool stopped = false;
+
+    // the writer's state, only used by the writer thread
+    struct Stream {
+        uint64_t next = 0;
+        std::map<uint64_t, std::pair<int64_t, std::string>> early;
+        std::string partial;
+    };
+    struct Pending {
+        uint64_t closeAt[2];
+    };
+    struct IndexEntry {
+        uint32_t firstSeq = 0, lastSeq = 0;
+        int64_t firstTime = 0, lastTime = 0;
+        uint64_t count = 0;
+    };
+    std::map<std::pair<uint64_t, int>, Stream> streams;
+    std::unordered_map<uint64_t, Pending> closing;
+    std::string block;
+    std::map<std::pair<std::string, int>, IndexEntry> blockIndex;
+    int64_t blockStarted = 0;
+    FILE* segment = nullptr;
+    FILE* index = nullptr;
+    size_t segmentOffset = 0;
+    int64_t segmentDay = -1;
+
+    std::thread writer;
+
+    static std::atomic<uint64_t>& trailIds() {
+        static std::atomic<uint64_t> ids{0};
+        return ids;
+    }
+
+    Ring& threadRing() {
+        thread_local std::vector<std::pair<uint64_t, std::shared_ptr<Ring>>> threadRings;
+        for (auto& entry : threadRings) {
+            if (entry.first == trailId) return *entry.second;
+        }
+        auto ring = std::make_shared<Ring>(options.ringSize);
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            rings.push_back(ring);
+        }
+        threadRings.emplace_back(trailId, ring);
+        return *ring;
+    }
+
+    void append(uint64_t connection, Kind kind, uint64_t sequence, const char* p, size_t len, int64_t time = 0) {
+        auto& ring = threadRing();
+        const auto capacity = ring.data.size();
+        const auto size = (sizeof(Chunk) + len + 7) & ~size_t(7);
+        auto head = ring.head.load(std::memory_order_relaxed);
+        // a chunk is contiguous, so the rest of the ring is padded if the chunk does not fit
+        auto offset = head & (capacity - 1);
+        size_t pad = capacity - offset < size ? capacity - offset : 0;
+        if (head + pad + size - ring.tail.load(std::memory_order_acquire) > capacity) {
+            stalls++;
+            while (head + pad + size - ring.tail.load(std::memory_order_acquire) > capacity) std::this_thread::yield();
+        }
+        if (pad) {
+            Chunk marker{uint32_t(pad), PAD, {}, 0, 0, 0, 0, 0};
+            memcpy(ring.data.data() + offset, &marker, sizeof(uint32_t) + 1);
+            head += pad;
+            offset = 0;
+        }
+        Chunk chunk{uint32_t(size), kind, {}, uint32_t(len), 0, connection, sequence, time};
+        memcpy(ring.data.data() + offset, &chunk, sizeof(chunk));
+        memcpy(ring.data.data() + offset + sizeof(chunk), p, len);
+        ring.head.store(head + size, std::memory_order_release);
+    }
+
+    // read the pending chunks from the rings, returns the number read
+    size_t drain() {
+        std::vector<std::shared_ptr<Ring>> current;
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            // release the rings of exited threads once empty
+            std::erase_if(rings, [](auto& ring) { return ring.use_count() == 1 && ring->head.load() == ring->tail.load(); });
+            current = rings;
+        }
+        size_t count = 0;
+        for (auto& ring : current) {
+            auto capacity = ring->data.size();
+            auto tail = ring->tail.load(std::memory_order_relaxed);
+            auto head = ring->head.load(std::memory_order_acquire);
+            while (tail != head) {
+                auto p = ring->data.data() + (tail & (capacity - 1));
+                Chunk chunk;
+                memcpy(&chunk, p, sizeof(uint32_t) + 1);
+                if (chunk.kind != PAD) {
+                    memcpy(&chunk, p, sizeof(chunk));
+                    consume(chunk, p + sizeof(chunk));
+                    count++;
+                }
+                tail += chunk.size;
+            }
+            ring->tail.store(tail, std::memory_order_release);
+        }
+        return count;
+    }
+
+    void consume(const Chunk& chunk, const char* data) {
+        if (chunk.kind == CLOSE) {
+            uint64_t outbound;
+            memcpy(&outbound, data, sizeof(outbound));
+            closing[chunk.connection] = Pending{{chunk.sequence, outbound}};
+            release(chunk.connection);
+            return;
+        }
+        auto& stream = streams[{chunk.connection, chunk.kind}];
+        auto len = chunk.length;
+        if (chunk.sequence != stream.next) {
+            // an earlier chunk is in another thread's ring
+            stream.early[chunk.sequence] = {chunk.time, std::string(data, len)};
+            return;
+        }
+        receive(stream, Direction(chunk.kind), chunk.time, data, len);
+        for (auto itr = stream.early.begin(); itr != stream.early.end() && itr->first == stream.next; itr = stream.early.erase(itr)) {
+            receive(stream, Direction(chunk.kind), itr->second.first, itr->second.second.data(), itr->second.second.size());
+        }
+        if (closing.count(chunk.connection)) release(chunk.connection);
+    }
+
+    // drop the streams of a closed connection once all of its chunks have been read
+    void release(uint64_t connection) {
+        auto& pending = closing[connection];
+        for (int direction = 0; direction < 2; direction++) {
+            auto itr = streams.find({connection, direction});
+            if (itr != streams.end() && itr->second.next < pending.closeAt[direction]) return;
+            if (itr == streams.end() && pending.closeAt[direction] > 0) return;
+        }
+        streams.erase({connection, INBOUND});
+        streams.erase({connection, OUTBOUND});
+        closing.erase(connection);
+    }
+
+    void receive(Stream& stream, Direction direction, int64_t time, const char* data, size_t len) {
+        stream.next++;
+        stream.partial.append(data, len);
+        size_t start = 0;
+        while (start < stream.partial.size()) {
+            size_t length;
+            try {
+                length = Framing::messageLength(stream.partial.data() + start, stream.partial.size() - start);
+            } catch (const std::runtime_error&) {
+                // not FIX, e.g. the shared memory hello, or the padding, skip to the next BeginString
+                auto next = stream.partial.find("8=FIX", start + 1);
+                start = next == std::string::npos ? stream.partial.size() : next;
+                continue;
+            }
+            if (!length) break;
+            addEntry(direction, time, std::string_view(stream.partial.data() + start, length));
+            start += length;
+        }
+        stream.partial.erase(0, start);
+    }
+
+    static std::string_view field(std::string_view msg, std::string_view tag) {
+        auto pos = msg.find(tag);
+        if (pos == std::string_view::npos) return {};
+        pos += tag.size();
+        return msg.substr(pos, msg.find('\001', pos) - pos);
+    }
+
+    void addEntry(Direction direction, int64_t time, std::string_view msg) {
+        if (day(time) != segmentDay || segmentOffset >= options.segmentSize) {
+            writeBlock();
+            openSegment(time);
+        }
+        auto sender = field(msg, "\00149="), target = field(msg, "\00156=");
+        std::string session = std::string(direction == OUTBOUND ? sender : target) + ":" + std::string(direction == OUTBOUND ? target : sender);
+        session.resize(std::min<size_t>(session.size(), 255));
+        uint32_t seqNum = 0;
+        for (char c : field(msg, "\00134=")) seqNum = seqNum * 10 + (c - '0');
+
+        EntryHeader header{time, seqNum, direction, uint8_t(session.size()), 0, uint32_t(msg.size()), 0};
+        if (block.empty()) blockStarted = AuditFormat::now();
+        block.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        block.append(session);
+        block.append(msg);
+
+        auto& entry = blockIndex[{session, direction}];
+        if (entry.count++ == 0) {
+            entry.firstSeq = seqNum;
+            entry.firstTime = time;
+        }
+        entry.lastSeq = seqNum;
+        entry.lastTime = std::max(entry.lastTime, time);
+        if (block.size() >= options.blockSize) writeBlock();
+    }
+
+    void openSegment(int64_t time) {
+        closeSegment();
+        time_t seconds = time / 1000000000;
+        struct tm tm;
+        gmtime_r(&seconds, &tm);
+        char name[64];
+        auto length = strftime(name, sizeof(name), "audit-%Y%m%d-%H%M%S", &tm);
+        // zero padded, so the names sort in time order, see AuditReader
+        snprintf(name + length, sizeof(name) - length, ".%09lld", (long long)(time % 1000000000));
+        auto base = options.directory + "/" + name;
+        segment = fopen((base + ".dat").c_str(), "wb");
+        index = fopen((base + ".idx").c_str(), "w");
+        if (!segment || !index) throw std::runtime_error("unable to create audit segment " + base);
+        segmentOffset = 0;
+        segmentDay = day(time);
+    }
+
+    void closeSegment() {
+        if (segment) fclose(segment);
+        if (index) fclose(index);
+        segment = index = nullptr;
+    }
+
+    void writeBlock() {
+        if (block.empty()) return;
+        BlockHeader header{{MAGIC[0], MAGIC[1], MAGIC[2], MAGIC[3]}, STORED, {}, uint32_t(block.size()), uint32_t(block.size())};
+        const char* stored = block.data();
+#ifdef AUDIT_ZLIB
+        std::vector<char> compressed(compressBound(block.size()));
+        uLongf length = compressed.size();
+        if (compress2(reinterpret_cast<Bytef*>(compressed.data()), &length, reinterpret_cast<const Bytef*>(block.data()), block.size(), options.compressionLevel) == Z_OK && length < block.size()) {
+            header.codec = ZLIB;
+            header.storedLength = length;
+            stored = compressed.data();
+        }
+#endif
+        fwrite(&header, sizeof(header), 1, segment);
+        fwrite(stored, 1, header.storedLength, segment);
+        fflush(segment);
+        for (auto& [key, entry] : blockIndex) {
+            fprintf(index, "%zu %s %d %u %u %lld %lld %llu\n", segmentOffset, key.first.c_str(), key.second, entry.firstSeq, entry.lastSeq,
+                    (long long)entry.firstTime, (long long)entry.lastTime, (unsigned long long)entry.count);
+        }
+        fflush(index);
+        segmentOffset += sizeof(header) + header.storedLength;
+        block.clear();
+        blockIndex.clear();
+    }
+
+    void run() {
+        while (true) {
+            uint64_t requested;
+            {
+                std::lock_guard<std::mutex> mu(lock);
+                requested = flushRequested;
+            }
+            if (drain()) continue;
+            if (!block.empty() && (requested != flushed || AuditFormat::now() - blockStarted >= options.flushInterval.count() * 1000000LL)) writeBlock();
+            std::unique_lock<std::mutex> lk(lock);
+            flushed = requested;
+            flushDone.notify_all();
+            if (stopped) return;
+            wakeup.wait_for(lk, std::chrono::milliseconds(10), [this] { return stopped || flushRequested != flushed; });
+        }
+    }
+
+   public:
+    AuditTrail(AuditOptions options = AuditOptions()) : options(options), trailId(trailIds()++) {
+        if ((options.ringSize & (options.ringSize - 1)) || options.ringSize < 4096) throw std::invalid_argument("ringSize must be a power of 2 of at least 4096");
+        mkdir(options.directory.c_str(), 0755);
+        writer = std::thread(&AuditTrail::run, this);
+    }
+    ~AuditTrail() {
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            stopped = true;
+        }
+        wakeup.notify_one();
+        writer.join();
+        drain();
+        writeBlock();
+        closeSegment();
+    }
+
+    // wait until the messages recorded before the call are written to the segment
+    void flush() {
+        std::unique_lock<std::mutex> lk(lock);
+        auto requested = ++flushRequested;
+        wakeup.notify_one();
+        flushDone.wait(lk, [&] { return flushed >= requested || stopped; });
+    }
+    // the number of times a thread waited for the writer, which should be 0
+    uint64_t stallCount() const { return stalls; }
+};
+
+// Reads the audit trail written by an AuditTrail, using the indexes to decompress only the blocks containing the
+// messages requested.
+class AuditReader : public AuditFormat {
+    struct Block {
+        std::string segment;
+        size_t offset;
+        bool operator==(const Block& other) const { return segment == other.segment && offset == other.offset; }
+    };
+    std::vector<std::string> segments;
+
+   public:
+    struct Entry {
+        int64_t time;
+        uint32_t seqNum;
+        Direction direction;
+        std::string_view session;
+        std::string_view message;
+    };
+
+    AuditReader(const std::string& directory) {
+        auto dir = opendir(directory.c_str());
+        if (!dir) throw std::runtime_error("unable to open " + directory);
+        while (auto entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.starts_with("audit-") && name.ends_with(".idx")) segments.push_back(directory + "/" + name.substr(0, name.size() - 4));
+        }
+        closedir(dir);
+        std::sort(segments.begin(), segments.end());
+    }
+
+    // the number of blocks in the trail
+    size_t blockCount() const {
+        size_t count = 0;
+        for (auto& segment : segments) {
+            std::ifstream index(segment + ".idx");
+            std::string line;
+            size_t last = SIZE_MAX, offset;
+            while (std::getline(index, line)) {
+                offset = std::stoull(line);
+                if (offset != last) count++;
+                last = offset;
+            }
+        }
+        return count;
+    }
+
+    // calls fn for each message of the session (or all sessions if empty) with a time in [from, to], in the order
+    // written. Returns the number of blocks read.
+    size_t query(const std::string& session, int64_t from, int64_t to, const std::function<void(const Entry&)>& fn) const {
+        std::vector<Block> blocks;
+        for (auto& segment : segments) {
+            std::ifstream index(segment + ".idx");
+            std::string line;
+            while (std::getline(index, line)) {
+                std::istringstream is(line);
+                size_t offset;
+                std::string id;
+                int direction;
+                uint32_t firstSeq, lastSeq;
+                long long firstTime, lastTime;
+                if (!(is >> offset >> id >> direction >> firstSeq >> lastSeq >> firstTime >> lastTime)) continue;
+                if ((!session.empty() && id != session) || lastTime < from || firstTime > to) continue;
+                if (blocks.empty() || !(blocks.back() == Block{segment, offset})) blocks.push_back({segment, offset});
+            }
+        }
+        std::vector<char> stored, raw;
+        for (auto& block : blocks) {
+            readBlock(block, stored, raw);
+            for (size_t pos = 0; pos + sizeof(EntryHeader) <= raw.size();) {
+                EntryHeader header;
+                memcpy(&header, raw.data() + pos, sizeof(header));
+                pos += sizeof(header);
+                Entry entry{header.time, header.seqNum, header.direction, std::string_view(raw.data() + pos, header.sessionLength),
+                            std::string_view(raw.data() + pos + header.sessionLength, header.length)};
+                pos += header.sessionLength + header.length;
+                if ((session.empty() || entry.session == session) && entry.time >= from && entry.time <= to) fn(entry);
+            }
+        }
+        return blocks.size();
+    }
+
+   private:
+    static void readBlock(const Block& block, std::vector<char>& stored, std::vector<char>& raw) {
+        std::ifstream is(block.segment + ".dat", std::ios::binary);
+        is.seekg(block.offset);
+        BlockHeader header;
+        if (!is.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.magic, MAGIC, 4) != 0) {
+            throw std::runtime_error("invalid audit block in " + block.segment + " at " + std::to_string(block.offset));
+        }
+        stored.resize(header.storedLength);
+        if (!is.read(stored.data(), stored.size())) throw std::runtime_error("truncated audit block in " + block.segment);
+        if (header.codec == STORED) {
+            raw.swap(stored);
+            return;
+        }
+#ifdef AUDIT_ZLIB
+        raw.resize(header.rawLength);
+        uLongf length = raw.size();
+        if (uncompress(reinterpret_cast<Bytef*>(raw.data()), &length, reinterpret_cast<const Bytef*>(stored.data()), stored.size()) != Z_OK || length != raw.size()) {
+            throw std::runtime_error("corrupt audit block in " + block.segment);
+        }
+#else
+        throw std::runtime_error("audit block is compressed, rebuild with AUDIT_ZLIB");
+#endif
+    }
+};
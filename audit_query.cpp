@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+
+#include "audit.h"
+
+// Extracts messages from an audit trail written by an AuditTrail, reading only the blocks whose index entries match.
+//
+// usage: audit_query <directory> [-session SENDER:TARGET] [-from time] [-to time] [-soh]
+//
+// The times are UTC in the FIX format YYYYMMDD-HH:MM:SS[.fraction]. The message fields are separated by | unless -soh.
+
+static int64_t parseTime(const char* s) {
+    struct tm tm = {};
+    const char* rest = strptime(s, "%Y%m%d-%H:%M:%S", &tm);
+    if (!rest) {
+        std::cerr << "invalid time " << s << ", expected YYYYMMDD-HH:MM:SS[.fraction]\n";
+        exit(1);
+    }
+    int64_t nanos = 0;
+    if (*rest == '.') {
+        int64_t scale = 100000000;
+        for (rest++; *rest >= '0' && *rest <= '9' && scale > 0; rest++, scale /= 10) nanos += (*rest - '0') * scale;
+    }
+    return int64_t(timegm(&tm)) * 1000000000 + nanos;
+}
+
+static std::string formatTime(int64_t time) {
+    time_t seconds = time / 1000000000;
+    struct tm tm;
+    gmtime_r(&seconds, &tm);
+    char buf[64];
+    auto len = strftime(buf, sizeof(buf), "%Y%m%d-%H:%M:%S", &tm);
+    snprintf(buf + len, sizeof(buf) - len, ".%09lld", (long long)(time % 1000000000));
+    return buf;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: audit_query <directory> [-session SENDER:TARGET] [-from time] [-to time] [-soh]\n";
+        return 1;
+    }
+    std::string session;
+    int64_t from = 0, to = INT64_MAX;
+    bool soh = false;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-session") == 0 && i + 1 < argc) {
+            session = argv[++i];
+        } else if (strcmp(argv[i], "-from") == 0 && i + 1 < argc) {
+            from = parseTime(argv[++i]);
+        } else if (strcmp(argv[i], "-to") == 0 && i + 1 < argc) {
+            to = parseTime(argv[++i]);
+        } else if (strcmp(argv[i], "-soh") == 0) {
+            soh = true;
+        } else {
+            std::cerr << "unknown option " << argv[i] << "\n";
+            return 1;
+        }
+    }
+
+    try {
+        AuditReader reader(argv[1]);
+        size_t count = 0;
+        std::string msg;
+        auto blocks = reader.query(session, from, to, [&](const AuditReader::Entry& entry) {
+            msg = entry.message;
+            if (!soh) std::replace(msg.begin(), msg.end(), '\001', '|');
+            std::cout << formatTime(entry.time) << " " << (entry.direction == AuditFormat::INBOUND ? "in " : "out") << " " << entry.session << " " << msg << "\n";
+            count++;
+        });
+        std::cerr << count << " messages, read " << blocks << " of " << reader.blockCount() << " blocks\n";
+    } catch (const std::runtime_error& err) {
+        std::cerr << err.what() << "\n";
+        return 1;
+    }
+}
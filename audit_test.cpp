@@ -0,0 +1,156 @@
+#define BOOST_TEST_MODULE audit_test
+#include <boost/test/included/unit_test.hpp>
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audit.h"
+#include "fix_builder.h"
+#include "fix_engine.h"
+#include "msg_logon.h"
+
+static std::string tempDirectory() {
+    char dir[] = "/tmp/audit_testXXXXXX";
+    return mkdtemp(dir);
+}
+
+static std::string encode(const std::string& sender, const std::string& target, int seqNum) {
+    FixBuilder msg;
+    msg.addField(8, "FIX.4.4");
+    msg.addField(9, "0000");
+    msg.addField(35, "D");
+    msg.addField(49, sender);
+    msg.addField(56, target);
+    msg.addField(34, seqNum);
+    msg.addField(11, "order" + std::to_string(seqNum));
+    std::ostringstream os;
+    msg.writeTo(os);
+    return os.str();
+}
+
+// messages split across reads, and reads recorded on different threads, are framed and indexed in order
+BOOST_AUTO_TEST_CASE( record_and_query ) {
+    auto dir = tempDirectory();
+    const int count = 200;
+    {
+        AuditOptions options;
+        options.directory = dir;
+        options.blockSize = 1024;
+        options.ringSize = 4096;
+        AuditTrail trail(options);
+        AuditTrail::Connection connection(trail);
+        std::string inbound, outbound;
+        for (int i = 1; i <= count; i++) {
+            inbound += encode("client", "server", i);
+            outbound += encode("server", "client", i);
+        }
+        for (size_t pos = 0, chunk = 0; pos < inbound.size(); pos += 37, chunk++) {
+            auto record = [&] {
+                connection.record(AuditTrail::INBOUND, inbound.data() + pos, std::min<size_t>(37, inbound.size() - pos));
+                if (pos < outbound.size()) connection.record(AuditTrail::OUTBOUND, outbound.data() + pos, std::min<size_t>(37, outbound.size() - pos));
+            };
+            if (chunk % 2) {
+                std::thread(record).join();
+            } else {
+                record();
+            }
+        }
+        trail.flush();
+    }
+
+    AuditReader reader(dir);
+    std::vector<AuditReader::Entry> entries;
+    std::vector<int64_t> times;
+    uint32_t next[2] = {1, 1};
+    auto blocks = reader.query("server:client", 0, INT64_MAX, [&](const AuditReader::Entry& entry) {
+        BOOST_REQUIRE(entry.seqNum == next[entry.direction]++);
+        BOOST_TEST(entry.message.find("\00111=order" + std::to_string(entry.seqNum) + "\001") != std::string_view::npos);
+        if (entry.direction == AuditTrail::OUTBOUND) times.push_back(entry.time);
+    });
+    BOOST_TEST(next[AuditTrail::INBOUND] == count + 1u);
+    BOOST_TEST(next[AuditTrail::OUTBOUND] == count + 1u);
+    BOOST_TEST(blocks == reader.blockCount());
+    BOOST_TEST(blocks > 10u);
+    BOOST_TEST(reader.query("client:server", 0, INT64_MAX, [](auto&) {}) == 0u);
+
+    // a time range only reads the blocks whose index entries overlap it
+    int matched = 0;
+    auto from = times[100], to = times[120];
+    blocks = reader.query("server:client", from, to, [&](const AuditReader::Entry& entry) {
+        BOOST_TEST(entry.time >= from);
+        BOOST_TEST(entry.time <= to);
+        matched++;
+    });
+    BOOST_TEST(matched >= 21);
+    BOOST_TEST(blocks < reader.blockCount());
+
+    // the nanoseconds of the segment name are zero padded, so the names sort in time order
+    auto files = opendir(dir.c_str());
+    BOOST_REQUIRE(files);
+    while (auto file = readdir(files)) {
+        std::string name = file->d_name;
+        if (name.starts_with("audit-")) BOOST_TEST(name.size() == std::string("audit-20240101-000000.000000000.idx").size());
+    }
+    closedir(files);
+}
+
+// both sides of a session are recorded from the engine's socket buffers
+BOOST_AUTO_TEST_CASE( engine_sessions ) {
+    auto dir = tempDirectory();
+    AuditOptions auditOptions;
+    auditOptions.directory = dir;
+    AuditTrail trail(auditOptions);
+
+    class TestAcceptor : public Acceptor<> {
+       public:
+        std::atomic<int> orders = 0;
+        TestAcceptor(int port, const DefaultSessionConfig& config, EngineOptions options) : Acceptor(port, config, 1, options) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() == "D" && ++orders == 10) shutdown();
+        }
+        bool validateLogon(const FixMessage& logon) override { return true; }
+    };
+    class TestInitiator : public Initiator<> {
+       public:
+        TestInitiator(const Endpoint& server, const DefaultSessionConfig& config) : Initiator(server, config) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onConnected() override {
+            FixBuilder msg;
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+            for (int i = 0; i < 10; i++) {
+                msg.addField(11, "order" + std::to_string(i));
+                sendMessage("D", msg);
+            }
+        }
+    };
+
+    EngineOptions options;
+    options.audit = &trail;
+    TestAcceptor acceptor(9001, DefaultSessionConfig("server", "*"), options);
+    auto t = std::thread([&acceptor]() { acceptor.listen(); });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    TestInitiator initiator(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("client", "server"));
+    initiator.setAudit(trail);
+    initiator.connect();
+    t.join();
+    initiator.disconnect();
+    BOOST_TEST(acceptor.orders == 10);
+    trail.flush();
+
+    AuditReader reader(dir);
+    int counts[2] = {0, 0};
+    reader.query("client:server", 0, INT64_MAX, [&](const AuditReader::Entry& entry) { counts[entry.direction]++; });
+    BOOST_TEST(counts[AuditTrail::OUTBOUND] == 11);
+    int serverInbound = 0;
+    reader.query("server:client", 0, INT64_MAX, [&](const AuditReader::Entry& entry) {
+        if (entry.direction == AuditTrail::INBOUND) serverInbound++;
+    });
+    BOOST_TEST(serverInbound == 11);
+}
@@ -0,0 +1,109 @@
+#include <poll.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "bench_util.h"
+#include "fix_engine.h"
+#include "msg_logon.h"
+#include "msg_massquote.h"
+
+// Compares fanning out a message to many sessions using Acceptor::broadcast() versus a loop
+// over Acceptor::sendMessage(), which re-encodes the message for every session.
+//
+// usage: bench_broadcast [sessions] [rounds]
+
+static const int PORT = 9101;
+
+class BroadcastServer : public Acceptor<> {
+   public:
+    BroadcastServer() : Acceptor(PORT, DefaultSessionConfig("SERVER", "*"), std::max(int(std::thread::hardware_concurrency() / 2), 1)) {}
+    void onMessage(Session<>& session, const FixMessage& msg) override {}
+    bool validateLogon(const FixMessage& msg) override { return true; }
+};
+
+static void buildQuote(FixBuilder& fix, int i) {
+    MassQuote::build(fix, "Q" + std::to_string(i), "E1", "IBM", F(100.25), F(10), F(100.5), F(10));
+}
+
+int main(int argc, char* argv[]) {
+    int count = 1000;
+    int rounds = 1000;
+    if (argc > 1) count = atoi(argv[1]);
+    if (argc > 2) rounds = atoi(argv[2]);
+    bench::raiseFileLimit(count * 2 + 64);
+
+    BroadcastServer server;
+    std::thread serverThread([&server]() { server.listen(); });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    std::vector<int> sockets;
+    std::vector<std::string> sessionIds;
+    std::string buffer, msg;
+    FixBuilder body;
+    for (int i = 0; i < count; i++) {
+        int fd = bench::connectTo(bench::loopback(PORT));
+        if (fd < 0) {
+            perror("connect");
+            exit(1);
+        }
+        auto client = "CLIENT_" + std::to_string(i);
+        Logon::build(body);
+        bench::writeAll(fd, bench::encode(Logon::msgType, client, "SERVER", 1, body));
+        buffer.clear();
+        if (!bench::readMessage(fd, buffer, msg)) {
+            std::cerr << "no logon response\n";
+            exit(1);
+        }
+        sockets.push_back(fd);
+        sessionIds.push_back("SERVER:" + client);
+    }
+    std::cout << "logged on " << count << " sessions\n";
+
+    // drain the client sockets so the server never blocks on a full socket
+    std::atomic<bool> done = false;
+    std::atomic<long> bytesReceived = 0;
+    std::thread reader([&]() {
+        std::vector<pollfd> fds;
+        for (auto fd : sockets) fds.push_back({fd, POLLIN, 0});
+        char tmp[65536];
+        while (!done) {
+            if (::poll(fds.data(), fds.size(), 100) <= 0) continue;
+            for (auto& pfd : fds) {
+                if (pfd.revents & POLLIN) {
+                    auto n = ::read(pfd.fd, tmp, sizeof(tmp));
+                    if (n > 0) bytesReceived += n;
+                }
+            }
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (auto& id : sessionIds) {
+            buildQuote(body, r);
+            server.sendMessage(id, MassQuote::msgType, body);
+        }
+    }
+    auto loopUsec = bench::micros(std::chrono::steady_clock::now() - start);
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        buildQuote(body, r);
+        server.broadcast(MassQuote::msgType, body);
+    }
+    auto broadcastUsec = bench::micros(std::chrono::steady_clock::now() - start);
+
+    long messages = long(rounds) * count;
+    std::cout << "sendMessage loop: " << loopUsec / (double)rounds << " usec per fan-out, " << loopUsec * 1000.0 / messages << " nsec per session\n";
+    std::cout << "broadcast: " << broadcastUsec / (double)rounds << " usec per fan-out, " << broadcastUsec * 1000.0 / messages << " nsec per session\n";
+
+    done = true;
+    reader.join();
+    for (auto fd : sockets) ::close(fd);
+    std::cout << std::flush;
+    _exit(0);
+}
@@ -0,0 +1,64 @@
+#!/bin/bash
+
+# Compares two results of bin/bench_micro -json, e.g. before and after a change, and flags the benchmarks whose
+# ns_per_op increased by more than the threshold percent. Exits with status 1 if any benchmark regressed.
+#
+# usage: bench_compare.sh <baseline.json> <current.json> [threshold percent, default 10]
+
+if [ "$#" -lt 2 ]; then
+    echo "usage: $0 <baseline.json> <current.json> [threshold]"
+    exit 2
+fi
+
+BASELINE=$1
+CURRENT=$2
+THRESHOLD=${3:-10}
+
+for file in "$BASELINE" "$CURRENT"; do
+    if [ ! -r "$file" ]; then
+        echo "unable to read $file"
+        exit 2
+    fi
+done
+
+awk -v threshold="$THRESHOLD" '
+# the value of the key in a line of the results, one benchmark per line
+function field(line, key,    value) {
+    if (!match(line, "\"" key "\": *\"?[^,\"}]*")) return ""
+    value = substr(line, RSTART, RLENGTH)
+    sub("^\"" key "\": *\"?", "", value)
+    return value
+}
+BEGIN {
+    printf "%-18s %12s %12s %9s\n", "benchmark", "baseline", "current", "change"
+}
+FNR == NR {
+    name = field($0, "name")
+    if (name != "") baseline[name] = field($0, "ns_per_op")
+    next
+}
+{
+    name = field($0, "name")
+    if (name == "") next
+    current = field($0, "ns_per_op")
+    if (!(name in baseline) || baseline[name] <= 0) {
+        printf "%-18s %12s %12.1f %9s\n", name, "-", current, "new"
+        next
+    }
+    change = (current - baseline[name]) * 100 / baseline[name]
+    status = ""
+    if (change > threshold) {
+        status = "REGRESSION"
+        regressions++
+    } else if (change < -threshold) {
+        status = "improved"
+    }
+    printf "%-18s %12.1f %12.1f %+8.1f%% %s\n", name, baseline[name], current, change, status
+}
+END {
+    if (regressions > 0) {
+        printf "%d benchmark(s) regressed by more than %s%%\n", regressions, threshold
+        exit 1
+    }
+}
+' "$BASELINE" "$CURRENT"
@@ -0,0 +1,122 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "bench_util.h"
+#include "fix_engine.h"
+#include "msg_logon.h"
+
+// Measures the round trip latency of quiet sessions sharing a single worker thread with a session flooding
+// orders, to compare EngineOptions::readBudget and EngineOptions::priorities. Each quiet client sends an order
+// every millisecond and waits for the reply, the noisy client sends orders as fast as the server accepts them.
+// Each order costs the server about a microsecond.
+//
+// usage: bench_fairness [-budget <messages>] [-priorities] [-quiet <sessions>] [-seconds <n>]
+
+static const int PORT = 9103;
+
+class FairnessServer : public Acceptor<> {
+   public:
+    std::atomic<long> noisyOrders = 0;
+    FairnessServer(EngineOptions options) : Acceptor(PORT, DefaultSessionConfig("SERVER", "*"), 1, options) {}
+    void onMessage(Session<>& session, const FixMessage& msg) override {
+        if (msg.msgType() == Logon::msgType) {
+            if (msg.getString(Tag::SENDER_COMP_ID).starts_with("QUIET")) session.setPriority(Priority::High);
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start < std::chrono::microseconds(1));
+        if (msg.getString(Tag::SENDER_COMP_ID).starts_with("NOISY")) {
+            noisyOrders++;
+            return;
+        }
+        FixBuilder reply;
+        reply.addField(11, msg.getString(11));
+        session.sendMessage("8", reply);
+    }
+    bool validateLogon(const FixMessage& msg) override { return true; }
+};
+
+static int logon(const std::string& client) {
+    int fd = bench::connectTo(bench::loopback(PORT));
+    if (fd < 0) {
+        perror("connect");
+        exit(1);
+    }
+    FixBuilder body;
+    Logon::build(body);
+    bench::writeAll(fd, bench::encode(Logon::msgType, client, "SERVER", 1, body));
+    std::string buffer, msg;
+    if (!bench::readMessage(fd, buffer, msg)) {
+        std::cerr << "no logon response\n";
+        exit(1);
+    }
+    return fd;
+}
+
+int main(int argc, char* argv[]) {
+    EngineOptions options;
+    int quietSessions = 4;
+    int seconds = 5;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-budget") == 0 && i + 1 < argc) options.readBudget = atoi(argv[++i]);
+        if (strcmp(argv[i], "-priorities") == 0) options.priorities = true;
+        if (strcmp(argv[i], "-quiet") == 0 && i + 1 < argc) quietSessions = atoi(argv[++i]);
+        if (strcmp(argv[i], "-seconds") == 0 && i + 1 < argc) seconds = atoi(argv[++i]);
+    }
+
+    FairnessServer server(options);
+    std::thread serverThread([&server]() { server.listen(); });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    std::atomic<bool> done = false;
+    int noisy = logon("NOISY");
+    std::thread flooder([&]() {
+        // a batch of orders per write, so the noisy session always has data pending
+        int seqNum = 2;
+        FixBuilder body;
+        while (!done) {
+            std::string batch;
+            for (int i = 0; i < 64; i++) {
+                body.addField(11, seqNum);
+                batch += bench::encode("D", "NOISY", "SERVER", seqNum++, body);
+            }
+            if (!bench::writeAll(noisy, batch)) return;
+        }
+    });
+
+    std::vector<std::vector<long>> latencies(quietSessions);
+    std::vector<std::thread> clients;
+    for (int c = 0; c < quietSessions; c++) {
+        clients.emplace_back([&, c]() {
+            auto client = "QUIET_" + std::to_string(c);
+            int fd = logon(client);
+            std::string buffer, msg;
+            FixBuilder body;
+            for (int seqNum = 2; !done; seqNum++) {
+                body.addField(11, seqNum);
+                auto start = std::chrono::steady_clock::now();
+                bench::writeAll(fd, bench::encode("D", client, "SERVER", seqNum, body));
+                if (!bench::readMessage(fd, buffer, msg)) return;
+                latencies[c].push_back(bench::micros(std::chrono::steady_clock::now() - start));
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            ::close(fd);
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    done = true;
+    for (auto& client : clients) client.join();
+
+    std::vector<long> all;
+    for (auto& samples : latencies) all.insert(all.end(), samples.begin(), samples.end());
+    std::cout << "read budget " << options.readBudget << (options.priorities ? ", priorities" : "") << "\n";
+    std::cout << "noisy session: " << server.noisyOrders / seconds << " orders per second\n";
+    std::cout << "quiet sessions: " << all.size() << " round trips, p50 " << bench::percentile(all, 50) << " usec, p99 "
+              << bench::percentile(all, 99) << " usec, max " << bench::percentile(all, 100) << " usec\n";
+    std::cout << std::flush;
+    _exit(0);
+}
@@ -0,0 +1,108 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "bench_util.h"
+#include "fix_engine.h"
+#include "msg_logon.h"
+
+// Opens a large number of mostly idle loopback sessions against an in-process Acceptor, and reports
+// the resident memory per session and the logon rate.
+//
+// usage: bench_idle_sessions [count] [-compact] [-coroutines]
+//
+// Linux limits the number of connections per loopback address to the ephemeral port range, so the
+// connections are spread across 127.0.0.x, on macOS all connections use 127.0.0.1.
+
+static const int PORT = 9100;
+static const int PER_ADDRESS = 20000;
+
+class IdleServer : public Acceptor<> {
+   public:
+    IdleServer(EngineOptions options) : Acceptor(PORT, DefaultSessionConfig("SERVER", "*"), std::max(int(std::thread::hardware_concurrency() / 2), 1), options) {}
+    void onMessage(Session<>& session, const FixMessage& msg) override {}
+    bool validateLogon(const FixMessage& msg) override { return true; }
+};
+
+int main(int argc, char* argv[]) {
+    int count = 100000;
+    bool compact = false;
+    bool coroutines = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-compact") == 0) {
+            compact = true;
+        } else if (strcmp(argv[i], "-coroutines") == 0) {
+            coroutines = true;
+        } else if (strcmp(argv[i], "-h") == 0) {
+            std::cout << "usage: bench_idle_sessions [count] [-compact] [-coroutines]\n";
+            exit(0);
+        } else {
+            count = atoi(argv[i]);
+        }
+    }
+    // each session uses a client and a server socket
+    long limit = bench::raiseFileLimit(count * 2 + 64);
+    if (limit < count * 2 + 64) {
+        count = (limit - 64) / 2;
+        std::cout << "open file limit is " << limit << ", reducing session count to " << count << "\n";
+    }
+
+    auto baseRSS = bench::currentRSS();
+
+    auto options = compact ? EngineOptions::compact() : EngineOptions();
+    if (coroutines) options.coroutines = true;
+    IdleServer server(options);
+    std::thread serverThread([&server]() { server.listen(); });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    auto startRSS = bench::currentRSS();
+
+    std::vector<int> sockets;
+    sockets.reserve(count);
+    std::string buffer, msg;
+    FixBuilder body;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+#ifdef __APPLE__
+        auto addr = bench::loopback(PORT);
+#else
+        auto addr = bench::loopback(PORT, 1 + i / PER_ADDRESS);
+#endif
+        int fd = bench::connectTo(addr);
+        if (fd < 0) {
+            perror("connect");
+            break;
+        }
+        Logon::build(body);
+        if (!bench::writeAll(fd, bench::encode(Logon::msgType, "CLIENT_" + std::to_string(i), "SERVER", 1, body))) {
+            std::cerr << "unable to send logon\n";
+            break;
+        }
+        buffer.clear();
+        if (!bench::readMessage(fd, buffer, msg)) {
+            std::cerr << "no logon response\n";
+            break;
+        }
+        sockets.push_back(fd);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    // let the session fibers settle after their logon
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    auto endRSS = bench::currentRSS();
+
+    int sessions = sockets.size();
+    auto usec = bench::micros(end - start);
+    std::cout << (compact ? "compact" : "default") << " configuration\n";
+    std::cout << "logged on " << sessions << " sessions in " << usec / 1000 << " ms, logons per sec " << (long)(sessions / (usec / 1000000.0)) << "\n";
+    std::cout << "base rss " << baseRSS / 1024 << " KB, acceptor rss " << startRSS / 1024 << " KB, with sessions " << endRSS / 1024 << " KB\n";
+    if (sessions) {
+        std::cout << "rss per session " << (endRSS - startRSS) / sessions << " bytes\n";
+    }
+
+    // don't wait for 100k sessions to be torn down
+    std::cout << std::flush;
+    _exit(0);
+}
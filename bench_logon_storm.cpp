@@ -0,0 +1,112 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "fix_engine.h"
+#include "msg_logon.h"
+
+// Simulates the reconnect storm at market open: many clients connect and log on to an in-process Acceptor at
+// the same time. Reports the logons per second and the latency from connect() to the Logon response.
+//
+// usage: bench_logon_storm [count] [clients] [-backlog <n>] [-coroutines]
+
+static const int PORT = 9103;
+static const int PER_ADDRESS = 20000;
+
+class StormServer : public Acceptor<> {
+   public:
+    StormServer(EngineOptions options) : Acceptor(PORT, DefaultSessionConfig("SERVER", "*"), std::max(int(std::thread::hardware_concurrency() / 2), 1), options) {}
+    void onMessage(Session<>& session, const FixMessage& msg) override {}
+    bool validateLogon(const FixMessage& msg) override { return true; }
+};
+
+int main(int argc, char* argv[]) {
+    int count = 5000;
+    int clients = 100;
+    EngineOptions options;
+    for (int i = 1, n = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-backlog") == 0 && i + 1 < argc) {
+            options.backlog = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-coroutines") == 0) {
+            options.coroutines = true;
+        } else if (strcmp(argv[i], "-h") == 0) {
+            std::cout << "usage: bench_logon_storm [count] [clients] [-backlog <n>] [-coroutines]\n";
+            exit(0);
+        } else if (n++ == 0) {
+            count = atoi(argv[i]);
+        } else {
+            clients = atoi(argv[i]);
+        }
+    }
+    long limit = bench::raiseFileLimit(count * 2 + 64);
+    if (limit < count * 2 + 64) {
+        count = (limit - 64) / 2;
+        std::cout << "open file limit is " << limit << ", reducing session count to " << count << "\n";
+    }
+
+    StormServer server(options);
+    std::thread serverThread([&server]() { server.listen(); });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    // each client connects and logs on its share of the sessions one after another, keeping the sockets open
+    std::atomic<int> next = 0, failed = 0;
+    std::mutex lock;
+    std::vector<long> latencies;
+    std::vector<int> sockets;
+    latencies.reserve(count);
+    sockets.reserve(count);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; c++) {
+        threads.emplace_back([&]() {
+            std::string buffer, msg;
+            FixBuilder body;
+            int i;
+            while ((i = next++) < count) {
+#ifdef __APPLE__
+                auto addr = bench::loopback(PORT);
+#else
+                auto addr = bench::loopback(PORT, 1 + i / PER_ADDRESS);
+#endif
+                auto connectStart = std::chrono::steady_clock::now();
+                int fd = bench::connectTo(addr);
+                if (fd < 0) {
+                    failed++;
+                    continue;
+                }
+                // a connection dropped from a full accept queue is only established on the client side
+                struct timeval timeout = {5, 0};
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                Logon::build(body);
+                buffer.clear();
+                if (!bench::writeAll(fd, bench::encode(Logon::msgType, "CLIENT_" + std::to_string(i), "SERVER", 1, body)) ||
+                    !bench::readMessage(fd, buffer, msg)) {
+                    failed++;
+                    ::close(fd);
+                    continue;
+                }
+                auto latency = bench::micros(std::chrono::steady_clock::now() - connectStart);
+                std::lock_guard<std::mutex> mu(lock);
+                latencies.push_back(latency);
+                sockets.push_back(fd);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    auto usec = bench::micros(std::chrono::steady_clock::now() - start);
+
+    int sessions = latencies.size();
+    std::cout << "backlog " << options.backlog << ", " << clients << " concurrent clients" << (options.coroutines ? ", coroutines" : "") << "\n";
+    std::cout << "logged on " << sessions << " sessions in " << usec / 1000 << " ms, " << failed << " failed, sessions per sec " << (long)(sessions / (usec / 1000000.0)) << "\n";
+    std::cout << "logon latency usec p50 " << bench::percentile(latencies, 50) << " p99 " << bench::percentile(latencies, 99) << " max " << bench::percentile(latencies, 100) << "\n";
+
+    // don't wait for the sessions to be torn down
+    std::cout << std::flush;
+    _exit(0);
+}
@@ -0,0 +1,283 @@
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "fix_engine.h"
+#include "framing.h"
+#include "msg_logon.h"
+#include "msg_orders.h"
+#include "park_unpark.h"
+#include "poller.h"
+
+// Microbenchmarks of the components on the message path, each reported as the median over several runs of the
+// nanoseconds per operation:
+//
+//   send_message      build a NewOrderSingle and Session::sendMessage() it, the session writes to /dev/null
+//   framing_parse     Framing::messageLength() and FixMessage::parse() of a received NewOrderSingle
+//   session_dispatch  Session::handle() reading, parsing and dispatching orders sent over a Unix domain socket
+//   poller_wakeup     the median latency from a socket becoming readable until the thread waiting on it is unparked
+//                     by the Poller callback
+//   session_lookup    Acceptor::isLoggedOn() with 256 logged on sessions, the lookup of Acceptor::sendMessage()
+//
+// -json writes the results to the file, compare two runs with bench_compare.sh. make bench writes bin/bench.json.
+//
+// usage: bench_micro [-json <file>] [-iterations <n>] [-repeat <runs>]
+
+// prevents the compiler removing the work
+static volatile size_t sink;
+
+static double nanosSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void buildOrder(FixBuilder& body, int i) {
+    NewOrderSingle::build<7>(body, "IBM", OrderType::Limit, OrderSide::Buy, F(100.0), F(10.0), "B" + std::to_string(i));
+}
+
+struct NullHandler : SessionHandler<> {
+    void onMessage(Session<>& session, const FixMessage& msg) override {}
+    bool validateLogon(const FixMessage& msg) override { return true; }
+    void onDisconnected(const Session<>& session) override {}
+    void onLoggedOn(const Session<>& session) override {}
+};
+
+// a session on a file rather than a socket, so only the encoding and the write system call are measured
+class NullSession : public Session<> {
+   public:
+    NullSession(int fd, SessionHandler<>& handler) : Session(fd, handler, DefaultSessionConfig("SERVER", "BENCH")) {}
+};
+
+static double sendMessage(int n) {
+    int fd = ::open("/dev/null", O_WRONLY);
+    NullHandler handler;
+    NullSession session(fd, handler);
+    FixBuilder body;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) {
+        buildOrder(body, i);
+        session.sendMessage(NewOrderSingle::msgType, body);
+    }
+    auto nanos = nanosSince(start);
+    ::close(fd);
+    return nanos / n;
+}
+
+// the received bytes, as read into the session's socket buffer
+struct ReceivedBuf : std::streambuf {
+    void reset(std::string& bytes) { setg(bytes.data(), bytes.data(), bytes.data() + bytes.size()); }
+};
+
+static double framingParse(int n) {
+    const int batch = 1000;
+    std::string bytes;
+    FixBuilder body;
+    for (int i = 0; i < batch; i++) {
+        buildOrder(body, i);
+        bytes += bench::encode(NewOrderSingle::msgType, "BENCH", "SERVER", i + 1, body);
+    }
+    ReceivedBuf buf;
+    std::istream is(&buf);
+    FixMessage msg;
+    size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int parsed = 0; parsed < n;) {
+        buf.reset(bytes);
+        is.clear();
+        for (size_t offset = 0; offset < bytes.size() && parsed < n; parsed++) {
+            auto length = Framing::messageLength(bytes.data() + offset, bytes.size() - offset);
+            FixMessage::parse(is, msg, GroupDefs());
+            offset += length;
+            total += length;
+        }
+    }
+    auto nanos = nanosSince(start);
+    sink = total;
+    return nanos / n;
+}
+
+// counts the application messages received
+class CountingAcceptor : public Acceptor<> {
+   public:
+    std::atomic<int> received{0};
+    CountingAcceptor(const std::string& path) : Acceptor(Endpoint::unixDomain(path), DefaultSessionConfig("SERVER", "*"), 1) {}
+    void onMessage(Session<>& session, const FixMessage& msg) override { received.fetch_add(1, std::memory_order_relaxed); }
+    bool validateLogon(const FixMessage& msg) override { return true; }
+};
+
+// connect and log on as the sender, returns the socket
+static int logon(const std::string& path, const std::string& sender) {
+    int fd = bench::connectTo(path);
+    if (fd < 0) {
+        perror("connect");
+        exit(1);
+    }
+    FixBuilder body;
+    Logon::build(body);
+    std::string buffer, msg;
+    if (!bench::writeAll(fd, bench::encode(Logon::msgType, sender, "SERVER", 1, body)) || !bench::readMessage(fd, buffer, msg)) {
+        fprintf(stderr, "no logon response for %s\n", sender.c_str());
+        exit(1);
+    }
+    return fd;
+}
+
+// a logged on client sending to a CountingAcceptor
+struct DispatchClient {
+    CountingAcceptor& server;
+    int fd;
+    int seqNum = 2;
+};
+
+static double sessionDispatch(DispatchClient& client, int n) {
+    std::string bytes;
+    FixBuilder body;
+    for (int i = 0; i < n; i++) {
+        buildOrder(body, i);
+        bytes += bench::encode(NewOrderSingle::msgType, "DISPATCH", "SERVER", client.seqNum++, body);
+    }
+    int expected = client.server.received + n;
+    auto start = std::chrono::steady_clock::now();
+    if (!bench::writeAll(client.fd, bytes)) {
+        perror("write");
+        exit(1);
+    }
+    while (client.server.received < expected) std::this_thread::yield();
+    return nanosSince(start) / n;
+}
+
+static double pollerWakeup(int n) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    Poller poller;
+    ParkSupport waiting;
+    poller.add_socket(fds[0], nullptr, [&](struct kevent& event, void* data) {
+        char c;
+        if (::read(fds[0], &c, 1) == 1) waiting.unpark();
+    });
+    std::thread pollerThread([&] {
+        while (poller.running) poller.poll();
+    });
+    std::vector<double> samples;
+    samples.reserve(n);
+    for (int i = 0; i < n; i++) {
+        auto start = std::chrono::steady_clock::now();
+        if (::write(fds[1], "x", 1) != 1) break;
+        waiting.park();
+        samples.push_back(nanosSince(start));
+    }
+    // the last write wakes the poller to see it is stopped
+    poller.running = false;
+    if (::write(fds[1], "x", 1) != 1) perror("write");
+    pollerThread.join();
+    poller.remove_socket(fds[0]);
+    ::close(fds[0]);
+    ::close(fds[1]);
+    return bench::percentile(samples, 50);
+}
+
+static double sessionLookup(CountingAcceptor& server, const std::vector<std::string>& ids, int n) {
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) found += server.isLoggedOn(ids[i % ids.size()]);
+    auto nanos = nanosSince(start);
+    if (found != size_t(n)) {
+        fprintf(stderr, "only %zu of %d lookups found the session\n", found, n);
+        exit(1);
+    }
+    sink = found;
+    return nanos / n;
+}
+
+struct Result {
+    std::string name;
+    int iterations;
+    double nanos;
+};
+
+template <class Fn>
+static void run(std::vector<Result>& results, const char* name, int iterations, int repeat, Fn fn) {
+    std::vector<double> runs;
+    for (int i = 0; i < repeat; i++) runs.push_back(fn(iterations));
+    auto nanos = bench::percentile(runs, 50);
+    printf("%-18s %12d %12.1f\n", name, iterations, nanos);
+    fflush(stdout);
+    results.push_back(Result{name, iterations, nanos});
+}
+
+static void writeJson(const std::string& path, const std::vector<Result>& results) {
+    std::ofstream os(path);
+    os << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& result = results[i];
+        char nanos[32];
+        snprintf(nanos, sizeof(nanos), "%.1f", result.nanos);
+        os << "    {\"name\": \"" << result.name << "\", \"iterations\": " << result.iterations << ", \"ns_per_op\": " << nanos << "}"
+           << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+    if (!os) {
+        fprintf(stderr, "unable to write %s\n", path.c_str());
+        exit(1);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string json;
+    int iterations = 100000;
+    int repeat = 5;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-json" && i + 1 < argc) {
+            json = argv[++i];
+        } else if (arg == "-iterations" && i + 1 < argc) {
+            iterations = std::max(atoi(argv[++i]), 10);
+        } else if (arg == "-repeat" && i + 1 < argc) {
+            repeat = std::max(atoi(argv[++i]), 1);
+        } else {
+            fprintf(stderr, "usage: %s [-json <file>] [-iterations <n>] [-repeat <runs>]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    auto path = "/tmp/bench_micro." + std::to_string(getpid());
+    CountingAcceptor server(path);
+    std::thread serverThread([&server]() { server.listen(); });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    DispatchClient client{server, logon(path, "DISPATCH")};
+    std::vector<std::string> ids;
+    std::vector<int> lookupClients;
+    for (int i = 0; i < 256; i++) {
+        auto sender = "L" + std::to_string(i);
+        lookupClients.push_back(logon(path, sender));
+        ids.push_back("SERVER:" + sender);
+    }
+
+    std::vector<Result> results;
+    printf("%-18s %12s %12s\n", "benchmark", "iterations", "ns/op");
+    run(results, "send_message", iterations, repeat, sendMessage);
+    run(results, "framing_parse", iterations, repeat, framingParse);
+    run(results, "session_dispatch", iterations, repeat, [&](int n) { return sessionDispatch(client, n); });
+    run(results, "poller_wakeup", iterations / 10, repeat, pollerWakeup);
+    run(results, "session_lookup", iterations * 10, repeat, [&](int n) { return sessionLookup(server, ids, n); });
+    if (!json.empty()) writeJson(json, results);
+
+    ::unlink(path.c_str());
+    std::cout << std::flush;
+    _exit(0);
+}
@@ -0,0 +1,87 @@
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "bench_util.h"
+#include "exchange.h"
+#include "fix_engine.h"
+#include "msg_logon.h"
+#include "msg_orders.h"
+
+// Measures the orders per second and the fill latency of the Exchange. A single client rests a sell order,
+// then sends a crossing buy order and waits for both fills. The fill latency is from sending the buy order
+// until the last fill is received.
+//
+// usage: bench_orders [count]
+
+static const int PORT = 9102;
+
+class ExchangeServer : public Acceptor<> {
+    Exchange exchange{*this};
+
+   public:
+    ExchangeServer() : Acceptor(PORT, DefaultSessionConfig("SERVER", "*")) {}
+    void onMessage(Session<>& session, const FixMessage& msg) override { exchange.onMessage(session, msg); }
+    void onDisconnected(const Session<>& session) override {
+        exchange.onDisconnected(session);
+        Acceptor::onDisconnected(session);
+    }
+    bool validateLogon(const FixMessage& msg) override { return true; }
+};
+
+// read messages until one containing the field, e.g. 39=2 for a fill
+static bool readUntil(int fd, std::string& buffer, std::string& msg, const std::string& field) {
+    while (bench::readMessage(fd, buffer, msg)) {
+        if (msg.find("\001" + field + "\001") != std::string::npos) return true;
+    }
+    return false;
+}
+
+int main(int argc, char* argv[]) {
+    int count = 100000;
+    if (argc > 1) count = atoi(argv[1]);
+
+    ExchangeServer server;
+    std::thread serverThread([&server]() { server.listen(); });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    int fd = bench::connectTo(bench::loopback(PORT));
+    if (fd < 0) {
+        perror("connect");
+        exit(1);
+    }
+    std::string buffer, msg;
+    FixBuilder body;
+    int seqNum = 1;
+    Logon::build(body);
+    bench::writeAll(fd, bench::encode(Logon::msgType, "BENCH", "SERVER", seqNum++, body));
+    if (!bench::readMessage(fd, buffer, msg)) {
+        std::cerr << "no logon response\n";
+        exit(1);
+    }
+
+    std::vector<long> latencies;
+    latencies.reserve(count);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        auto id = std::to_string(i);
+        NewOrderSingle::build<7>(body, "IBM", OrderType::Limit, OrderSide::Sell, F(100.0), F(10.0), "S" + id);
+        bench::writeAll(fd, bench::encode(NewOrderSingle::msgType, "BENCH", "SERVER", seqNum++, body));
+        if (!readUntil(fd, buffer, msg, "39=0")) break;
+
+        auto sent = std::chrono::steady_clock::now();
+        NewOrderSingle::build<7>(body, "IBM", OrderType::Limit, OrderSide::Buy, F(100.0), F(10.0), "B" + id);
+        bench::writeAll(fd, bench::encode(NewOrderSingle::msgType, "BENCH", "SERVER", seqNum++, body));
+        // the fill of the resting sell, then the fill of the buy
+        if (!readUntil(fd, buffer, msg, "39=2") || !readUntil(fd, buffer, msg, "39=2")) break;
+        latencies.push_back(bench::micros(std::chrono::steady_clock::now() - sent));
+    }
+    auto usec = bench::micros(std::chrono::steady_clock::now() - start);
+
+    std::cout << latencies.size() << " fills, " << (int)(latencies.size() * 2 / (usec / 1000000.0)) << " orders per sec\n";
+    std::cout << "fill latency usec, p50 " << bench::percentile(latencies, 50) << " p99 " << bench::percentile(latencies, 99) << " max " << bench::percentile(latencies, 100) << "\n";
+
+    ::close(fd);
+    std::cout << std::flush;
+    _exit(0);
+}
@@ -0,0 +1,63 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "risk.h"
+
+// Measures the per-message cost of the PreTradeRisk checks on a parsed NewOrderSingle, from a single thread and
+// from several threads sharing the account.
+//
+// usage: bench_risk [count] [threads]
+
+static void parse(const std::string& encoded, FixMessage& msg) {
+    std::istringstream is(encoded);
+    FixMessage::parse(is, msg, GroupDefs());
+}
+
+static double run(PreTradeRisk& risk, const FixMessage& msg, int count, int threads) {
+    std::vector<std::thread> workers;
+    std::atomic<int> rejected = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&]() {
+            for (int i = 0; i < count; i++) {
+                if (risk.check(msg)) rejected++;
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    auto usec = bench::micros(std::chrono::steady_clock::now() - start);
+    if (rejected) std::cerr << rejected << " rejected\n";
+    return usec * 1000.0 / count;
+}
+
+int main(int argc, char* argv[]) {
+    int count = 10000000;
+    int threads = 4;
+    if (argc > 1) count = atoi(argv[1]);
+    if (argc > 2) threads = atoi(argv[2]);
+
+    PreTradeRisk risk;
+    RiskLimits limits;
+    limits.maxOrderQty = 1000;
+    limits.maxNotional = 1000000 * OrderBook::SCALE;
+    limits.maxPosition = 1L << 40;
+    limits.priceBandPercent = 10;
+    risk.addAccount("BENCH", limits);
+    risk.addSymbol("IBM", 100 * OrderBook::SCALE);
+
+    FixBuilder body;
+    NewOrderSingle::build<7>(body, "IBM", OrderType::Limit, OrderSide::Buy, F(100.25), F(10.0), "MyOrder");
+    FixMessage msg;
+    parse(bench::encode(NewOrderSingle::msgType, "BENCH", "SERVER", 1, body), msg);
+    if (auto reason = risk.check(msg)) {
+        std::cerr << "order rejected: " << reason << "\n";
+        exit(1);
+    }
+
+    std::cout << "1 thread: " << run(risk, msg, count, 1) << " nsec per check\n";
+    std::cout << threads << " threads, shared account: " << run(risk, msg, count, threads) << " nsec per check (elapsed per thread)\n";
+}
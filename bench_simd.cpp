@@ -0,0 +1,66 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "simd.h"
+
+// Compares the scalar and vector kernels used for framing and checksums, over FIX like messages of 64 bytes to 4 KB.
+// "split" finds every SOH in the message as a parser splitting fields would, "scan" finds a SOH at the end of the
+// message, e.g. the end of a long field, and "sum" computes the CheckSum.
+//
+// usage: bench_simd [iterations]
+
+static std::string message(size_t size) {
+    std::string msg;
+    for (int tag = 100; msg.size() < size; tag++) {
+        msg += std::to_string(tag) + "=VALUE" + std::to_string(tag * 31) + "\001";
+    }
+    msg.resize(size);
+    msg.back() = '\001';
+    return msg;
+}
+
+// prevents the compiler removing the kernels
+static volatile size_t sink;
+
+template <class Fn>
+static double nanosPer(int iterations, Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    size_t total = 0;
+    for (int i = 0; i < iterations; i++) total += fn();
+    sink = total;
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = 1000000;
+    if (argc > 1) iterations = atoi(argv[1]);
+
+    std::vector<simd::Level> levels = {simd::Level::Scalar};
+#ifdef SIMD_X86
+    levels.push_back(simd::Level::SSE2);
+    if (simd::detect() == simd::Level::AVX2) levels.push_back(simd::Level::AVX2);
+#endif
+    printf("cpu level %s\n", simd::name(simd::detect()));
+    printf("%6s %-7s %10s %10s %10s %10s\n", "size", "kernel", "split ns", "scan ns", "sum ns", "sum GB/s");
+    for (size_t size : {64, 256, 1024, 4096}) {
+        auto msg = message(size);
+        auto p = msg.data();
+        std::string scan(size - 1, 'x');
+        scan += '\001';
+        int n = std::max(int(iterations * 64 / size), 1000);
+        for (auto level : levels) {
+            auto kernels = simd::Kernels::of(level);
+            auto split = nanosPer(n, [&] {
+                size_t fields = 0;
+                for (size_t pos = 0; pos < size; pos += kernels.find(p + pos, size - pos, '\001') + 1) fields++;
+                return fields;
+            });
+            auto end = nanosPer(n, [&] { return kernels.find(scan.data(), size, '\001'); });
+            auto sum = nanosPer(n, [&] { return size_t(kernels.sum(p, size)); });
+            printf("%6zu %-7s %10.1f %10.1f %10.1f %10.2f\n", size, simd::name(level), split, end, sum, size / sum);
+        }
+    }
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+// helpers shared by the bench_* programs, which drive the engine using raw sockets so that
+// the client side cost is not included in the measurements
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
+#include "fix_builder.h"
+
+namespace bench {
+
+// resident set size of the process in bytes
+inline long currentRSS() {
+#ifdef __APPLE__
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return 0;
+    return info.resident_size;
+#else
+    long pages = 0, resident = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (!fp) return 0;
+    if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    fclose(fp);
+    return resident * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+// raise the open file limit to allow n sockets, returns the resulting limit
+inline long raiseFileLimit(long n) {
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    if (rl.rlim_cur < (rlim_t)n) {
+        rl.rlim_cur = std::min((rlim_t)n, rl.rlim_max);
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    return rl.rlim_cur;
+}
+
+inline sockaddr_in loopback(int port, int address = 1) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(0x7F000000 | address);
+    return addr;
+}
+
+// a blocking TCP connection, or -1 on error
+inline int connectTo(const sockaddr_in& addr) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (::connect(fd, (const sockaddr*)&addr, sizeof(addr)) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    int flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    return fd;
+}
+
+// a blocking Unix domain socket connection, or -1 on error
+inline int connectTo(const std::string& path) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (::connect(fd, (const sockaddr*)&addr, sizeof(addr)) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// render a complete message including header and trailer, body is reset
+inline std::string encode(const std::string& msgType, const std::string& senderCompId, const std::string& targetCompId, int seqNum, FixBuilder& body) {
+    FixBuilder msg;
+    msg.addField(8, "FIX.4.4");
+    msg.addField(9, "0000");
+    msg.addField(35, msgType);
+    msg.addTimeNow(52);
+    msg.addField(49, senderCompId);
+    msg.addField(56, targetCompId);
+    msg.addField(34, seqNum);
+    msg.addBuilder(body);
+    std::ostringstream os;
+    msg.writeTo(os);
+    return os.str();
+}
+
+inline bool writeAll(int fd, const std::string& data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+        auto n = ::write(fd, data.data() + offset, data.size() - offset);
+        if (n <= 0) return false;
+        offset += n;
+    }
+    return true;
+}
+
+// offset past the end of the first complete message in buffer, or 0 if there is none
+inline size_t messageEnd(const std::string& buffer) {
+    auto trailer = buffer.find("\00110=");
+    if (trailer == std::string::npos) return 0;
+    auto end = buffer.find('\001', trailer + 4);
+    return end == std::string::npos ? 0 : end + 1;
+}
+
+// blocking read of the next complete message from fd into msg, buffer holds any remaining bytes
+inline bool readMessage(int fd, std::string& buffer, std::string& msg) {
+    char tmp[4096];
+    size_t end;
+    while ((end = messageEnd(buffer)) == 0) {
+        auto n = ::read(fd, tmp, sizeof(tmp));
+        if (n <= 0) return false;
+        buffer.append(tmp, n);
+    }
+    msg = buffer.substr(0, end);
+    buffer.erase(0, end);
+    return true;
+}
+
+// the value at the given percentile (0-100) of the samples, which are sorted in place
+template <typename T>
+T percentile(std::vector<T>& samples, double p) {
+    if (samples.empty()) return T();
+    std::sort(samples.begin(), samples.end());
+    size_t index = std::min(samples.size() - 1, size_t(samples.size() * p / 100));
+    return samples[index];
+}
+
+inline long micros(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+}  // namespace bench
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "affinity.h"
+
+// A pool of fixed size I/O buffers shared by many sessions. A Socketbuf in borrow mode
+// only holds a buffer while it has data pending, so idle sessions hold no buffer memory.
+//
+// A pool for a NUMA node allocates the buffers in mapped slabs bound to the node, see Affinity.
+class BufferPool {
+    static const size_t SLAB_BUFFERS = 64;
+
+    const size_t bufferSize;
+    const int node;
+    std::mutex lock;
+    std::vector<char*> available;
+    std::vector<std::pair<void*, size_t>> slabs;
+
+    // add a slab of buffers bound to the node to the available buffers, with the lock held
+    void allocateSlab() {
+        size_t pageSize = ::sysconf(_SC_PAGESIZE);
+        size_t len = (bufferSize * SLAB_BUFFERS + pageSize - 1) / pageSize * pageSize;
+        void* vp = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (vp == MAP_FAILED) throw std::bad_alloc();
+        Affinity::bindToNode(vp, len, node);
+        slabs.emplace_back(vp, len);
+        for (size_t i = 0; i < SLAB_BUFFERS; i++) available.push_back(static_cast<char*>(vp) + i * bufferSize);
+    }
+
+   public:
+    BufferPool(size_t bufferSize = 4096, int node = -1) : bufferSize(bufferSize), node(node) {}
+    ~BufferPool() {
+        if (node < 0) {
+            for (auto buffer : available) delete[] buffer;
+        }
+        for (auto& slab : slabs) ::munmap(slab.first, slab.second);
+    }
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    size_t size() const { return bufferSize; }
+
+    char* acquire() {
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            if (available.empty() && node >= 0) allocateSlab();
+            if (!available.empty()) {
+                auto buffer = available.back();
+                available.pop_back();
+                return buffer;
+            }
+        }
+        return new char[bufferSize];
+    }
+    void release(char* buffer) {
+        std::lock_guard<std::mutex> mu(lock);
+        available.push_back(buffer);
+    }
+    // the pool used by sessions that are not given one explicitly
+    static BufferPool& shared() {
+        static BufferPool pool;
+        return pool;
+    }
+};
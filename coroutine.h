@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <thread>
+#include <vector>
+
+#include "affinity.h"
+
+// A detached coroutine. It is started by CoroScheduler::spawn() and its frame is destroyed when it completes.
+struct Task {
+    struct promise_type {
+        Task get_return_object() { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+    std::coroutine_handle<> handle;
+};
+
+// A thread resuming the coroutines scheduled on it in order. The run queue is guarded by a spin lock held only to
+// push or swap the queue, and the thread sleeps on an atomic wait when idle, so a wakeup is a system call only
+// when the thread is asleep.
+class CoroScheduler {
+    std::atomic_flag queueLock = ATOMIC_FLAG_INIT;
+    std::vector<std::coroutine_handle<>> queue;
+    std::atomic<uint32_t> epoch{0};
+    std::atomic<bool> sleeping{false};
+    std::atomic<bool> stopped{false};
+    std::thread thread;
+
+    void lock() {
+        while (queueLock.test_and_set(std::memory_order_acquire)) std::this_thread::yield();
+    }
+    void unlock() { queueLock.clear(std::memory_order_release); }
+
+    void run(int cpu) {
+        if (cpu >= 0) Affinity::pin(cpu);
+        std::vector<std::coroutine_handle<>> running;
+        while (true) {
+            lock();
+            running.swap(queue);
+            unlock();
+            for (auto handle : running) handle.resume();
+            if (!running.empty()) {
+                running.clear();
+                continue;
+            }
+            if (stopped) return;
+            sleeping.store(true);
+            auto observed = epoch.load();
+            lock();
+            bool empty = queue.empty();
+            unlock();
+            if (empty && !stopped) epoch.wait(observed);
+            sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+   public:
+    // the thread is pinned to the cpu if not -1, see Affinity
+    CoroScheduler(int cpu = -1) : thread(&CoroScheduler::run, this, cpu) {}
+    ~CoroScheduler() { stop(); }
+
+    // resume the coroutine on the scheduler's thread, may be called from any thread
+    void schedule(std::coroutine_handle<> handle) {
+        lock();
+        queue.push_back(handle);
+        unlock();
+        epoch.fetch_add(1);
+        if (sleeping.load()) epoch.notify_one();
+    }
+    void spawn(Task task) { schedule(task.handle); }
+    // awaited to resume the coroutine after those already scheduled
+    struct Yield {
+        CoroScheduler& scheduler;
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { scheduler.schedule(handle); }
+        void await_resume() {}
+    };
+    Yield yield() { return Yield{*this}; }
+    // stop the thread once the scheduled coroutines have run, suspended coroutines are not resumed
+    void stop() {
+        if (!thread.joinable()) return;
+        stopped = true;
+        epoch.fetch_add(1);
+        epoch.notify_one();
+        thread.join();
+    }
+};
+
+// The coroutine equivalent of ParkSupport, a single coroutine awaits the CoroParker until unpark() is called
+// from any thread. An unpark() before the await is remembered, so the await does not suspend.
+class CoroParker {
+    static constexpr uintptr_t EMPTY = 0, SIGNALED = 1;
+    // EMPTY, SIGNALED or the address of the suspended coroutine
+    std::atomic<uintptr_t> state{EMPTY};
+
+   public:
+    CoroScheduler* scheduler = nullptr;
+
+    void unpark() {
+        auto current = state.load();
+        while (true) {
+            if (current == SIGNALED) return;
+            if (current == EMPTY) {
+                if (state.compare_exchange_weak(current, SIGNALED)) return;
+            } else if (state.compare_exchange_weak(current, EMPTY)) {
+                scheduler->schedule(std::coroutine_handle<>::from_address(reinterpret_cast<void*>(current)));
+                return;
+            }
+        }
+    }
+
+    bool await_ready() {
+        auto signaled = SIGNALED;
+        return state.compare_exchange_strong(signaled, EMPTY);
+    }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        auto empty = EMPTY;
+        if (state.compare_exchange_strong(empty, reinterpret_cast<uintptr_t>(handle.address()))) return true;
+        // unparked since await_ready()
+        state.store(EMPTY);
+        return false;
+    }
+    void await_resume() {}
+};
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "fix_builder.h"
+
+// A bounded multiple producer/single consumer queue which never blocks, after D. Vyukov's bounded MPMC queue. Each
+// cell has a sequence number telling the producers and the consumer whose turn it is, so the only contended write
+// is the producers' increment of the tail. The capacity is rounded up to a power of two.
+template <typename T>
+class MpscQueue {
+    struct alignas(64) Cell {
+        std::atomic<uint64_t> sequence;
+        T value;
+    };
+    const uint64_t mask;
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<uint64_t> tail{0};
+    // only used by the consumer
+    alignas(64) uint64_t head = 0;
+
+   public:
+    explicit MpscQueue(size_t capacity) : mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1), cells(new Cell[mask + 1]) {
+        for (uint64_t i = 0; i <= mask; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // fill(T&) assigns the value in place, so its storage is reused. Returns false if the queue is full
+    template <typename Fill>
+    bool tryPush(Fill&& fill) {
+        auto pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            auto& cell = cells[pos & mask];
+            auto diff = int64_t(cell.sequence.load(std::memory_order_acquire)) - int64_t(pos);
+            if (diff < 0) return false;
+            if (diff > 0) {
+                // another producer took the cell
+                pos = tail.load(std::memory_order_relaxed);
+            } else if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                fill(cell.value);
+                cell.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+    }
+    // returns false if the queue is empty, only called by the consumer. The value is swapped with the cell's, so
+    // the storage of the previous value is reused by the producers
+    bool tryPop(T& value) {
+        auto& cell = cells[head & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != head + 1) return false;
+        std::swap(value, cell.value);
+        cell.sequence.store(head + mask + 1, std::memory_order_release);
+        head++;
+        return true;
+    }
+};
+
+// an outbound message copied to the drop copy sessions
+struct DropCopyMessage {
+    std::string msgType;
+    // the TargetCompID of the session the message was sent to, added to the copies as DeliverToCompID
+    std::string deliverTo;
+    // the message as written to the session's socket
+    std::string bytes;
+};
+
+// a streambuf appending the bytes written to a string, so a message can be encoded into reused storage
+class StringAppendBuf : public std::streambuf {
+    std::string& str;
+
+   protected:
+    int_type overflow(int_type c) override {
+        if (c != traits_type::eof()) str.push_back(traits_type::to_char_type(c));
+        return c;
+    }
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        str.append(s, n);
+        return n;
+    }
+
+   public:
+    explicit StringAppendBuf(std::string& str) : str(str) {}
+};
+
+struct DropCopyStats {
+    // the messages queued for the drop copy sessions
+    std::atomic<uint64_t> copied{0};
+    // the messages not copied since the queue was full
+    std::atomic<uint64_t> dropped{0};
+};
+
+// Copies selected outbound messages of all sessions to the drop copy sessions, see Acceptor::addDropCopy(). The
+// sessions push the bytes of the messages they send to a lock-free queue and a writer thread re-encodes the body
+// for the drop copy sessions, so a slow drop copy consumer never delays the sending session. If the queue is full
+// the copy is dropped.
+class DropCopy {
+    struct Target {
+        std::string sessionId;
+        std::vector<std::string> msgTypes;
+    };
+    // fixed once the writer is started
+    std::vector<Target> targets;
+    std::vector<std::string> msgTypes;
+    MpscQueue<DropCopyMessage> queue;
+    DropCopyStats dropCopyStats;
+    std::atomic<bool> running{false};
+    // set by the writer before it waits for a message, so the producers only wake it when it is waiting
+    std::atomic<bool> writerIdle{false};
+    std::thread writer;
+
+    static bool contains(const std::vector<std::string>& msgTypes, std::string_view msgType) {
+        return std::find(msgTypes.begin(), msgTypes.end(), msgType) != msgTypes.end();
+    }
+    // the standard header and trailer fields, which the drop copy session encodes itself
+    static bool isHeaderTag(int tag) {
+        switch (tag) {
+            case 8: case 9: case 10: case 34: case 35: case 43: case 49: case 50: case 52: case 56: case 57: case 89:
+            case 90: case 91: case 93: case 97: case 115: case 116: case 122: case 128: case 129: case 142: case 143:
+            case 144: case 145: case 212: case 213: case 347: case 369: case 627: case 1128: case 1129:
+                return true;
+        }
+        return false;
+    }
+    // add the body fields of the encoded message to the builder
+    static void addBody(FixBuilder& msg, std::string_view bytes) {
+        while (!bytes.empty()) {
+            auto end = bytes.find('\001');
+            auto field = bytes.substr(0, end);
+            bytes.remove_prefix(end == std::string_view::npos ? bytes.size() : end + 1);
+            auto equals = field.find('=');
+            if (equals == std::string_view::npos) continue;
+            int tag = 0;
+            for (auto c : field.substr(0, equals)) tag = tag * 10 + (c - '0');
+            if (!isHeaderTag(tag)) msg.addField(tag, field.substr(equals + 1));
+        }
+    }
+    void wakeWriter() {
+        if (writerIdle.exchange(false)) writerIdle.notify_one();
+    }
+
+   public:
+    // sends a copy to the session with the id, if it is logged on
+    typedef std::function<void(const std::string& sessionId, const std::string& msgType, FixBuilder& msg)> Sender;
+
+    explicit DropCopy(size_t capacity) : queue(capacity) {}
+    ~DropCopy() { stop(); }
+
+    void addTarget(const std::string& sessionId, std::vector<std::string> types) {
+        for (auto& msgType : types) {
+            if (!contains(msgTypes, msgType)) msgTypes.push_back(msgType);
+        }
+        targets.push_back(Target{sessionId, std::move(types)});
+    }
+    bool isTarget(const std::string& sessionId) const {
+        return std::any_of(targets.begin(), targets.end(), [&](auto& target) { return target.sessionId == sessionId; });
+    }
+    // true if any drop copy session receives the message type
+    bool copies(std::string_view msgType) const {
+        return contains(msgTypes, msgType);
+    }
+    // queue a copy of the encoded message sent to the target, called by any session
+    void push(const std::string& msgType, const std::string& deliverTo, std::string_view bytes) {
+        bool pushed = queue.tryPush([&](DropCopyMessage& copy) {
+            copy.msgType = msgType;
+            copy.deliverTo = deliverTo;
+            copy.bytes.assign(bytes);
+        });
+        if (!pushed) {
+            dropCopyStats.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        dropCopyStats.copied.fetch_add(1, std::memory_order_relaxed);
+        // orders the push before reading writerIdle, paired with the fence in the writer
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (writerIdle.load(std::memory_order_relaxed)) wakeWriter();
+    }
+    const DropCopyStats& stats() const {
+        return dropCopyStats;
+    }
+
+    void start(Sender send) {
+        running = true;
+        writer = std::thread([this, send = std::move(send)] {
+            DropCopyMessage copy;
+            FixBuilder msg;
+            while (running) {
+                if (!queue.tryPop(copy)) {
+                    writerIdle.store(true);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    // stop() clears writerIdle after running, so the wait returns if it was missed
+                    if (!running) break;
+                    if (!queue.tryPop(copy)) {
+                        writerIdle.wait(true);
+                        continue;
+                    }
+                    writerIdle.store(false, std::memory_order_relaxed);
+                }
+                // the copy is encoded with the drop copy session's header, like any message it sends
+                for (auto& target : targets) {
+                    if (!contains(target.msgTypes, copy.msgType)) continue;
+                    msg.reset();
+                    msg.addField(128, copy.deliverTo);
+                    addBody(msg, copy.bytes);
+                    send(target.sessionId, copy.msgType, msg);
+                }
+            }
+        });
+    }
+    // stop the writer, discarding the queued messages
+    void stop() {
+        if (!running.exchange(false)) return;
+        writerIdle.store(false);
+        writerIdle.notify_one();
+        writer.join();
+    }
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "fix_builder.h"
+#include "simd.h"
+
+// A message encoded once for sending to many sessions. Only the standard header fields that vary by session
+// (SenderCompID, TargetCompID, MsgSeqNum) and the BeginString/BodyLength prefix are encoded per session, and
+// since the CheckSum is a sum of the bytes, the sums of the shared parts are computed once.
+struct EncodedMessage {
+    std::string beginString;
+    // MsgType and SendingTime fields
+    std::string header;
+    // the body fields
+    std::string body;
+    int headerSum = 0;
+    int bodySum = 0;
+
+    static int checksum(std::string_view bytes) { return simd::sum(bytes.data(), bytes.size()); }
+
+    EncodedMessage() {}
+    // encode the msg, which is reset
+    EncodedMessage(const std::string& beginString, const std::string& msgType, FixBuilder& msg) : beginString(beginString) {
+        // use the builder to encode the fields so they match the messages sent by Session::sendMessage()
+        FixBuilder full;
+        full.addField(8, beginString);
+        full.addField(9, "0000");
+        full.addField(35, msgType);
+        full.addTimeNow(52);
+        full.addBuilder(msg);
+        std::ostringstream os;
+        full.writeTo(os);
+        auto encoded = os.str();
+
+        auto start = encoded.find("\00135=") + 1;
+        auto bodyStart = encoded.find('\001', encoded.find("\00152=", start) + 1) + 1;
+        // strip the trailing 10=nnn<SOH>
+        auto end = encoded.size() - 7;
+        header = encoded.substr(start, bodyStart - start);
+        body = encoded.substr(bodyStart, end - bodyStart);
+        headerSum = checksum(header);
+        bodySum = checksum(body);
+    }
+
+    // Per session state for sending encoded messages. The prefix contains the session specific header
+    // fields up to the value of the MsgSeqNum, e.g. 49=SENDER|56=TARGET|34=
+    struct SessionHeader {
+        std::string prefix;
+        int prefixSum = 0;
+        SessionHeader() {}
+        SessionHeader(const std::string& prefix) : prefix(prefix), prefixSum(checksum(prefix)) {}
+    };
+
+    // Scratch space for the per session parts of a message
+    struct Scratch {
+        char start[32];
+        char seqNum[16];
+        char trailer[8];
+    };
+
+    static const int IOV_COUNT = 6;
+
+    // fill iov with the complete message for the session, returns the number of entries used
+    int render(const SessionHeader& session, int seqNum, Scratch& scratch, struct iovec* iov) const {
+        int seqLen = snprintf(scratch.seqNum, sizeof(scratch.seqNum), "%d\001", seqNum);
+        int bodyLength = header.size() + session.prefix.size() + seqLen + body.size();
+        int startLen = snprintf(scratch.start, sizeof(scratch.start), "8=%s\0019=%d\001", beginString.c_str(), bodyLength);
+        unsigned int sum = checksum(std::string_view(scratch.start, startLen)) + headerSum + session.prefixSum + checksum(std::string_view(scratch.seqNum, seqLen)) + bodySum;
+        snprintf(scratch.trailer, sizeof(scratch.trailer), "10=%03u\001", sum % 256);
+
+        iov[0] = {scratch.start, size_t(startLen)};
+        iov[1] = {const_cast<char*>(header.data()), header.size()};
+        iov[2] = {const_cast<char*>(session.prefix.data()), session.prefix.size()};
+        iov[3] = {scratch.seqNum, size_t(seqLen)};
+        iov[4] = {const_cast<char*>(body.data()), body.size()};
+        iov[5] = {scratch.trailer, 7};
+        return IOV_COUNT;
+    }
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The address an Acceptor listens on or an Initiator connects to: TCP over IPv4 or IPv6, or a Unix domain
+// stream socket for processes on the same host.
+class Endpoint {
+    sockaddr_storage address{};
+    socklen_t length = 0;
+
+   public:
+    Endpoint() {}
+    Endpoint(const sockaddr_in& addr) : length(sizeof(addr)) {
+        memcpy(&address, &addr, sizeof(addr));
+    }
+    Endpoint(const sockaddr_in6& addr) : length(sizeof(addr)) {
+        memcpy(&address, &addr, sizeof(addr));
+    }
+    Endpoint(const sockaddr* addr, socklen_t length) : length(length) {
+        memcpy(&address, addr, std::min(size_t(length), sizeof(address)));
+    }
+
+    // all IPv4 interfaces
+    static Endpoint tcp(int port) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(port);
+        return Endpoint(addr);
+    }
+    // all IPv6 interfaces, and IPv4 via mapped addresses
+    static Endpoint tcp6(int port) {
+        sockaddr_in6 addr{};
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_any;
+        addr.sin6_port = htons(port);
+        return Endpoint(addr);
+    }
+    static Endpoint unixDomain(const std::string& path) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("unix socket path too long: " + path);
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        return Endpoint(reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+    // Resolve the host name, or IPv4/IPv6 address, to all matching addresses in the order the resolver prefers, e.g. ::1
+    // before 127.0.0.1 for localhost. An Initiator given them all connects to the first accepting the connection.
+    static std::vector<Endpoint> resolveAll(const std::string& host, int port) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* result;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+            throw std::runtime_error("unable to resolve " + host);
+        }
+        std::vector<Endpoint> endpoints;
+        for (auto info = result; info; info = info->ai_next) endpoints.emplace_back(info->ai_addr, info->ai_addrlen);
+        freeaddrinfo(result);
+        if (endpoints.empty()) throw std::runtime_error("unable to resolve " + host);
+        return endpoints;
+    }
+    // the first of resolveAll()
+    static Endpoint resolve(const std::string& host, int port) {
+        return resolveAll(host, port).front();
+    }
+
+    int family() const { return address.ss_family; }
+    const sockaddr* addr() const { return reinterpret_cast<const sockaddr*>(&address); }
+    socklen_t size() const { return length; }
+    bool isTcp() const { return family() == AF_INET || family() == AF_INET6; }
+    bool isUnixDomain() const { return family() == AF_UNIX; }
+    std::string path() const {
+        return isUnixDomain() ? reinterpret_cast<const sockaddr_un*>(&address)->sun_path : "";
+    }
+
+    // true if the peer is on the same host, i.e. a unix domain socket or a loopback address
+    bool isLocal() const {
+        switch (family()) {
+            case AF_UNIX:
+                return true;
+            case AF_INET:
+                return (ntohl(reinterpret_cast<const sockaddr_in*>(&address)->sin_addr.s_addr) >> 24) == 127;
+            case AF_INET6: {
+                auto& addr = reinterpret_cast<const sockaddr_in6*>(&address)->sin6_addr;
+                if (IN6_IS_ADDR_LOOPBACK(&addr)) return true;
+                // IPv4 mapped loopback, ::ffff:127.x.x.x
+                return IN6_IS_ADDR_V4MAPPED(&addr) && addr.s6_addr[12] == 127;
+            }
+        }
+        return false;
+    }
+
+    std::string toString() const {
+        char host[INET6_ADDRSTRLEN];
+        switch (family()) {
+            case AF_UNIX:
+                return "unix:" + path();
+            case AF_INET: {
+                auto addr = reinterpret_cast<const sockaddr_in*>(&address);
+                inet_ntop(AF_INET, &addr->sin_addr, host, sizeof(host));
+                return std::string(host) + " port " + std::to_string(ntohs(addr->sin_port));
+            }
+            case AF_INET6: {
+                auto addr = reinterpret_cast<const sockaddr_in6*>(&address);
+                inet_ntop(AF_INET6, &addr->sin6_addr, host, sizeof(host));
+                return std::string(host) + " port " + std::to_string(ntohs(addr->sin6_port));
+            }
+        }
+        return "unknown";
+    }
+};
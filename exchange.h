@@ -0,0 +1,452 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "fix_engine.h"
+#include "intern_table.h"
+#include "msg_logout.h"
+#include "msg_massquote.h"
+#include "msg_orders.h"
+#include "msg_reject.h"
+#include "order_book.h"
+#include "quote_book.h"
+#include "risk.h"
+#include "sequencer.h"
+
+// The symbols the sessions of an exchange may add to InternTable::symbols(): sessionSymbols per session id, kept
+// after it disconnects so reconnecting does not reset the limit, and maxSymbols in total. As a client may choose a
+// new CompID for each session, the total is at most half the table's capacity, leaving the rest for the preloaded
+// symbols and the application. Not thread-safe.
+class SymbolQuota {
+    const size_t sessionSymbols;
+    const size_t maxSymbols;
+    size_t total = 0;
+    // only the sessions that added a symbol have an entry, so there are at most maxSymbols
+    std::unordered_map<std::string, size_t> added;
+
+   public:
+    SymbolQuota(size_t sessionSymbols, size_t maxSymbols)
+        : sessionSymbols(sessionSymbols), maxSymbols(std::min(maxSymbols, InternTable::symbols().capacity() / 2)) {}
+
+    // the id of the new symbol, or InternTable::NONE if the session or the exchange is over its limit or the table is full
+    uint32_t add(const std::string& sessionId, std::string_view symbol) {
+        if (total == maxSymbols) return InternTable::NONE;
+        auto itr = added.find(sessionId);
+        if ((itr == added.end() ? 0 : itr->second) >= sessionSymbols) return InternTable::NONE;
+        auto id = InternTable::symbols().intern(symbol);
+        if (id == InternTable::NONE) return id;
+        total++;
+        if (itr == added.end()) added.emplace(sessionId, 1);
+        else itr->second++;
+        return id;
+    }
+};
+
+// Routes the NewOrderSingle, OrderCancelRequest and MassQuote messages of the sessions of an Acceptor to an
+// OrderBook per symbol, and sends the resulting ExecutionReports to the owning sessions. Each book has its own
+// lock, and the reports are sent after it is released so a blocked session cannot stall the book.
+//
+// The quotes of a session are tracked in its SessionQuotes, and are canceled when the session logs out or
+// disconnects. The quotes of all sessions for a symbol are in the SymbolQuotes of its book.
+//
+// The books are indexed by the symbol's id in InternTable::symbols(), so finding a book takes no lock. The table is
+// shared and never shrinks, so each session may only add sessionSymbols new symbols to it, e.g. 0 if all symbols
+// are loaded from EngineOptions::symbolFile, and all sessions maxSymbols, see SymbolQuota. Orders and quotes for
+// other symbols are rejected.
+//
+// If given the PreTradeRisk stage of the acceptor, the orders record the account they were checked against, and
+// the positions held by the orders are released as they are canceled or rejected.
+class Exchange {
+    struct Book {
+        std::mutex lock;
+        OrderBook book;
+        SymbolQuotes quotes;
+    };
+    typedef std::vector<OrderBook::Execution> Executions;
+
+    Acceptor<>& acceptor;
+    PreTradeRisk* const risk;
+    InternTable& symbols = InternTable::symbols();
+    // held to create a book
+    std::mutex booksLock;
+    std::unique_ptr<std::atomic<Book*>[]> books{new std::atomic<Book*>[InternTable::symbols().capacity()]()};
+    // a session's quotes are only modified by the session, but the map is shared
+    std::mutex sessionsLock;
+    std::unordered_map<std::string, std::unique_ptr<SessionQuotes>> sessionQuotes;
+    // held with sessionsLock
+    SymbolQuota symbolsAdded;
+
+    Book& book(uint32_t id) {
+        if (auto b = books[id].load(std::memory_order_acquire)) return *b;
+        std::lock_guard<std::mutex> mu(booksLock);
+        if (!books[id].load(std::memory_order_relaxed)) books[id].store(new Book(), std::memory_order_release);
+        return *books[id].load(std::memory_order_relaxed);
+    }
+    // the book of a symbol already in the table, e.g. of a resting quote
+    Book& book(std::string_view symbol) {
+        return book(symbols.find(symbol));
+    }
+    // the book of the symbol, adding the symbol to the table if the session is allowed, otherwise nullptr
+    Book* book(Session<>& session, std::string_view symbol) {
+        auto id = symbols.find(symbol);
+        if (id == InternTable::NONE) {
+            std::lock_guard<std::mutex> mu(sessionsLock);
+            if ((id = symbolsAdded.add(session.id(), symbol)) == InternTable::NONE) return nullptr;
+        }
+        return &book(id);
+    }
+    void rejectSymbol(Session<>& session, const FixMessage& msg, std::string_view refId, FixBuilder& fix) {
+        BusinessMessageReject::build(fix, msg.seqNum(), msg.msgType(), refId, BusinessRejectReason::UnknownSecurity, "unknown symbol");
+        session.sendMessage(BusinessMessageReject::msgType, fix);
+    }
+
+    SessionQuotes& quotesOf(const std::string& sessionId) {
+        std::lock_guard<std::mutex> mu(sessionsLock);
+        auto& quotes = sessionQuotes[sessionId];
+        if (!quotes) quotes = std::make_unique<SessionQuotes>(sessionId);
+        return *quotes;
+    }
+
+    void send(Session<>& session, std::string_view symbol, Executions& executions, FixBuilder& fix) {
+        auto sessionId = session.id();
+        for (auto& e : executions) {
+            if (risk) PreTradeRisk::onExecution(e);
+            buildReport(fix, symbol, e);
+            if (e.owner == sessionId) {
+                session.sendMessage(ExecutionReport::msgType, fix);
+            } else {
+                acceptor.sendMessage(e.owner, ExecutionReport::msgType, fix);
+            }
+        }
+        executions.clear();
+    }
+
+    void onNewOrder(Session<>& session, const FixMessage& msg, Executions& executions, FixBuilder& fix) {
+        auto symbol = msg.getString(55);
+        auto side = msg.getChar(54) == '2' ? OrderSide::Sell : OrderSide::Buy;
+        auto type = msg.getChar(40) == '1' ? OrderType::Market : OrderType::Limit;
+        void* account = risk ? risk->accountOf(msg) : nullptr;
+        auto found = book(session, symbol);
+        if (!found) {
+            if (account) risk->release(msg);
+            return rejectSymbol(session, msg, msg.getString(11), fix);
+        }
+        auto& b = *found;
+        {
+            std::lock_guard<std::mutex> mu(b.lock);
+            b.book.newOrder(session.id(), msg.getString(11), side, type, type == OrderType::Market ? 0 : price(msg.getString(44)), quantity(msg.getString(38)), executions,
+                            account);
+        }
+        if (account && executions.front().execType == ExecType::Rejected) risk->release(msg);
+        send(session, symbol, executions, fix);
+    }
+    void onCancel(Session<>& session, const FixMessage& msg, Executions& executions, FixBuilder& fix) {
+        auto symbol = msg.getString(55);
+        auto exchangeIdStr = msg.getString(37);
+        long exchangeId = 0;
+        std::from_chars(exchangeIdStr.data(), exchangeIdStr.data() + exchangeIdStr.size(), exchangeId);
+        bool canceled = false;
+        // an order can only rest in the book of a known symbol
+        auto id = symbols.find(symbol);
+        if (id != InternTable::NONE) {
+            auto& b = book(id);
+            std::lock_guard<std::mutex> mu(b.lock);
+            canceled = b.book.cancel(session.id(), exchangeId, executions);
+        }
+        if (canceled) {
+            send(session, symbol, executions, fix);
+        } else {
+            OrderCancelReject::build(fix, exchangeId, msg.getString(41), OrderStatus::Rejected);
+            session.sendMessage(OrderCancelReject::msgType, fix);
+        }
+    }
+    void onMassQuote(Session<>& session, const FixMessage& msg, Executions& executions, FixBuilder& fix) {
+        // a single quote set and entry, as sent by MassQuote::build()
+        QuoteEntry entry{msg.getString(302), msg.getString(299), msg.getString(55), price(msg.getString(132)), quantity(msg.getString(134)),
+                         price(msg.getString(133)), quantity(msg.getString(135))};
+        if (!book(session, entry.symbol)) return rejectSymbol(session, msg, msg.getString(117), fix);
+        bool accepted = quote(session, &entry, 1, executions, fix, risk ? risk->accountOf(msg) : nullptr);
+        // the quote status is 0 accepted, or 5 rejected
+        MassQuoteAck::build(fix, msg.getString(117), accepted ? 0 : 5);
+        session.sendMessage(MassQuoteAck::msgType, fix);
+    }
+
+    // remove the quote from its book, the book must be locked
+    static void withdraw(Book& b, Quote& quote) {
+        b.book.cancelQuote(quote.orders);
+        b.quotes.remove(quote);
+    }
+
+   public:
+    Exchange(Acceptor<>& acceptor, PreTradeRisk* risk = nullptr, size_t sessionSymbols = 1000, size_t maxSymbols = 10000)
+        : acceptor(acceptor), risk(risk), symbolsAdded(sessionSymbols, maxSymbols) {}
+    ~Exchange() {
+        for (size_t id = 0, n = symbols.size(); id < n; id++) delete books[id].load();
+    }
+
+    static F fixedPrice(OrderBook::Units units) { return F(double(units) / OrderBook::SCALE); }
+    static F fixedQty(int64_t quantity) { return F(double(quantity)); }
+    // a whole quantity, or -1 if it is invalid
+    static int64_t quantity(std::string_view s) {
+        OrderBook::Units units;
+        if (!OrderBook::parse(s, units) || units % OrderBook::SCALE != 0) return -1;
+        return units / OrderBook::SCALE;
+    }
+    static OrderBook::Units price(std::string_view s) {
+        OrderBook::Units units;
+        return OrderBook::parse(s, units) ? units : -1;
+    }
+    static void buildReport(FixBuilder& fix, std::string_view symbol, const OrderBook::Execution& e) {
+        ExecutionReport::build(fix, e.orderId, symbol, e.side, fixedPrice(e.lastPrice), fixedQty(e.lastQty), fixedQty(e.cumQty), fixedPrice(e.avgPrice),
+                               fixedQty(e.remaining), e.exchangeId, e.execType, e.execId, e.status);
+        if (*e.text) fix.addField(58, e.text);
+    }
+
+    // Replace the session's quotes for the entries, which is a batch update: the lock of a book is held for
+    // consecutive entries of the same symbol, and the entries of a set are matched by position, see SessionQuotes.
+    // The reports for any fills are sent as each book is released. Returns false if any entry was rejected. The fills
+    // are added to the position of the account, see PreTradeRisk::onExecution().
+    bool quote(Session<>& session, const QuoteEntry* entries, size_t count, Executions& executions, FixBuilder& fix, AccountRisk* account = nullptr) {
+        auto& quotes = quotesOf(session.id());
+        SessionQuotes::QuoteSet* set = nullptr;
+        std::string_view setId;
+        size_t position = 0;
+        Book* b = nullptr;
+        std::string_view symbol;
+        std::unique_lock<std::mutex> lock;
+        bool accepted = true;
+        for (size_t i = 0; i < count; i++) {
+            auto& e = entries[i];
+            if (!set || e.setId != setId) {
+                set = &quotes.set(e.setId);
+                setId = e.setId;
+                position = 0;
+            }
+            auto& q = quotes.entry(*set, position++, e.entryId);
+            if (!b || e.symbol != symbol || (!q.symbol.empty() && q.symbol != e.symbol)) {
+                if (lock.owns_lock()) lock.unlock();
+                if (!executions.empty()) send(session, symbol, executions, fix);
+            }
+            if (!q.symbol.empty() && q.symbol != e.symbol) {
+                // the entry moved to another symbol
+                auto& old = book(q.symbol);
+                std::lock_guard<std::mutex> mu(old.lock);
+                withdraw(old, q);
+                b = nullptr;
+            }
+            if (!lock.owns_lock()) {
+                if (!(b = book(session, e.symbol))) {
+                    // an unknown symbol, any previous quote of the entry was withdrawn above
+                    accepted = false;
+                    q.symbol.clear();
+                    continue;
+                }
+                symbol = e.symbol;
+                lock = std::unique_lock<std::mutex>(b->lock);
+            }
+            q.symbol.assign(e.symbol);
+            q.bidPrice = e.bidPrice;
+            q.bidQty = e.bidQty;
+            q.askPrice = e.askPrice;
+            q.askQty = e.askQty;
+            if (!b->book.quote(quotes.owner, e.entryId, q.orders, e.bidPrice, e.bidQty, e.askPrice, e.askQty, executions, account)) {
+                accepted = false;
+                q.bidQty = q.askQty = 0;
+            }
+            if (q.isQuoted()) {
+                b->quotes.update(quotes.owner, q);
+            } else {
+                b->quotes.remove(q);
+            }
+        }
+        if (lock.owns_lock()) lock.unlock();
+        if (!executions.empty()) send(session, symbol, executions, fix);
+        return accepted;
+    }
+    // cancel all quotes of the session
+    void cancelQuotes(const std::string& sessionId) {
+        std::unique_ptr<SessionQuotes> quotes;
+        {
+            std::lock_guard<std::mutex> mu(sessionsLock);
+            auto itr = sessionQuotes.find(sessionId);
+            if (itr == sessionQuotes.end()) return;
+            quotes = std::move(itr->second);
+            sessionQuotes.erase(itr);
+        }
+        quotes->forEach([this](Quote& quote) {
+            if (quote.symbol.empty()) return;
+            auto& b = book(quote.symbol);
+            std::lock_guard<std::mutex> mu(b.lock);
+            withdraw(b, quote);
+        });
+    }
+
+    // returns true if the message was handled
+    bool onMessage(Session<>& session, const FixMessage& msg) {
+        // not thread_local, as sending may park the fiber and another fiber on the thread could enter here
+        Executions executions;
+        FixBuilder fix(512);
+        auto msgType = msg.msgType();
+        if (msgType == NewOrderSingle::msgType) {
+            onNewOrder(session, msg, executions, fix);
+        } else if (msgType == OrderCancelRequest::msgType) {
+            onCancel(session, msg, executions, fix);
+        } else if (msgType == MassQuote::msgType) {
+            onMassQuote(session, msg, executions, fix);
+        } else if (msgType == Logout::msgType) {
+            cancelQuotes(session.id());
+            return false;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    // remove the orders and quotes of the session from all books
+    void onDisconnected(const Session<>& session) {
+        auto sessionId = session.id();
+        cancelQuotes(sessionId);
+        Executions canceled;
+        for (size_t id = 0, n = symbols.size(); id < n; id++) {
+            auto b = books[id].load(std::memory_order_acquire);
+            if (!b) continue;
+            std::lock_guard<std::mutex> bookLock(b->lock);
+            b->book.cancelAll(sessionId, risk ? &canceled : nullptr);
+        }
+        for (auto& e : canceled) PreTradeRisk::onExecution(e);
+    }
+    // the best bid and offer of the symbol, 0 if none
+    std::pair<F, F> bbo(std::string_view symbol) {
+        if (symbols.find(symbol) == InternTable::NONE) return {F(0), F(0)};
+        auto& b = book(symbol);
+        std::lock_guard<std::mutex> mu(b.lock);
+        return {fixedPrice(b.book.bid()), fixedPrice(b.book.ask())};
+    }
+    // the best quoted prices for the symbol across the sessions, which may have since traded, 0 if none
+    std::pair<F, F> bestQuotes(std::string_view symbol) {
+        if (symbols.find(symbol) == InternTable::NONE) return {F(0), F(0)};
+        auto& b = book(symbol);
+        std::lock_guard<std::mutex> mu(b.lock);
+        return {fixedPrice(b.quotes.bestBid()), fixedPrice(b.quotes.bestAsk())};
+    }
+};
+
+// The matching logic of Exchange run by a Sequencer: the books are only used by the sequencer's thread so
+// they need no locks, and the reports are sent to the sessions by handle. Add the sequencer() to the Acceptor
+// as a stage, after any PreTradeRisk stage given to release the positions as in Exchange, and start() it.
+class SequencedExchange : public BusinessLogic {
+    typedef std::vector<OrderBook::Execution> Executions;
+
+    Sequencer sequencer_{*this};
+    PreTradeRisk* const risk;
+    SymbolQuota symbolsAdded;
+    // indexed by the symbol's id in InternTable::symbols()
+    std::vector<std::unique_ptr<OrderBook>> books;
+    // the OrderBook owner is the session id
+    std::unordered_map<std::string, SessionHandle> handles;
+    std::unordered_map<SessionHandle, std::string> ids;
+    std::unordered_map<SessionHandle, std::unique_ptr<SessionQuotes>> quotes;
+    Executions executions;
+    FixBuilder fix{512};
+
+    OrderBook& book(uint32_t id) {
+        if (id >= books.size()) books.resize(id + 1);
+        auto& book = books[id];
+        if (!book) book = std::make_unique<OrderBook>();
+        return *book;
+    }
+    void send(SessionHandle session, std::string_view symbol) {
+        for (auto& e : executions) {
+            if (risk) PreTradeRisk::onExecution(e);
+            auto itr = handles.find(e.owner);
+            if (itr == handles.end()) continue;
+            Exchange::buildReport(fix, symbol, e);
+            sequencer_.send(itr->second, ExecutionReport::msgType, fix);
+        }
+        executions.clear();
+    }
+
+   public:
+    SequencedExchange(PreTradeRisk* risk = nullptr, size_t sessionSymbols = 1000, size_t maxSymbols = 10000)
+        : risk(risk), symbolsAdded(sessionSymbols, maxSymbols) {}
+    Sequencer& sequencer() { return sequencer_; }
+
+    void onLoggedOn(SessionHandle session, const std::string& sessionId) override {
+        if (sessionId.empty()) return;
+        handles[sessionId] = session;
+        ids[session] = sessionId;
+        quotes[session] = std::make_unique<SessionQuotes>(sessionId);
+    }
+    void onMessage(SessionHandle session, const FixMessage& msg) override {
+        auto itr = ids.find(session);
+        if (itr == ids.end()) return;
+        auto& owner = itr->second;
+        auto msgType = msg.msgType();
+        bool order = msgType == NewOrderSingle::msgType, cancel = msgType == OrderCancelRequest::msgType;
+        if (!order && !cancel && msgType != MassQuote::msgType) return;
+        auto symbol = msg.getString(55);
+        auto& symbols = InternTable::symbols();
+        auto symbolId = symbols.find(symbol);
+        if (symbolId == InternTable::NONE && !cancel) {
+            symbolId = symbolsAdded.add(owner, symbol);
+        }
+        if (symbolId == InternTable::NONE) {
+            if (cancel) {
+                // an order can only rest in the book of a known symbol
+                auto exchangeIdStr = msg.getString(37);
+                long exchangeId = 0;
+                std::from_chars(exchangeIdStr.data(), exchangeIdStr.data() + exchangeIdStr.size(), exchangeId);
+                OrderCancelReject::build(fix, exchangeId, msg.getString(41), OrderStatus::Rejected);
+                sequencer_.send(session, OrderCancelReject::msgType, fix);
+                return;
+            }
+            if (order && risk) risk->release(msg);
+            BusinessMessageReject::build(fix, msg.seqNum(), msgType, order ? msg.getString(11) : msg.getString(117), BusinessRejectReason::UnknownSecurity,
+                                         "unknown symbol");
+            sequencer_.send(session, BusinessMessageReject::msgType, fix);
+            return;
+        }
+        if (msgType == NewOrderSingle::msgType) {
+            auto type = msg.getChar(40) == '1' ? OrderType::Market : OrderType::Limit;
+            void* account = risk ? risk->accountOf(msg) : nullptr;
+            book(symbolId).newOrder(owner, msg.getString(11), msg.getChar(54) == '2' ? OrderSide::Sell : OrderSide::Buy, type,
+                                  type == OrderType::Market ? 0 : Exchange::price(msg.getString(44)), Exchange::quantity(msg.getString(38)), executions, account);
+            if (account && executions.front().execType == ExecType::Rejected) risk->release(msg);
+        } else if (msgType == OrderCancelRequest::msgType) {
+            auto exchangeIdStr = msg.getString(37);
+            long exchangeId = 0;
+            std::from_chars(exchangeIdStr.data(), exchangeIdStr.data() + exchangeIdStr.size(), exchangeId);
+            if (!book(symbolId).cancel(owner, exchangeId, executions)) {
+                OrderCancelReject::build(fix, exchangeId, msg.getString(41), OrderStatus::Rejected);
+                sequencer_.send(session, OrderCancelReject::msgType, fix);
+            }
+        } else if (msgType == MassQuote::msgType) {
+            auto& sessionQuotes = *quotes[session];
+            auto& quote = sessionQuotes.entry(sessionQuotes.set(msg.getString(302)), 0, msg.getString(299));
+            bool accepted = book(symbolId).quote(owner, quote.entryId, quote.orders, Exchange::price(msg.getString(132)), Exchange::quantity(msg.getString(134)),
+                                               Exchange::price(msg.getString(133)), Exchange::quantity(msg.getString(135)), executions,
+                                               risk ? risk->accountOf(msg) : nullptr);
+            MassQuoteAck::build(fix, msg.getString(117), accepted ? 0 : 5);
+            sequencer_.send(session, MassQuoteAck::msgType, fix);
+        }
+        send(session, symbol);
+    }
+    void onDisconnected(SessionHandle session) override {
+        auto itr = ids.find(session);
+        if (itr == ids.end()) return;
+        for (auto& book : books) {
+            if (book) book->cancelAll(itr->second, risk ? &executions : nullptr);
+        }
+        for (auto& e : executions) PreTradeRisk::onExecution(e);
+        executions.clear();
+        handles.erase(itr->second);
+        quotes.erase(session);
+        ids.erase(itr);
+    }
+};
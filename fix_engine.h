@@ -1,17 +1,42 @@
+#pragma once
+
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
 
+#include <algorithm>
 #include <boost/fiber/all.hpp>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
+#include <span>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
+#include "affinity.h"
+#include "buffer_pool.h"
+#include "coroutine.h"
+#include "drop_copy.h"
+#include "encoded_message.h"
+#include "endpoint.h"
 #include "fix_builder.h"
 #include "fix_parser.h"
+#include "intern_table.h"
+#include "framing.h"
+#include "latency_histogram.h"
+#include "logger.h"
 #include "park_unpark.h"
 #include "poller.h"
+#include "priority_scheduler.h"
+#include "replication.h"
 #include "socketbuf.h"
+#include "stack_pool.h"
+#include "throttle.h"
 
 struct DefaultSessionConfig {
     std::string beginString = "FIX.4.4";
@@ -20,6 +45,17 @@ struct DefaultSessionConfig {
     int nextSeqNum = 1;
     int expectedSeqNum = 1;
 
+    // Outbound backpressure. If outboundHighWatermark is 0 a send parks until the socket is writable. Otherwise
+    // a send never blocks, and the bytes the socket does not accept are buffered. The session becomes a slow
+    // consumer when the buffer reaches the high watermark, recovers when it drains below the low watermark,
+    // and is disconnected if the buffer exceeds outboundLimit.
+    size_t outboundHighWatermark = 0;
+    size_t outboundLowWatermark = 0;
+    size_t outboundLimit = 0;
+
+    // inbound rate limits, see ThrottleConfig
+    ThrottleConfig throttle;
+
     DefaultSessionConfig(std::string senderCompId, std::string targetCompId) : senderCompId(senderCompId), targetCompId(targetCompId) {}
 
     // initialize header fields, except fields 8,9,35 which are maintained by the engine
@@ -29,6 +65,11 @@ struct DefaultSessionConfig {
         msg.addField(Tag::SEQ_NUM, nextSeqNum++);
     }
 
+    // the encoded fields added by configureHeader() up to the sequence number value, used when sending an EncodedMessage
+    std::string headerPrefix() const {
+        return "49=" + senderCompId + "\00156=" + targetCompId + "\00134=";
+    }
+
     // initialize the configuration from the logon message. afterwhich the id() must remain constant
     void initialize(const FixMessage& logon) {
     }
@@ -38,15 +79,115 @@ struct DefaultSessionConfig {
     }
 };
 
+// engine tuning shared by all sessions of an Acceptor
+struct EngineOptions {
+    // fiber stack size, 0 uses the Boost.Fiber default
+    size_t stackSize = 0;
+    // recycle fixed size fiber stacks through a shared StackPool
+    bool pooledStacks = false;
+    // back the pooled stacks with huge pages if the OS has them reserved
+    bool hugePageStacks = false;
+    // sessions only hold socket buffers while data is pending, see Socketbuf
+    bool borrowBuffers = false;
+    size_t bufferSize = 4096;
+    // the length of the queue of connections not yet accepted, raise net.core.somaxconn (Linux) or
+    // kern.ipc.somaxconn (macOS) to allow larger values
+    int backlog = SOMAXCONN;
+    // accept the shared memory transport from initiators connecting via the loopback interface
+    bool sharedMemory = false;
+    // deliver up to batchSize complete messages received in one read to SessionHandler::onMessages(), 1 disables batching
+    size_t batchSize = 1;
+    // record the messages of every session, see AuditTrail
+    AuditTrail* audit = nullptr;
+    // stream the sessions' sequence numbers and outbound messages to a standby process, see Replicator
+    Replicator* replicator = nullptr;
+    // the messages a session processes before yielding its worker to the other ready sessions, 0 is unlimited
+    size_t readBudget = 0;
+    // the largest inbound message a coroutine session buffers, a longer BodyLength terminates the session
+    size_t maxMessageSize = 1024 * 1024;
+    // run the session fibers by Session::priority(), see PriorityScheduler. Not supported with coroutines
+    bool priorities = false;
+    // collect kernel receive timestamps, see Session::receiveTime() and Acceptor::receiveLatency(). Linux only
+    bool receiveTimestamps = false;
+    // the messages queued for the drop copy sessions before copies are dropped, see Acceptor::addDropCopy()
+    size_t dropCopyCapacity = 16384;
+    // the bytes a drop copy session buffers before it is disconnected, unless its config sets outboundHighWatermark
+    size_t dropCopyOutboundLimit = 64 * 1024 * 1024;
+    // a file of symbols, one per line, added to InternTable::symbols() by listen() so their ids follow the file
+    std::string symbolFile;
+    // The cpus the worker threads are pinned to, assigned round robin, empty leaves the workers unpinned. A pinned
+    // worker keeps the sessions assigned to it rather than sharing them with the other workers, and their socket
+    // buffers and pooled stacks are allocated on the worker's NUMA node. Linux only.
+    std::vector<int> workerCpus;
+    // the cpu the poller thread is pinned to, -1 leaves it unpinned
+    int pollerCpu = -1;
+    // with workerCpus, assign a connection to the worker pinned to the cpu that received its packets, see SO_INCOMING_CPU
+    bool incomingCpu = false;
+    // run the sessions as C++20 coroutines on the worker threads rather than fibers, see Session::run(). The
+    // default is selected at build time with COROUTINE_SESSIONS, e.g. make COROUTINES=1
+#ifdef COROUTINE_SESSIONS
+    bool coroutines = true;
+#else
+    bool coroutines = false;
+#endif
+
+    // a memory optimized configuration for a large number of mostly idle sessions
+    static EngineOptions compact() {
+        EngineOptions options;
+        options.stackSize = 32 * 1024;
+        options.pooledStacks = true;
+        options.borrowBuffers = true;
+        return options;
+    }
+};
+
+// the transport used by an Initiator, see ShmChannel
+enum class Transport {
+    Socket,
+    SharedMemory
+};
+
 template <class SessionConfig=DefaultSessionConfig>
 class Session;
 
+// A stage run on each inbound message before SessionHandler::onMessage(), e.g. pre-trade risk checks. Stages are
+// called on the session's thread, so concurrently for different sessions.
+template <class SessionConfig=DefaultSessionConfig>
+struct MessageStage {
+    // return false to drop the message, after sending any reject to the session
+    virtual bool process(Session<SessionConfig>& session, const FixMessage& msg) = 0;
+    // called after SessionHandler::onLoggedOn(), and before SessionHandler::onDisconnected()
+    virtual void onLoggedOn(Session<SessionConfig>& session) {}
+    virtual void onDisconnected(Session<SessionConfig>& session) {}
+};
+
+template <class SessionConfig>
+struct PoliciesOf;
+
 template <class SessionConfig=DefaultSessionConfig>
 struct SessionHandler {
+    // the stages in order, which must be added before any sessions are started
+    std::vector<MessageStage<SessionConfig>*> stages;
+    void addStage(MessageStage<SessionConfig>& stage) {
+        static_assert(PoliciesOf<SessionConfig>::type::stages, "the SessionConfig::Policies disable the stages");
+        stages.push_back(&stage);
+    }
+    // the sent messages copied to the drop copy sessions, see Acceptor::addDropCopy()
+    DropCopy* dropCopy = nullptr;
+    // the sequences of the sessions taken over from a primary, see Acceptor::takeover()
+    ReplicaSequences* replicaSequences = nullptr;
+
     virtual void onMessage(Session<SessionConfig>& session, const FixMessage& msg) = 0;
+    // Called instead of onMessage() if EngineOptions::batchSize is greater than 1, with the messages parsed from the
+    // current socket buffer that passed the stages, in sequence. The messages are only valid during the call.
+    virtual void onMessages(Session<SessionConfig>& session, std::span<const FixMessage> msgs) {
+        for (auto& msg : msgs) onMessage(session, msg);
+    }
     virtual bool validateLogon(const FixMessage& logon) = 0;
     virtual void onDisconnected(const Session<SessionConfig>& session) = 0;
     virtual void onLoggedOn(const Session<SessionConfig>& session) = 0;
+    // called when the session's outbound buffer crosses the high (slow is true) or low watermark, possibly on the poller thread
+    virtual void onSlowConsumer(const Session<SessionConfig>& session, bool slow) {}
 };
 
 
@@ -54,38 +195,297 @@ inline std::ostream& operator<<(std::ostream& os, const DefaultSessionConfig& co
     return os << "[" << config.id() << " seq " << config.nextSeqNum << "]";
 }
 
+// The optional session features, resolved at compile time so a disabled feature costs nothing. A SessionConfig
+// selects them by declaring a Policies type, otherwise all but instrumentation are enabled. A SessionConfig may also
+// declare its handler as Handler, a final class derived from SessionHandler, e.g. the Acceptor, so the Session calls
+// the handler without virtual dispatch and the compiler can inline onMessage() into Session::handle(). The engine is
+// instantiated for DefaultSessionConfig and LeanSessionConfig, include fix_engine_impl.h to instantiate it for others.
+struct SessionPolicies {
+    // run the MessageStages added to the handler
+    static constexpr bool stages = true;
+    // deliver batches to SessionHandler::onMessages(), see EngineOptions::batchSize
+    static constexpr bool batching = true;
+    // record the messages in EngineOptions::audit
+    static constexpr bool audit = true;
+    // apply the SessionConfig::throttle rate limits
+    static constexpr bool throttling = true;
+    // copy the sent messages to the drop copy sessions, see Acceptor::addDropCopy()
+    static constexpr bool dropCopy = true;
+    // replicate the session state to a standby, see EngineOptions::replicator
+    static constexpr bool replication = true;
+    // count the messages and the time spent in the handler, see Session::stats()
+    static constexpr bool instrumentation = false;
+};
+
+// a DefaultSessionConfig without the optional features
+struct LeanSessionConfig : DefaultSessionConfig {
+    struct Policies : SessionPolicies {
+        static constexpr bool stages = false;
+        static constexpr bool batching = false;
+        static constexpr bool audit = false;
+        static constexpr bool throttling = false;
+        static constexpr bool dropCopy = false;
+        static constexpr bool replication = false;
+    };
+    using DefaultSessionConfig::DefaultSessionConfig;
+};
+
+template <class SessionConfig>
+struct PoliciesOf {
+    using type = SessionPolicies;
+};
+template <class SessionConfig>
+    requires requires { typename SessionConfig::Policies; }
+struct PoliciesOf<SessionConfig> {
+    using type = typename SessionConfig::Policies;
+};
+
+template <class SessionConfig>
+struct HandlerOf {
+    using type = SessionHandler<SessionConfig>;
+};
+template <class SessionConfig>
+    requires requires { typename SessionConfig::Handler; }
+struct HandlerOf<SessionConfig> {
+    using type = typename SessionConfig::Handler;
+};
+
+// see SessionPolicies::instrumentation
+struct SessionStats {
+    uint64_t messages = 0;
+    uint64_t handlerNanos = 0;
+};
+
 template <class SessionConfig>
 class Acceptor;
 
 template <class SessionConfig>
 class Initiator;
 
+template <class SessionConfig>
+class InitiatorPool;
+
 template <class SessionConfig>
 class Session : ParkSupport {
     friend class Acceptor<SessionConfig>;
     friend class Initiator<SessionConfig>;
     bool loggedIn = false;
+    // the session's own reference until it terminates, and those of the Acceptor's senders, see Acceptor::pin()
+    std::atomic<int> references{1};
+    // an accepted session is deleted once it terminated and no sender references it
+    void release() {
+        if (references.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+    }
+    // the initiator may switch to the shared memory transport before logon
+    bool allowSharedMemory = false;
     const int socket;
     void handle();
+    Task run(size_t bufferSize, size_t maxMessageSize);
+    bool validate(const FixMessage& msg, FixBuilder& out);
+    bool garbled(bool checksumValid);
+    bool process(const FixMessage& msg, FixBuilder& out);
+    bool process(std::vector<FixMessage>& batch, size_t count, FixBuilder& out);
+    bool isValidBatch(const std::vector<FixMessage>& batch, size_t count) const;
+    // see EngineOptions::batchSize
+    size_t batchSize = 1;
+    // see EngineOptions::readBudget, turn counts the messages processed since the session last waited or yielded
+    size_t readBudget = 0;
+    size_t turn = 0;
+    // the kernel receive time of the messages being processed, and the histogram of the time until they are handled
+    uint64_t messageReceiveTime = 0;
+    LatencyHistogram* receiveLatency = nullptr;
+    void recordReceiveLatency(size_t messages) {
+        if (!receiveLatency || !messageReceiveTime) return;
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        auto nanos = uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+        if (nanos > messageReceiveTime) receiveLatency->record(nanos - messageReceiveTime, messages);
+    }
+    // see SessionConfig::throttle
+    Throttle throttle;
+    enum Admission { ADMIT, DROP, TERMINATE };
+    Admission admit(const FixMessage& msg, FixBuilder& out);
+    // see EngineOptions::replicator, the session is replicated once logged on
+    Replicator* replicator = nullptr;
+    std::unique_ptr<Replicator::Connection> replica;
+    void startReplication() {
+        if constexpr (Policies::replication) {
+            if (!replicator) return;
+            replica = std::make_unique<Replicator::Connection>(*replicator, id());
+            sbuf.setReplica(replica.get());
+        }
+    }
+    void replicateInbound() {
+        if constexpr (Policies::replication) {
+            if (replica) replica->inbound(config.expectedSeqNum);
+        }
+    }
+    // continue the sequences of a session taken over from a primary, see Acceptor::takeover()
+    void restoreSequences() {
+        if constexpr (Policies::replication) {
+            if (handler.replicaSequences) handler.replicaSequences->find(config.id(), config.nextSeqNum, config.expectedSeqNum);
+        }
+    }
+    // the restored sequences are only used by the first session to log on
+    void sequencesRestored() {
+        if constexpr (Policies::replication) {
+            if (handler.replicaSequences) handler.replicaSequences->remove(config.id());
+        }
+    }
+    // the session fiber is run by a PriorityScheduler
+    bool prioritized = false;
+    Priority sessionPriority = Priority::Normal;
+    // returns true if the session used its read budget while more data is pending, and should yield
+    bool budgetExhausted(size_t messages, bool pending) {
+        if (!readBudget) return false;
+        if (!pending) {
+            turn = 0;
+            return false;
+        }
+        if ((turn += messages) < readBudget) return false;
+        turn = 0;
+        return true;
+    }
+    using Policies = typename PoliciesOf<SessionConfig>::type;
+    SessionStats sessionStats;
+    // the handler as its final type if SessionConfig declares a Handler, so the calls are not virtual
+    auto& target() {
+        using Handler = typename HandlerOf<SessionConfig>::type;
+        static_assert(std::is_base_of_v<SessionHandler<SessionConfig>, Handler>, "SessionConfig::Handler must derive from SessionHandler");
+        static_assert(std::is_same_v<Handler, SessionHandler<SessionConfig>> || std::is_final_v<Handler>, "SessionConfig::Handler must be a final class");
+        return static_cast<Handler&>(handler);
+    }
+    bool passesStages(const FixMessage& msg) {
+        if constexpr (Policies::stages) {
+            return std::all_of(handler.stages.begin(), handler.stages.end(), [&](auto stage) { return stage->process(*this, msg); });
+        } else {
+            return true;
+        }
+    }
+    bool acceptSharedMemory(std::istream& is);
     FixBuilder fullMsg;
     SessionHandler<SessionConfig>& handler;
     std::mutex lock;
     // thread is owned by the session and reads the socket via handle()
     boost::fibers::fiber* fiber = nullptr;
+    // used instead of ParkSupport when the session is a coroutine, see run()
+    CoroParker parker;
+    // the single owner of the socket, used for both reading and writing
     Socketbuf sbuf;
     std::ostream os;
+    bool slowConsumer = false;
+    // messages replaced by key while a slow consumer, in the order they were first queued
+    struct Conflated {
+        std::string key;
+        std::string msgType;
+        FixBuilder msg;
+    };
+    std::deque<Conflated> conflated;
+    std::unordered_map<std::string, Conflated*> conflatedByKey;
+    // rendered on the first EncodedMessage sent, after logon
+    EncodedMessage::SessionHeader encodedHeader;
+    // a drop copy session, whose messages are not copied
+    bool dropCopyTarget = false;
+    // the last message copied to the drop copy sessions, reused so copying does not allocate
+    struct Copied {
+        std::string bytes;
+        StringAppendBuf buf{bytes};
+        std::ostream os{&buf};
+    };
+    std::unique_ptr<Copied> copied;
+    // send the message, and queue the bytes written for the drop copy sessions
+    void sendCopied(const std::string& msgType, FixBuilder& msg) {
+        bool changed;
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            if (!copied) copied = std::make_unique<Copied>();
+            copied->bytes.clear();
+            encodeTo(copied->os, msgType, msg);
+            os.write(copied->bytes.data(), copied->bytes.size());
+            os.flush();
+            handler.dropCopy->push(msgType, config.targetCompId, copied->bytes);
+            changed = checkOutbound();
+        }
+        if (changed) target().onSlowConsumer(*this, slowConsumer);
+    }
+
+    void encodeTo(std::ostream& out, const std::string& msgType, FixBuilder& msg) {
+        fullMsg.addField(8, config.beginString);
+        fullMsg.addField(9, "0000");
+        fullMsg.addField(35, msgType);
+        fullMsg.addTimeNow(52);
+        config.configureHeader(fullMsg);
+        fullMsg.addBuilder(msg);
+        fullMsg.writeTo(out);
+    }
+    void encode(const std::string& msgType, FixBuilder& msg) {
+        encodeTo(os, msgType, msg);
+        os.flush();
+    }
+    // send the conflated messages while below the high watermark
+    void sendConflated() {
+        while (!conflated.empty() && sbuf.outbound() < config.outboundHighWatermark) {
+            auto& entry = conflated.front();
+            encode(entry.msgType, entry.msg);
+            conflatedByKey.erase(entry.key);
+            conflated.pop_front();
+        }
+    }
+    // check the outbound buffer against the watermarks, returns true if the slow consumer state changed
+    bool checkOutbound() {
+        if (!config.outboundHighWatermark) return false;
+        auto outbound = sbuf.outbound();
+        if (config.outboundLimit && outbound > config.outboundLimit) {
+            // handle() reads the end of stream and terminates the session
+            sbuf.discard();
+            ::shutdown(socket, SHUT_RDWR);
+        }
+        if (!slowConsumer && outbound >= config.outboundHighWatermark) {
+            return slowConsumer = true;
+        }
+        if (slowConsumer && outbound < config.outboundLowWatermark && conflated.empty()) {
+            slowConsumer = false;
+            return true;
+        }
+        return false;
+    }
+    // called by the poller when the socket becomes readable
+    void wake() {
+        if (parker.scheduler) {
+            parker.unpark();
+        } else {
+            unpark();
+        }
+    }
+    // called by the poller when the socket becomes writable
+    void onWritable() {
+        bool changed;
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            if (!sbuf.drain()) return;
+            sendConflated();
+            changed = checkOutbound();
+        }
+        if (changed) target().onSlowConsumer(*this, slowConsumer);
+    }
 
    protected:
     SessionConfig config;
-    Session(int socket, SessionHandler<SessionConfig>& handler, SessionConfig config) : socket(socket), handler(handler), sbuf(socket, *this), os(&sbuf), config(config) {}
+    Session(int socket, SessionHandler<SessionConfig>& handler, SessionConfig config, BufferPool& pool = BufferPool::shared(), bool borrowBuffers = false) : socket(socket), handler(handler), sbuf(socket, *this, pool, borrowBuffers), os(&sbuf), config(config) {
+        sbuf.setNonBlocking(config.outboundHighWatermark > 0);
+        if constexpr (Policies::throttling && requires { config.throttle; }) throttle = Throttle(config.throttle);
+    }
 
     struct DisconnectHandler {
         Session& session;
         SessionHandler<SessionConfig>& handler;
         DisconnectHandler(Session& session, SessionHandler<SessionConfig>& handler) : session(session), handler(handler) {}
         ~DisconnectHandler() {
-            std::cout << "session disconnected " << session.id() << "\n";
-            handler.onDisconnected(session);
+            Logger::info("session disconnected {}", session.id());
+            if constexpr (Policies::stages) {
+                for (auto stage : handler.stages) stage->onDisconnected(session);
+            }
+            session.target().onDisconnected(session);
         }
     };
 
@@ -93,99 +493,355 @@ class Session : ParkSupport {
     // The message should be sent should not contain any of the header or trailer fields.
     // The msg is automatically reset.
     void sendMessage(const std::string& msgType, FixBuilder& msg) {
-        std::lock_guard<std::mutex> mu(lock);
-        fullMsg.addField(8, config.beginString);
-        fullMsg.addField(9, "0000");
-        fullMsg.addField(35, msgType);
-        fullMsg.addTimeNow(52);
-        config.configureHeader(fullMsg);
-        fullMsg.addBuilder(msg);
-        fullMsg.writeTo(os);
-        os.flush();
+        if constexpr (Policies::dropCopy) {
+            if (handler.dropCopy && !dropCopyTarget && handler.dropCopy->copies(msgType)) return sendCopied(msgType, msg);
+        }
+        bool changed;
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            encode(msgType, msg);
+            changed = checkOutbound();
+        }
+        if (changed) target().onSlowConsumer(*this, slowConsumer);
+    }
+    // Same as sendMessage(), but while the session is a slow consumer the message replaces any queued message
+    // with the same key (e.g. the symbol for a quote), so the client receives the latest value once it catches up.
+    void sendMessage(const std::string& msgType, FixBuilder& msg, const std::string& conflationKey) {
+        bool changed;
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            if (!slowConsumer) {
+                encode(msgType, msg);
+            } else {
+                auto itr = conflatedByKey.find(conflationKey);
+                Conflated* entry;
+                if (itr != conflatedByKey.end()) {
+                    entry = itr->second;
+                    entry->msg.reset();
+                } else {
+                    entry = &conflated.emplace_back();
+                    entry->key = conflationKey;
+                    conflatedByKey[conflationKey] = entry;
+                }
+                entry->msgType = msgType;
+                entry->msg.addBuilder(msg);
+            }
+            changed = checkOutbound();
+        }
+        if (changed) target().onSlowConsumer(*this, slowConsumer);
+    }
+    // Send a message encoded once for many sessions, see Acceptor::broadcast()
+    void sendMessage(const EncodedMessage& msg) {
+        bool changed;
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            if (encodedHeader.prefix.empty()) encodedHeader = EncodedMessage::SessionHeader(config.headerPrefix());
+            EncodedMessage::Scratch scratch;
+            struct iovec iov[EncodedMessage::IOV_COUNT];
+            int count = msg.render(encodedHeader, config.nextSeqNum++, scratch, iov);
+            sbuf.writev(iov, count);
+            changed = checkOutbound();
+        }
+        if (changed) target().onSlowConsumer(*this, slowConsumer);
     }
+    bool isSlowConsumer() const {
+        return slowConsumer;
+    }
+    // true if a send never waits for the peer, see DefaultSessionConfig::outboundHighWatermark
+    bool isNonBlocking() const {
+        return sbuf.isNonBlocking();
+    }
+    // for use by the application or a MessageStage, e.g. the handle assigned by a Sequencer
+    uint64_t userData = 0;
     std::string id() const {
         return config.id();
     }
+    // Set the scheduling class of the session, e.g. High for a latency sensitive client, see EngineOptions::priorities.
+    // Must be called from the session's own fiber, e.g. in onMessage() for the Logon, as it changes the properties of
+    // the calling fiber. A priority set before the fiber starts is applied when it starts.
+    void setPriority(Priority priority) {
+        sessionPriority = priority;
+        if (prioritized) boost::this_fiber::properties<FiberPriority>().priority = priority;
+    }
+    Priority priority() const {
+        return sessionPriority;
+    }
+    // The time the kernel received the message being handled, in nanoseconds since the epoch (CLOCK_REALTIME), or 0
+    // unless EngineOptions::receiveTimestamps. Messages received in one read share the time, and a message received
+    // over several reads has the time of the last.
+    uint64_t receiveTime() const {
+        return messageReceiveTime;
+    }
+    // the messages over the throttle limits, see SessionConfig::throttle
+    const ThrottleStats& throttleStats() const {
+        return throttle.stats;
+    }
+    // the message counts and handler time, only maintained if SessionPolicies::instrumentation
+    const SessionStats& stats() const {
+        return sessionStats;
+    }
 };
 
 template <class SessionConfig=DefaultSessionConfig>
 class Acceptor : public SessionHandler<SessionConfig> {
-    const int port;
+    const Endpoint endpoint;
     int serverSocket;
     std::shared_mutex sessionLock;
     std::map<std::string, Session<SessionConfig>*> sessionMap;
+    // broadcast groups, guarded by the sessionLock
+    std::map<std::string, std::vector<Session<SessionConfig>*>> groups;
     SessionConfig config;
     Poller poller;
     int workerThreads;
+    const EngineOptions options;
+    // the poller signals listen() when connections are pending, see acceptPending()
+    std::mutex acceptLock;
+    std::condition_variable acceptReady;
+    bool pendingConnections = false;
+    bool stopping = false;
+    BufferPool bufferPool;
+    StackPool stackPool;
+    // the pools for each NUMA node of the pinned workers, see EngineOptions::workerCpus
+    struct NodePools {
+        BufferPool bufferPool;
+        StackPool stackPool;
+        NodePools(const EngineOptions& options, int node) : bufferPool(options.bufferSize, node), stackPool(options.stackSize ? options.stackSize : 64 * 1024, options.hugePageStacks, node) {}
+    };
+    std::map<int, std::unique_ptr<NodePools>> nodePools;
+    LatencyHistogram receiveLatencyHistogram;
+    std::unique_ptr<DropCopy> dropCopyWriter;
+    // A session referenced by a sender, so it is not deleted while sending after sessionLock is released. Sending
+    // under the lock could park the fiber holding it, and block the logons and disconnects of all the sessions.
+    struct Unpin {
+        void operator()(Session<SessionConfig>* session) const { session->release(); }
+    };
+    typedef std::unique_ptr<Session<SessionConfig>, Unpin> Pinned;
+    // called holding sessionLock
+    static Pinned pin(Session<SessionConfig>* session) {
+        session->references.fetch_add(1, std::memory_order_relaxed);
+        return Pinned(session);
+    }
+    // a drop copy session buffers what its socket does not accept rather than block the writer, and without its own
+    // watermarks is disconnected once the buffer exceeds dropCopyOutboundLimit
+    void nonBlockingDropCopy(Session<SessionConfig>& session) {
+        {
+            std::lock_guard<std::mutex> mu(session.lock);
+            if (!session.config.outboundHighWatermark) {
+                session.config.outboundHighWatermark = options.dropCopyOutboundLimit;
+                session.config.outboundLowWatermark = options.dropCopyOutboundLimit / 2;
+                session.config.outboundLimit = options.dropCopyOutboundLimit;
+            }
+            session.sbuf.setNonBlocking(true);
+        }
+        // the buffered bytes are written once the socket is writable, see Session::onWritable()
+        poller.add_writable(session.socket);
+    }
+    ReplicaSequences takenOver;
+
+    // start a fiber using the stack allocation configured in the options
+    template <typename Fn>
+    boost::fibers::fiber newFiber(StackPool& stackPool, Fn&& fn) {
+        if (options.pooledStacks) {
+            return boost::fibers::fiber(std::allocator_arg, PooledStack{stackPool}, std::forward<Fn>(fn));
+        } else if (options.stackSize) {
+            return boost::fibers::fiber(std::allocator_arg, boost::fibers::fixedsize_stack(options.stackSize), std::forward<Fn>(fn));
+        }
+        return boost::fibers::fiber(std::forward<Fn>(fn));
+    }
 
    protected:
    public:
-    Acceptor(int port, SessionConfig config, int workerThreads=2) : port(port), config(config), workerThreads(workerThreads) {}
+    // listen for TCP connections on all IPv4 interfaces
+    Acceptor(int port, SessionConfig config, int workerThreads=2, EngineOptions options=EngineOptions()) : Acceptor(Endpoint::tcp(port), config, workerThreads, options) {}
+    Acceptor(Endpoint endpoint, SessionConfig config, int workerThreads=2, EngineOptions options=EngineOptions()) : endpoint(endpoint), config(config), workerThreads(workerThreads), options(options),
+        bufferPool(options.bufferSize), stackPool(options.stackSize ? options.stackSize : 64 * 1024, options.hugePageStacks) {}
     // The message should be sent should not contain any of the header or trailer fields.
     // The msg is automatically reset.
     void sendMessage(const std::string& sessionId, const std::string& msgType, FixBuilder& msg) {
-        Session<SessionConfig>* session;
+        Pinned session;
         {
             std::shared_lock<std::shared_mutex> mu(sessionLock);
-            session = sessionMap[sessionId];
+            auto itr = sessionMap.find(sessionId);
+            if (itr != sessionMap.end()) session = pin(itr->second);
         }
-        if (session != nullptr) {
+        if (session) {
             session->sendMessage(msgType, msg);
         } else {
-            std::cerr << "Session not found for " << sessionId << "\n";
+            Logger::error("Session not found for {}", sessionId);
+        }
+    }
+    // true if the session with the id is logged on, using the same lookup as sendMessage()
+    bool isLoggedOn(const std::string& sessionId) {
+        std::shared_lock<std::shared_mutex> mu(sessionLock);
+        return sessionMap.find(sessionId) != sessionMap.end();
+    }
+    // Send the message to all logged on sessions. The body is encoded once, and only the session specific
+    // header fields are encoded per session. The msg is automatically reset.
+    void broadcast(const std::string& msgType, FixBuilder& msg) {
+        EncodedMessage encoded(config.beginString, msgType, msg);
+        std::vector<Pinned> sessions;
+        {
+            std::shared_lock<std::shared_mutex> mu(sessionLock);
+            sessions.reserve(sessionMap.size());
+            for (auto& entry : sessionMap) sessions.push_back(pin(entry.second));
         }
+        for (auto& session : sessions) session->sendMessage(encoded);
+    }
+    // Send the message to the sessions subscribed to the group, see broadcast(msgType,msg)
+    void broadcast(const std::string& group, const std::string& msgType, FixBuilder& msg) {
+        EncodedMessage encoded(config.beginString, msgType, msg);
+        std::vector<Pinned> sessions;
+        {
+            std::shared_lock<std::shared_mutex> mu(sessionLock);
+            auto itr = groups.find(group);
+            if (itr == groups.end()) return;
+            sessions.reserve(itr->second.size());
+            for (auto session : itr->second) sessions.push_back(pin(session));
+        }
+        for (auto& session : sessions) session->sendMessage(encoded);
+    }
+    // Designate the session with the id as a drop copy session, e.g. for a risk or back office system. It receives a
+    // copy of each message of the msgTypes sent to the other sessions with sendMessage(), with the DeliverToCompID
+    // (128) of the original recipient. The copies are sent by a writer thread, and a drop copy session never blocks
+    // it, see EngineOptions::dropCopyOutboundLimit. Must be called before listen().
+    void addDropCopy(const std::string& sessionId, std::vector<std::string> msgTypes) {
+        if (!dropCopyWriter) {
+            dropCopyWriter = std::make_unique<DropCopy>(options.dropCopyCapacity);
+            this->dropCopy = dropCopyWriter.get();
+        }
+        dropCopyWriter->addTarget(sessionId, std::move(msgTypes));
+    }
+    // Continue the sequences of the sessions replicated from a failed primary, e.g. once Standby::primaryAlive() is
+    // false, so the first successful logon of each session expects and sends the next sequence numbers. Call before
+    // listen().
+    void takeover(Standby& standby) {
+        standby.poll();
+        for (auto& [id, session] : standby.sessions()) takenOver.add(id, session.nextSeqNum, session.expectedSeqNum);
+        this->replicaSequences = &takenOver;
+    }
+    // the copied and dropped messages, see addDropCopy()
+    const DropCopyStats* dropCopyStats() const {
+        return dropCopyWriter ? &dropCopyWriter->stats() : nullptr;
+    }
+    // subscribe a logged on session to a broadcast group. A session is unsubscribed from all groups on disconnect.
+    void subscribe(const std::string& group, const std::string& sessionId) {
+        std::unique_lock<std::shared_mutex> mu(sessionLock);
+        auto itr = sessionMap.find(sessionId);
+        if (itr == sessionMap.end()) {
+            Logger::error("Session not found for {}", sessionId);
+            return;
+        }
+        auto& members = groups[group];
+        if (std::find(members.begin(), members.end(), itr->second) == members.end()) members.push_back(itr->second);
+    }
+    void unsubscribe(const std::string& group, const std::string& sessionId) {
+        std::unique_lock<std::shared_mutex> mu(sessionLock);
+        auto itr = sessionMap.find(sessionId);
+        auto group_itr = groups.find(group);
+        if (itr == sessionMap.end() || group_itr == groups.end()) return;
+        std::erase(group_itr->second, itr->second);
     }
     // override to filter the incoming address. throw an exception to disallow the connection request.
-    virtual void onConnected(struct sockaddr_in remote) {}
+    virtual void onConnected(const Endpoint& remote) {}
     virtual void onDisconnected(const Session<SessionConfig>& session) {
         poller.remove_socket(session.socket);
         std::unique_lock<std::shared_mutex> mu(sessionLock);
-        sessionMap.erase(session.config.id());
+        auto itr = sessionMap.find(session.config.id());
+        // a session which was not logged on can have the same id as a logged on session
+        if (itr == sessionMap.end() || itr->second != &session) return;
+        sessionMap.erase(itr);
+        for (auto& group : groups) std::erase(group.second, &session);
     }
     virtual void onLoggedOn(const Session<SessionConfig>& session) {
+        auto& target = const_cast<Session<SessionConfig>&>(session);
+        if (dropCopyWriter) target.dropCopyTarget = dropCopyWriter->isTarget(session.config.id());
+        if (target.dropCopyTarget) nonBlockingDropCopy(target);
         std::unique_lock<std::shared_mutex> mu(sessionLock);
-        sessionMap[session.config.id()] = const_cast<Session<SessionConfig>*>(&session);
+        sessionMap[session.config.id()] = &target;
+    }
+    // the time from the kernel receiving a message until it is passed to the handler, see EngineOptions::receiveTimestamps
+    const LatencyHistogram& receiveLatency() const {
+        return receiveLatencyHistogram;
     }
     // Listen for initiators. Function does not return until shutdown() is called.
     void listen();
-    // Shutdown the acceptor. This will close the server socket.
+    // Shutdown the acceptor. listen() closes the server socket and terminates the sessions.
     void shutdown() {
-        close(serverSocket);
+        {
+            std::lock_guard<std::mutex> mu(acceptLock);
+            stopping = true;
+        }
+        acceptReady.notify_one();
     }
 };
 
 template <class SessionConfig=DefaultSessionConfig>
 class Initiator : public SessionHandler<SessionConfig> {
-    bool connected = false;
-    const sockaddr_in server;
-    Session<SessionConfig>* session = nullptr;
+    // the session casts its handler to the SessionConfig::Handler, which is the Acceptor's class
+    static_assert(!requires { typename SessionConfig::Handler; }, "an Initiator's SessionConfig cannot declare a Handler");
+    friend class InitiatorPool<SessionConfig>;
+    std::atomic<bool> connected = false;
+    // the addresses of the server, tried in order
+    const std::vector<Endpoint> servers;
+    // shared with the senders, so run() releasing the session does not delete it during a send
+    std::shared_ptr<Session<SessionConfig>> session;
+    // held to replace the session or take a reference to it
+    std::mutex sessionLock;
+    std::shared_ptr<Session<SessionConfig>> current() {
+        std::lock_guard<std::mutex> mu(sessionLock);
+        return session;
+    }
     const SessionConfig config;
     int socket;
+    AuditTrail* audit = nullptr;
+    // parks the fiber in connect(timeout) until the connection completes
+    ParkSupport connecting;
+    // held while the session is released, so disconnect() does not shut down a reused socket
+    std::mutex socketLock;
+    void startSession(ShmChannel* channel);
+    // connect without blocking the thread, parking the calling fiber, see InitiatorPool
+    bool connect(std::chrono::milliseconds timeout);
+    // a non-blocking connect to the server, returns the socket or -1 if it failed or the deadline passed
+    int connect(const Endpoint& server, std::chrono::steady_clock::time_point deadline);
+    // run the session on the calling fiber until it disconnects and release it, returns true if it logged on
+    bool run();
    protected:
     Poller *poller;
 
    public:
-    Initiator(struct sockaddr_in server, const SessionConfig config, Poller* poller = nullptr) : server(server), config(config), poller(poller) {}
+    Initiator(const Endpoint& server, const SessionConfig config, Poller* poller = nullptr) : Initiator(std::vector<Endpoint>{server}, config, poller) {}
+    // connect to the first of the servers accepting the connection, e.g. the addresses from Endpoint::resolveAll()
+    Initiator(std::vector<Endpoint> servers, const SessionConfig config, Poller* poller = nullptr) : servers(std::move(servers)), config(config), poller(poller) {}
     virtual ~Initiator() {
         if (session && session->fiber) session->fiber->join();
-        if (session) delete session;
     }
     // The message should be sent should not contain any of the header or trailer fields.
-    // The msg is automatically reset.
+    // The msg is automatically reset. The message is dropped while a pooled initiator is reconnecting.
     void sendMessage(const std::string& msgType, FixBuilder& msg) {
+        auto session = current();
+        if (!session) {
+            msg.reset();
+            return;
+        }
         session->sendMessage(msgType, msg);
     }
-    void connect();
+    void connect(Transport transport = Transport::Socket);
+    // record the messages of the sessions started by later connects, see AuditTrail
+    void setAudit(AuditTrail& trail) {
+        audit = &trail;
+    }
     bool isConnected() {
         return connected;
     }
     void disconnect() {
-        close(socket);
+        std::lock_guard<std::mutex> mu(socketLock);
+        // the session owns the socket, so only shut it down to terminate handle()
+        if (connected) ::shutdown(socket, SHUT_RDWR);
         connected = false;
     }
     void handle() {
         if(poller) {
-            auto fiber = new boost::fibers::fiber(&Session<SessionConfig>::handle, session);
+            auto fiber = new boost::fibers::fiber(&Session<SessionConfig>::handle, session.get());
             session->fiber = fiber;
             return;
         } else {
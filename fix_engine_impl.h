@@ -0,0 +1,771 @@
+#pragma once
+
+// The definitions of the engine's templates, explicitly instantiated in fix_engine.cpp for the SessionConfigs
+// provided. Include this header in one translation unit to instantiate the engine for another SessionConfig, e.g.
+// one naming its Handler for static dispatch, see SessionPolicies.
+#include "fix_engine.h"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "fix.h"
+#include "msg_logon.h"
+#include "msg_reject.h"
+#include "msg_logout.h"
+#include "socketbuf.h"
+
+template <class SessionConfig>
+void Acceptor<SessionConfig>::listen() {
+    if (!options.symbolFile.empty()) {
+        auto symbols = InternTable::symbols().load(options.symbolFile);
+        if (symbols < 0) {
+            Logger::error("unable to load symbols from {}", options.symbolFile);
+            return;
+        }
+        Logger::info("loaded {} symbols from {}", symbols, options.symbolFile);
+    }
+    if ((serverSocket = socket(endpoint.family(), SOCK_STREAM, 0)) < 0) {
+        Logger::error("socket failed: {}", Errno());
+        return;
+    }
+
+    int opt = 1;
+    if (endpoint.isTcp()) {
+        if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
+            Logger::error("setsockopt SO_REUSEADDR failed: {}", Errno());
+            return;
+        }
+        if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+            Logger::error("setsockopt SO_REUSEPORT failed: {}", Errno());
+            return;
+        }
+    }
+    if (endpoint.family() == AF_INET6) {
+        // accept IPv4 connections as mapped addresses as well
+        int v6only = 0;
+        if (setsockopt(serverSocket, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only))) {
+            Logger::error("setsockopt IPV6_V6ONLY failed: {}", Errno());
+        }
+    }
+#ifdef SO_TIMESTAMPNS
+    // inherited by the accepted sockets, so the data received before a session enables its timestamps is stamped
+    if (options.receiveTimestamps && setsockopt(serverSocket, SOL_SOCKET, SO_TIMESTAMPNS, &opt, sizeof(opt))) {
+        Logger::error("setsockopt SO_TIMESTAMPNS failed: {}", Errno());
+    }
+#endif
+    if (endpoint.isUnixDomain()) {
+        // remove the socket file left by a previous acceptor
+        unlink(endpoint.path().c_str());
+    }
+
+    if (bind(serverSocket, endpoint.addr(), endpoint.size()) < 0) {
+        Logger::error("Error binding socket: {}", Errno());
+        return;
+    }
+
+    typedef boost::fibers::buffered_channel<Session<SessionConfig> *> channel_t;
+    channel_t chan{2};
+
+    workerThreads = std::max(workerThreads,1);
+
+    std::vector<std::thread> workers;
+    boost::fibers::barrier b(workerThreads+1);
+    // the coroutine sessions are assigned round robin to a scheduler, and stay on its thread
+    std::vector<std::unique_ptr<CoroScheduler>> schedulers;
+    size_t nextWorker = 0;
+
+    // pinned workers each have their own channel and keep their sessions, see EngineOptions::workerCpus
+    const bool pinned = !options.workerCpus.empty();
+    std::vector<int> workerCpus(workerThreads, -1);
+    std::vector<NodePools *> workerPools(workerThreads, nullptr);
+    std::vector<std::unique_ptr<channel_t>> workerChannels;
+    if (pinned) {
+        for (int i = 0; i < workerThreads; i++) {
+            workerCpus[i] = options.workerCpus[i % options.workerCpus.size()];
+            auto node = Affinity::nodeOf(workerCpus[i]);
+            auto &pools = nodePools[node];
+            if (!pools) pools = std::make_unique<NodePools>(options, node);
+            workerPools[i] = pools.get();
+            workerChannels.push_back(std::make_unique<channel_t>(2));
+        }
+    }
+
+    if (options.coroutines) {
+        Logger::info("starting {} coroutine scheduler threads", workerThreads);
+        for (int i = 0; i < workerThreads; i++) schedulers.push_back(std::make_unique<CoroScheduler>(workerCpus[i]));
+    } else {
+        Logger::info("starting {} worker threads", workerThreads);
+        for (int i = 0; i < workerThreads; i++) {
+            auto &source = pinned ? *workerChannels[i] : chan;
+            auto &stacks = pinned ? workerPools[i]->stackPool : stackPool;
+            int cpu = workerCpus[i];
+            workers.push_back(std::thread(
+                [this, &source, &stacks, &b, cpu] {
+                    if (options.priorities) {
+                        boost::fibers::use_scheduling_algorithm<PriorityScheduler>(cpu < 0);
+                    } else if (cpu < 0) {
+                        boost::fibers::use_scheduling_algorithm<boost::fibers::algo::shared_work>(true);
+                    }
+                    if (cpu >= 0 && !Affinity::pin(cpu)) {
+                        Logger::error("unable to pin worker to cpu {}", cpu);
+                    }
+                    // wait till all threads joined the shared pool
+                    b.wait();
+                    while (true) {
+                        Session<SessionConfig> *session;
+                        if (source.pop(session) != boost::fibers::channel_op_status::success) {
+                            return;
+                        }
+                        auto fiber = newFiber(stacks, [session] {
+                            if (session->prioritized) boost::this_fiber::properties<FiberPriority>().priority = session->sessionPriority;
+                            session->handle();
+                            // the session has been removed from the session map and poller by onDisconnected(), a
+                            // sender may still reference it
+                            session->release();
+                        });
+                        fiber.detach();
+                    }
+                }));
+        }
+        // wait till all threads joined the shared pool
+        b.wait();
+    }
+
+    if (dropCopyWriter) {
+        dropCopyWriter->start([this](const std::string &sessionId, const std::string &msgType, FixBuilder &msg) {
+            // the lock is held while sending so the session cannot be destroyed, drop copy sessions never block
+            std::shared_lock<std::shared_mutex> mu(sessionLock);
+            auto itr = sessionMap.find(sessionId);
+            if (itr != sessionMap.end()) itr->second->sendMessage(msgType, msg);
+        });
+    }
+
+    Logger::info("starting poller");
+    std::thread poller_thread([this]() {
+        if (options.pollerCpu >= 0 && !Affinity::pin(options.pollerCpu)) Logger::error("unable to pin poller to cpu {}", options.pollerCpu);
+        while (true) {
+            try {
+                poller.poll();
+            } catch (std::runtime_error &err) {
+                Logger::error("poller error: {}", err.what());
+                return;
+            }
+        }
+    });
+
+    Logger::info("listening for connections on {}", endpoint.toString());
+    if (::listen(serverSocket, options.backlog) < 0) {
+        Logger::error("error listening for connections: {}", Errno());
+        return;
+    }
+    int flags = fcntl(serverSocket, F_GETFL, 0);
+    if (fcntl(serverSocket, F_SETFL, flags | O_NONBLOCK) < 0) {
+        Logger::error("unable to set O_NONBLOCK on server socket: {}", Errno());
+        return;
+    }
+    // the poller only signals this thread, since a callback cannot register the accepted sockets with the poller
+    poller.add_listener(serverSocket, this, [](struct kevent &event, void *data) {
+        auto acceptor = static_cast<Acceptor<SessionConfig> *>(data);
+        {
+            std::lock_guard<std::mutex> mu(acceptor->acceptLock);
+            acceptor->pendingConnections = true;
+        }
+        acceptor->acceptReady.notify_one();
+    });
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> mu(acceptLock);
+            acceptReady.wait(mu, [this] { return pendingConnections || stopping; });
+            if (stopping) break;
+            pendingConnections = false;
+        }
+        // accept all pending connections, the listener is edge triggered
+        while (true) {
+            sockaddr_storage clientAddr;
+            socklen_t clientAddrLen = sizeof(clientAddr);
+#ifdef __linux__
+            int clientSocket = accept4(serverSocket, (struct sockaddr *)&clientAddr, &clientAddrLen, SOCK_NONBLOCK);
+#else
+            int clientSocket = accept(serverSocket, (struct sockaddr *)&clientAddr, &clientAddrLen);
+#endif
+            if (clientSocket < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                // the connection was reset before it was accepted
+                if (errno == ECONNABORTED || errno == EINTR) continue;
+                Logger::error("error accepting connection: {}", Errno());
+                // e.g. EMFILE, the connections stay queued and the edge triggered listener will not signal them
+                // again, so retry after a pause
+                std::unique_lock<std::mutex> mu(acceptLock);
+                acceptReady.wait_for(mu, std::chrono::milliseconds(100), [this] { return stopping; });
+                pendingConnections = true;
+                break;
+            }
+            Endpoint remote((struct sockaddr *)&clientAddr, clientAddrLen);
+
+            int flag = 1;
+            if (remote.isTcp() && setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) < 0) {
+                Logger::error("unable to set TCP_NODELAY: {}", Errno());
+            }
+
+#ifndef __linux__
+            int flags = fcntl(clientSocket, F_GETFL, 0);
+            if (fcntl(clientSocket, F_SETFL, flags | O_NONBLOCK) < 0) {
+                Logger::error("unable to set O_NONBLOCK: {}", Errno());
+                close(clientSocket);
+                continue;
+            }
+#endif
+
+            Logger::info("connection from {} on thread {}", remote.toString(), std::this_thread::get_id());
+            // owns the socket until the session is started
+            Session<SessionConfig> *session = nullptr;
+            try {
+                onConnected(remote);
+
+                // the worker to run the session, preferably the one on the cpu receiving its packets
+                size_t worker = nextWorker++ % workerThreads;
+                if (pinned && options.incomingCpu) {
+                    auto cpu = Affinity::incomingCpu(clientSocket);
+                    for (int i = 0; i < workerThreads; i++) {
+                        if (workerCpus[i] == cpu) worker = i;
+                    }
+                }
+                session = new Session(clientSocket, *this, config, pinned ? workerPools[worker]->bufferPool : bufferPool, options.borrowBuffers);
+                // a coroutine session reads the socket directly, so cannot switch to shared memory
+                session->allowSharedMemory = options.sharedMemory && remote.isLocal() && !options.coroutines;
+                if constexpr (Session<SessionConfig>::Policies::batching) session->batchSize = std::max<size_t>(options.batchSize, 1);
+                session->readBudget = options.readBudget;
+                if constexpr (Session<SessionConfig>::Policies::replication) session->replicator = options.replicator;
+                session->prioritized = options.priorities && !options.coroutines;
+                if (options.receiveTimestamps && session->sbuf.enableTimestamps()) session->receiveLatency = &receiveLatencyHistogram;
+                if constexpr (Session<SessionConfig>::Policies::audit) session->sbuf.setAudit(options.audit);
+                if (options.coroutines) {
+                    // a coroutine cannot park in a send, so the bytes the socket does not accept are buffered
+                    session->sbuf.setNonBlocking(true);
+                    session->parker.scheduler = schedulers[worker].get();
+                }
+                // register before the session starts, since it deletes itself on termination
+                poller.add_socket(clientSocket, session, [](struct kevent &event, void *data) {
+                    // on EOF the session reads the end of stream and terminates, closing the socket
+                    auto session = static_cast<Session<SessionConfig> *>(data);
+                    if (event.filter == EVFILT_WRITE) {
+                        session->onWritable();
+                    } else {
+                        session->wake();
+                    }
+                }, config.outboundHighWatermark > 0 || options.coroutines);
+                if (options.coroutines) {
+                    session->parker.scheduler->spawn(session->run(options.bufferSize, std::max(options.maxMessageSize, options.bufferSize)));
+                } else {
+                    (pinned ? *workerChannels[worker] : chan).push(session);
+                }
+                session = nullptr;
+            } catch (std::runtime_error &err) {
+                Logger::error("acceptor refused connection: {}", err.what());
+                if (session) {
+                    // closes the socket
+                    delete session;
+                } else {
+                    close(clientSocket);
+                }
+            }
+        }
+    }
+    poller.remove_socket(serverSocket);
+    close(serverSocket);
+
+    // close the sockets for any active sessions
+    {
+        std::unique_lock<std::shared_mutex> lu(sessionLock);
+        for(auto entry : sessionMap) {
+            ::shutdown(entry.second->socket, SHUT_RDWR);
+            entry.second->wake();
+        }
+    }
+
+    // wait for sessions to terminate
+    while(true) {
+        {
+            std::unique_lock<std::shared_mutex> lu(sessionLock);
+            if(sessionMap.empty()) break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    }
+
+    if (dropCopyWriter) dropCopyWriter->stop();
+    poller.close();
+    poller_thread.join();
+
+    chan.close();
+    for (auto &channel : workerChannels) channel->close();
+
+    for (auto &worker : workers) worker.join();
+    schedulers.clear();
+}
+
+template <class SessionConfig>
+void Session<SessionConfig>::handle() {
+    DisconnectHandler disconnectHandler(*this, handler);
+    std::istream is(&sbuf);
+    std::vector<FixMessage> batch(batchSize);
+    FixBuilder out;
+    try {
+        // std::cout << "handling session " << config << " on thread " << std::this_thread::get_id()<<"\n";
+        if (allowSharedMemory && is.peek() == ShmChannel::HELLO_PREFIX[0] && !acceptSharedMemory(is)) {
+            return;
+        }
+        while (true) {
+            auto sum = sbuf.inboundSum();
+            FixMessage::parse(is, batch[0], GroupDefs());
+            if (is.eof()) {
+                return;
+            }
+            if (garbled(Framing::checksumValid(batch[0].getString(10), sbuf.inboundSum() - sum))) continue;
+            // add the complete messages already in the socket buffer, parsing them cannot wait for the socket
+            size_t count = 1;
+            while (Policies::batching && count < batchSize) {
+                auto available = sbuf.available();
+                auto length = Framing::messageLength(available.data(), available.size());
+                if (!length) break;
+                FixMessage::parse(is, batch[count], GroupDefs());
+                if (!garbled(Framing::checksumValid(available.data(), length))) count++;
+            }
+            messageReceiveTime = sbuf.receiveTime();
+            if (!process(batch, count, out)) {
+                return;
+            }
+            // let the other ready sessions on the worker run
+            if (budgetExhausted(count, !sbuf.available().empty())) boost::this_fiber::yield();
+        }
+    } catch (const std::runtime_error &err) {
+        Logger::error("exception processing session: {}, {}", config, err.what());
+        return;
+    }
+}
+
+// The coroutine version of handle(). The socket is read into a buffer, and a message is only parsed once it is
+// complete, see Framing, so the coroutine only suspends awaiting the socket. The buffer grows to hold a partial
+// message of up to maxMessageSize bytes. The session is deleted on completion.
+template <class SessionConfig>
+Task Session<SessionConfig>::run(size_t bufferSize, size_t maxMessageSize) {
+    {
+        DisconnectHandler disconnectHandler(*this, handler);
+        std::vector<FixMessage> batch(batchSize);
+        FixBuilder out;
+        std::vector<char> buffer(bufferSize);
+        size_t start = 0, end = 0;
+        try {
+            bool open = true;
+            while (open) {
+                size_t length, count = 0, messages = 0;
+                while (open && (length = Framing::messageLength(buffer.data() + start, end - start, maxMessageSize)) > 0) {
+                    if (garbled(Framing::checksumValid(buffer.data() + start, length))) {
+                        start += length;
+                        continue;
+                    }
+                    FrameBuf frame(buffer.data() + start, length);
+                    std::istream is(&frame);
+                    FixMessage::parse(is, batch[count++], GroupDefs());
+                    start += length;
+                    messages++;
+                    if (count == batchSize) {
+                        open = process(batch, count, out);
+                        count = 0;
+                    }
+                }
+                if (open && count) open = process(batch, count, out);
+                if (!open) break;
+                // the socket may have more data, let the other ready sessions on the scheduler run
+                if (budgetExhausted(messages, start != end)) co_await parker.scheduler->yield();
+                // make room for the rest of a partial message
+                if (start == end) {
+                    start = end = 0;
+                } else if (end == buffer.size()) {
+                    if (start == 0) {
+                        // the header of a message this long is incomplete, so it is not a FIX message
+                        if (buffer.size() >= maxMessageSize) throw std::runtime_error("message too large");
+                        buffer.resize(std::min(buffer.size() * 2, maxMessageSize));
+                    }
+                    memmove(buffer.data(), buffer.data() + start, end - start);
+                    end -= start;
+                    start = 0;
+                }
+                auto bytesRead = sbuf.receive(buffer.data() + end, buffer.size() - end);
+                if (bytesRead > 0) {
+                    sbuf.auditInbound(buffer.data() + end, bytesRead);
+                    end += bytesRead;
+                    messageReceiveTime = sbuf.receiveTime();
+                } else if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    turn = 0;
+                    co_await parker;
+                } else {
+                    open = false;
+                }
+            }
+        } catch (const std::runtime_error &err) {
+            Logger::error("exception processing session: {}, {}", config, err.what());
+        }
+    }
+    release();
+}
+
+// a message whose CheckSum does not match is garbled, and is ignored without consuming its sequence number
+template <class SessionConfig>
+bool Session<SessionConfig>::garbled(bool checksumValid) {
+    if (!checksumValid) Logger::error("ignoring message with invalid CheckSum: {}", config);
+    return !checksumValid;
+}
+
+// validate an inbound message and process a Logon, returns false if the session must terminate
+template <class SessionConfig>
+bool Session<SessionConfig>::validate(const FixMessage &msg, FixBuilder &out) {
+    if (!loggedIn && msg.msgType() != Logon::msgType) {
+        Logger::error("rejecting connection, {} is not a Logon", msg.msgType());
+        Logout::build(out, "not logged in");
+        sendMessage(Logout::msgType, out);
+        return false;
+    }
+    auto targetCompId = msg.getString(Tag::TARGET_COMP_ID);
+    if (targetCompId != config.senderCompId) {
+        Logger::error("rejecting connection, invalid target comp id {}, expected {}", targetCompId, config.senderCompId);
+        Logout::build(out, "invalid target comp id");
+        sendMessage(Logout::msgType, out);
+        return false;
+    }
+
+    auto senderCompId = msg.getString(Tag::SENDER_COMP_ID);
+    if (senderCompId != config.targetCompId) {
+        if (config.targetCompId == "*") {
+            config.targetCompId = senderCompId;
+        } else {
+            Logger::error("rejecting connection, invalid sender comp id {}, expected {}", senderCompId, config.targetCompId);
+            Logout::build(out, "invalid sender comp id");
+            sendMessage(Logout::msgType, out);
+            return false;
+        }
+    }
+    // the comp ids are checked first, since a session taken over from a primary is identified by them
+    if (!loggedIn) restoreSequences();
+    if (msg.seqNum() != config.expectedSeqNum) {
+        Logger::error("rejecting connection, {} != expected {}", msg.seqNum(), config.expectedSeqNum);
+        Logout::build(out, "invalid sequence number");
+        sendMessage(Logout::msgType, out);
+        return false;
+    }
+
+    if (!loggedIn) {
+        if (!target().validateLogon(msg)) {
+            Logger::error("logon rejected");
+            Logout::build(out, "invalid logon");
+            sendMessage(Logout::msgType, out);
+            return false;
+        }
+        config.initialize(msg);
+        startReplication();
+        Logon::build(out);
+        sendMessage(Logon::msgType, out);
+        loggedIn = true;
+        sequencesRestored();
+        target().onLoggedOn(*this);
+        if constexpr (Policies::stages) {
+            for (auto stage : handler.stages) stage->onLoggedOn(*this);
+        }
+    }
+    return true;
+}
+
+// apply the throttle to a validated message, see ThrottleAction
+template <class SessionConfig>
+typename Session<SessionConfig>::Admission Session<SessionConfig>::admit(const FixMessage &msg, FixBuilder &out) {
+    if constexpr (!Policies::throttling) {
+        return ADMIT;
+    } else {
+        if (!throttle.enabled()) return ADMIT;
+        auto msgType = msg.msgType();
+        if (msgType == Logon::msgType) return ADMIT;
+        auto wait = throttle.acquire(msgType);
+        if (!wait) return ADMIT;
+        switch (throttle.action) {
+            case ThrottleAction::Queue:
+                if (!parker.scheduler) {
+                    throttle.stats.queued++;
+                    do {
+                        boost::this_fiber::sleep_for(std::chrono::nanoseconds(wait));
+                    } while ((wait = throttle.acquire(msgType)));
+                    return ADMIT;
+                }
+                [[fallthrough]];
+            case ThrottleAction::Reject:
+                throttle.stats.rejected++;
+                Reject::build(out, msg.seqNum(), "throttle limit exceeded");
+                sendMessage(Reject::msgType, out);
+                return DROP;
+            case ThrottleAction::Logout:
+                break;
+        }
+        throttle.stats.loggedOut++;
+        Logger::error("logging out {}, throttle limit exceeded", id());
+        Logout::build(out, "throttle limit exceeded");
+        sendMessage(Logout::msgType, out);
+        return TERMINATE;
+    }
+}
+
+// validate and dispatch an inbound message, returns false if the session must terminate
+template <class SessionConfig>
+bool Session<SessionConfig>::process(const FixMessage &msg, FixBuilder &out) {
+    if (!validate(msg, out)) return false;
+    auto admission = admit(msg, out);
+    if (admission == TERMINATE) return false;
+    if (admission == ADMIT && passesStages(msg)) {
+        recordReceiveLatency(1);
+        auto start = Policies::instrumentation ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        target().onMessage(*this, msg);
+        if constexpr (Policies::instrumentation) {
+            sessionStats.messages++;
+            sessionStats.handlerNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+    config.expectedSeqNum++;
+    replicateInbound();
+    return true;
+}
+
+// true if the messages of a logged on session are in sequence and from the session's counterparty
+template <class SessionConfig>
+bool Session<SessionConfig>::isValidBatch(const std::vector<FixMessage> &batch, size_t count) const {
+    if (!loggedIn) return false;
+    for (size_t i = 0; i < count; i++) {
+        auto &msg = batch[i];
+        if (msg.seqNum() != config.expectedSeqNum + int(i) || msg.getString(Tag::TARGET_COMP_ID) != config.senderCompId ||
+            msg.getString(Tag::SENDER_COMP_ID) != config.targetCompId) return false;
+    }
+    return true;
+}
+
+// Validate and dispatch the messages as a batch to SessionHandler::onMessages(), returns false if the session must
+// terminate. If the batch is not valid as a whole, e.g. it contains the Logon or a sequence gap, the messages are
+// validated one at a time and those before the invalid message are dispatched.
+template <class SessionConfig>
+bool Session<SessionConfig>::process(std::vector<FixMessage> &batch, size_t count, FixBuilder &out) {
+    if (!Policies::batching || batchSize == 1) return process(batch[0], out);
+    bool open = true;
+    size_t valid = 0;
+    if (isValidBatch(batch, count)) {
+        valid = count;
+        config.expectedSeqNum += count;
+    } else {
+        for (; valid < count && (open = validate(batch[valid], out)); valid++) config.expectedSeqNum++;
+    }
+    if (valid) replicateInbound();
+    // move the messages passing the throttle and the stages to the front of the batch
+    size_t passed = 0;
+    for (size_t i = 0; i < valid; i++) {
+        auto admission = admit(batch[i], out);
+        if (admission == TERMINATE) {
+            open = false;
+            break;
+        }
+        if (admission == DROP || !passesStages(batch[i])) continue;
+        if (passed != i) std::swap(batch[passed], batch[i]);
+        passed++;
+    }
+    if (!passed) return open;
+    recordReceiveLatency(passed);
+    auto start = Policies::instrumentation ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    target().onMessages(*this, std::span<const FixMessage>(batch.data(), passed));
+    if constexpr (Policies::instrumentation) {
+        sessionStats.messages += passed;
+        sessionStats.handlerNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+    return open;
+}
+
+template <class SessionConfig>
+bool Session<SessionConfig>::acceptSharedMemory(std::istream &is) {
+    char hello[ShmChannel::HELLO_LENGTH];
+    if (!is.read(hello, sizeof(hello))) return false;
+    hello[sizeof(hello) - 1] = 0;
+    auto prefixLength = strlen(ShmChannel::HELLO_PREFIX);
+    if (strncmp(hello, ShmChannel::HELLO_PREFIX, prefixLength) != 0) {
+        Logger::error("rejecting connection, invalid shared memory hello");
+        return false;
+    }
+    auto channel = ShmChannel::open(hello + prefixLength);
+    os.put(ShmChannel::ACK);
+    os.flush();
+    sbuf.attach(channel);
+    return true;
+}
+
+template <class SessionConfig>
+void Initiator<SessionConfig>::connect(Transport transport) {
+    const Endpoint* server = nullptr;
+    Logger::info("connecting...");
+    for (auto& candidate : servers) {
+        if ((socket = ::socket(candidate.family(), SOCK_STREAM, 0)) < 0) {
+            Logger::error("socket failed: {}", Errno());
+            continue;
+        }
+        if (::connect(socket, candidate.addr(), candidate.size()) == 0) {
+            server = &candidate;
+            break;
+        }
+        Logger::error("socket connect: {}", Errno());
+        close(socket);
+    }
+    if (!server) return;
+
+    int flag = 1;
+    if (server->isTcp() && setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) < 0) {
+        Logger::error("unable to set TCP_NODELAY: {}", Errno());
+    }
+
+    ShmChannel *channel = nullptr;
+    if (transport == Transport::SharedMemory) {
+        auto name = ShmChannel::uniqueName();
+        try {
+            channel = ShmChannel::create(name);
+        } catch (const std::runtime_error &err) {
+            Logger::error("{}", err.what());
+            close(socket);
+            return;
+        }
+        char hello[ShmChannel::HELLO_LENGTH];
+        ShmChannel::hello(hello, name);
+        char ack = 0;
+        if (::write(socket, hello, sizeof(hello)) != sizeof(hello) || ::read(socket, &ack, 1) != 1 || ack != ShmChannel::ACK) {
+            Logger::error("shared memory transport refused");
+            shm_unlink(name.c_str());
+            delete channel;
+            close(socket);
+            return;
+        }
+    }
+
+    if (poller) {
+        int flags = fcntl(socket, F_GETFL, 0);
+        if (fcntl(socket, F_SETFL, flags | O_NONBLOCK) < 0) {
+            Logger::error("unable to set O_NONBLOCK: {}", Errno());
+            delete channel;
+            close(socket);
+            return;
+        }
+    }
+
+    startSession(channel);
+}
+
+template <class SessionConfig>
+void Initiator<SessionConfig>::startSession(ShmChannel *channel) {
+    // a previous session run by handle() must have finished before it is released
+    if (session && session->fiber) session->fiber->join();
+    std::shared_ptr<Session<SessionConfig>> started(new Session(socket, *this, config));
+    if (channel) started->sbuf.attach(channel);
+    if constexpr (Session<SessionConfig>::Policies::audit) started->sbuf.setAudit(audit);
+    {
+        std::lock_guard<std::mutex> mu(sessionLock);
+        session = started;
+    }
+
+    if (poller) {
+        poller->add_socket(socket, started.get(), [](struct kevent &event, void *data) {
+            // on EOF the session reads the end of stream and terminates, closing the socket
+            auto session = static_cast<Session<SessionConfig> *>(data);
+            if (event.filter == EVFILT_WRITE) {
+                session->onWritable();
+            } else {
+                session->unpark();
+            }
+        }, config.outboundHighWatermark > 0);
+    }
+    connected = true;
+    onConnected();
+}
+
+template <class SessionConfig>
+int Initiator<SessionConfig>::connect(const Endpoint &server, std::chrono::steady_clock::time_point deadline) {
+    int fd = ::socket(server.family(), SOCK_STREAM, 0);
+    if (fd < 0) {
+        Logger::error("socket failed: {}", Errno());
+        return -1;
+    }
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        Logger::error("unable to set O_NONBLOCK: {}", Errno());
+        close(fd);
+        return -1;
+    }
+    if (::connect(fd, server.addr(), server.size()) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    // the socket becomes writable when the connection completes or fails
+    poller->add_socket(fd, this, [](struct kevent &event, void *data) {
+        static_cast<Initiator<SessionConfig> *>(data)->connecting.unpark();
+    }, true);
+    struct pollfd pfd = {fd, POLLOUT, 0};
+    while (::poll(&pfd, 1, 0) == 0) {
+        auto remaining = deadline - std::chrono::steady_clock::now();
+        if (remaining <= remaining.zero() || !connecting.parkFor(remaining)) break;
+    }
+    poller->remove_socket(fd);
+    int error = ETIMEDOUT;
+    socklen_t len = sizeof(error);
+    if (pfd.revents && getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0) error = errno;
+    if (error) {
+        close(fd);
+        return -1;
+    }
+
+    int flag = 1;
+    if (server.isTcp() && setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) < 0) {
+        Logger::error("unable to set TCP_NODELAY: {}", Errno());
+    }
+    return fd;
+}
+
+template <class SessionConfig>
+bool Initiator<SessionConfig>::connect(std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    int fd = -1;
+    for (auto &server : servers) {
+        if ((fd = connect(server, deadline)) >= 0) break;
+    }
+    if (fd < 0) return false;
+    {
+        std::lock_guard<std::mutex> mu(socketLock);
+        socket = fd;
+    }
+    startSession(nullptr);
+    return true;
+}
+
+template <class SessionConfig>
+bool Initiator<SessionConfig>::run() {
+    auto running = current();
+    running->handle();
+    bool loggedOn = running->loggedIn;
+    std::lock_guard<std::mutex> mu(socketLock);
+    {
+        std::lock_guard<std::mutex> sessionMu(sessionLock);
+        session.reset();
+    }
+    connected = false;
+    // closes the socket, unless a send still holds the session
+    running.reset();
+    return loggedOn;
+}
@@ -1,12 +1,20 @@
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <iostream>
+#include <sstream>
 #include <thread>
 #include "fix_builder.h"
 #define BOOST_TEST_MODULE fix_engine_test
 #include <boost/test/included/unit_test.hpp>
 
 #include "fix_engine.h"
+#include "fix_engine_impl.h"
 #include "msg_logon.h"
+#include "msg_reject.h"
+#include "exchange.h"
+#include "sequencer.h"
 
 BOOST_AUTO_TEST_CASE( disconnect ) {
     class TestAcceptor : public Acceptor<> {
@@ -103,3 +111,1216 @@ BOOST_AUTO_TEST_CASE( logon ) {
     std::cout << "disconnected client socket\n";
 }
 
+BOOST_AUTO_TEST_CASE( unix_domain_logon ) {
+    std::cout << "----- unix domain logon test\n";
+    class TestAcceptor : public Acceptor<> {
+    public:
+        TestAcceptor(const Endpoint& endpoint, const DefaultSessionConfig& config) : Acceptor(endpoint, config) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onConnected(const Endpoint& remote) override {
+            BOOST_TEST(remote.isLocal());
+        }
+        void onLoggedOn(const Session<>& session) override {
+            Acceptor::onLoggedOn(session);
+            BOOST_TEST(session.id()=="server:client");
+            shutdown();
+        }
+    };
+
+    auto endpoint = Endpoint::unixDomain("/tmp/fix_engine_test." + std::to_string(getpid()));
+    TestAcceptor acceptor(endpoint, DefaultSessionConfig("server", "*"));
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+
+    // give time for acceptor to start
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    class TestInitiator : public Initiator<> {
+    public:
+        TestInitiator(const Endpoint& server, const DefaultSessionConfig& config) : Initiator(server, config) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onConnected() override {
+            FixBuilder msg;
+            Initiator::onConnected();
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+        }
+    };
+
+    TestInitiator initiator(endpoint, DefaultSessionConfig("client", "server"));
+    initiator.connect();
+    BOOST_TEST(initiator.isConnected());
+    t.join();
+    initiator.disconnect();
+    unlink(endpoint.path().c_str());
+}
+
+BOOST_AUTO_TEST_CASE( resolved_addresses ) {
+    std::cout << "----- resolved addresses test\n";
+    class TestAcceptor : public Acceptor<> {
+    public:
+        TestAcceptor(int port, const DefaultSessionConfig& config) : Acceptor(port, config) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onLoggedOn(const Session<>& session) override {
+            Acceptor::onLoggedOn(session);
+            shutdown();
+        }
+    };
+
+    // localhost may resolve to ::1 before 127.0.0.1, which an IPv4 acceptor does not accept
+    auto localhost = Endpoint::resolveAll("localhost", 9001);
+    BOOST_TEST(!localhost.empty());
+    BOOST_TEST(Endpoint::resolve("localhost", 9001).toString() == localhost.front().toString());
+
+    TestAcceptor acceptor(9001, DefaultSessionConfig("server", "*"));
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    class TestInitiator : public Initiator<> {
+    public:
+        TestInitiator(const std::vector<Endpoint>& servers, const DefaultSessionConfig& config) : Initiator(servers, config) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onConnected() override {
+            FixBuilder msg;
+            Initiator::onConnected();
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+        }
+    };
+
+    // the first address refuses the connection
+    TestInitiator initiator({Endpoint::resolve("127.0.0.1", 9002), Endpoint::resolve("127.0.0.1", 9001)}, DefaultSessionConfig("client", "server"));
+    initiator.connect();
+    BOOST_TEST(initiator.isConnected());
+    t.join();
+    initiator.disconnect();
+}
+
+BOOST_AUTO_TEST_CASE( accept_retry ) {
+    std::cout << "----- accept retry test\n";
+    class TestAcceptor : public Acceptor<> {
+    public:
+        std::atomic<int> accepted{0};
+        TestAcceptor(int port, const DefaultSessionConfig& config) : Acceptor(port, config) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onConnected(const Endpoint& remote) override { accepted++; }
+    };
+
+    TestAcceptor acceptor(9001, DefaultSessionConfig("server", "*"));
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    // use up the descriptors, so the acceptor's accept fails with EMFILE
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    BOOST_REQUIRE(client >= 0);
+    struct rlimit saved;
+    getrlimit(RLIMIT_NOFILE, &saved);
+    struct rlimit limited = saved;
+    limited.rlim_cur = std::min<rlim_t>(saved.rlim_cur, 256);
+    setrlimit(RLIMIT_NOFILE, &limited);
+    std::vector<int> fillers;
+    for (int fd; (fd = dup(client)) >= 0;) fillers.push_back(fd);
+
+    auto server = Endpoint::resolve("127.0.0.1", 9001);
+    BOOST_REQUIRE(connect(client, server.addr(), server.size()) == 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    BOOST_TEST(acceptor.accepted == 0);
+
+    // the queued connection is accepted without another connection signalling the listener
+    for (auto fd : fillers) close(fd);
+    setrlimit(RLIMIT_NOFILE, &saved);
+    for (int i = 0; i < 50 && !acceptor.accepted; i++) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    BOOST_TEST(acceptor.accepted == 1);
+    close(client);
+    acceptor.shutdown();
+    t.join();
+}
+
+BOOST_AUTO_TEST_CASE( refused_connection ) {
+    std::cout << "----- refused connection test\n";
+    class TestAcceptor : public Acceptor<> {
+    public:
+        TestAcceptor(int port, const DefaultSessionConfig& config) : Acceptor(port, config) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onConnected(const Endpoint& remote) override { throw std::runtime_error("refused"); }
+    };
+
+    TestAcceptor acceptor(9001, DefaultSessionConfig("server", "*"));
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    // the acceptor closes a refused connection, so the client reads the end of stream
+    auto server = Endpoint::resolve("127.0.0.1", 9001);
+    for (int i = 0; i < 5; i++) {
+        int client = socket(AF_INET, SOCK_STREAM, 0);
+        BOOST_REQUIRE(client >= 0);
+        struct timeval timeout = {5, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        BOOST_REQUIRE(connect(client, server.addr(), server.size()) == 0);
+        char c;
+        BOOST_TEST(read(client, &c, 1) == 0);
+        close(client);
+    }
+    acceptor.shutdown();
+    t.join();
+}
+
+BOOST_AUTO_TEST_CASE( coroutine_session ) {
+    std::cout << "----- coroutine session test\n";
+    class TestAcceptor : public Acceptor<> {
+    public:
+        TestAcceptor(int port, const DefaultSessionConfig& config, EngineOptions options) : Acceptor(port, config, 1, options) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() != "D") return;
+            BOOST_TEST(msg.getString(11) == "order1");
+            shutdown();
+        }
+        bool validateLogon(const FixMessage& logon) override { return true; }
+    };
+
+    EngineOptions options;
+    options.coroutines = true;
+    TestAcceptor acceptor(9001, DefaultSessionConfig("server", "*"), options);
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+
+    // give time for acceptor to start
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    class TestInitiator : public Initiator<> {
+    public:
+        TestInitiator(const Endpoint& server, const DefaultSessionConfig& config) : Initiator(server, config) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onConnected() override {
+            FixBuilder msg;
+            Initiator::onConnected();
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+            msg.addField(11, "order1");
+            sendMessage("D", msg);
+        }
+    };
+
+    TestInitiator initiator(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("client", "server"));
+    initiator.connect();
+    BOOST_TEST(initiator.isConnected());
+    t.join();
+    initiator.disconnect();
+}
+
+BOOST_AUTO_TEST_CASE( coroutine_max_message ) {
+    std::cout << "----- coroutine max message test\n";
+    class TestAcceptor : public Acceptor<> {
+    public:
+        std::atomic<int> orders{0};
+        TestAcceptor(int port, const DefaultSessionConfig& config, EngineOptions options) : Acceptor(port, config, 1, options) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() == "D") orders++;
+        }
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onDisconnected(const Session<>& session) override {
+            Acceptor::onDisconnected(session);
+            shutdown();
+        }
+    };
+
+    EngineOptions options;
+    options.coroutines = true;
+    options.maxMessageSize = 8 * 1024;
+    TestAcceptor acceptor(9001, DefaultSessionConfig("server", "*"), options);
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    class TestInitiator : public Initiator<> {
+    public:
+        TestInitiator(const Endpoint& server, const DefaultSessionConfig& config) : Initiator(server, config) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onConnected() override {
+            FixBuilder msg;
+            Initiator::onConnected();
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+            msg.addField(58, std::string(9000, 'x'));
+            sendMessage("D", msg);
+        }
+    };
+
+    // the session is terminated rather than buffering the message
+    TestInitiator initiator(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("client", "server"));
+    initiator.connect();
+    t.join();
+    initiator.disconnect();
+    BOOST_TEST(acceptor.orders == 0);
+}
+
+// a message from the client "client" to "server", with its CheckSum off by one if garbled
+static std::string rawMessage(const char* msgType, int seqNum, const char* clOrdId, bool garbled = false) {
+    FixBuilder msg;
+    msg.addField(8, "FIX.4.4");
+    msg.addField(9, "0000");
+    msg.addField(35, msgType);
+    msg.addField(49, "client");
+    msg.addField(56, "server");
+    msg.addField(34, seqNum);
+    if (clOrdId) msg.addField(11, clOrdId);
+    std::ostringstream os;
+    msg.writeTo(os);
+    auto bytes = os.str();
+    if (garbled) bytes[bytes.size() - 2] = bytes[bytes.size() - 2] == '9' ? '0' : bytes[bytes.size() - 2] + 1;
+    return bytes;
+}
+
+static void garbledMessages(bool coroutines) {
+    class TestAcceptor : public Acceptor<> {
+    public:
+        std::vector<std::string> orders;
+        TestAcceptor(int port, const DefaultSessionConfig& config, EngineOptions options) : Acceptor(port, config, 1, options) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() == "D") orders.emplace_back(msg.getString(11));
+        }
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onDisconnected(const Session<>& session) override {
+            Acceptor::onDisconnected(session);
+            shutdown();
+        }
+    };
+
+    EngineOptions options;
+    options.coroutines = coroutines;
+    TestAcceptor acceptor(9001, DefaultSessionConfig("server", "*"), options);
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    auto server = Endpoint::resolve("127.0.0.1", 9001);
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    BOOST_REQUIRE(client >= 0);
+    BOOST_REQUIRE(connect(client, server.addr(), server.size()) == 0);
+    // a garbled message is ignored, so the next message reuses its sequence number, both on its own and in a batch
+    for (auto bytes : {rawMessage("A", 1, nullptr), rawMessage("D", 2, "order1", true),
+                       rawMessage("D", 2, "order2") + rawMessage("D", 3, "order3", true) + rawMessage("D", 3, "order4")}) {
+        BOOST_REQUIRE(write(client, bytes.data(), bytes.size()) == ssize_t(bytes.size()));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    close(client);
+    t.join();
+    BOOST_TEST(acceptor.orders == (std::vector<std::string>{"order2", "order4"}), boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE( garbled_message ) {
+    std::cout << "----- garbled message test\n";
+    garbledMessages(false);
+    garbledMessages(true);
+}
+
+BOOST_AUTO_TEST_CASE( pinned_workers ) {
+    std::cout << "----- pinned workers test\n";
+    class TestAcceptor : public Acceptor<> {
+    public:
+        TestAcceptor(int port, const DefaultSessionConfig& config, EngineOptions options) : Acceptor(port, config, 2, options) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() != "D") return;
+            BOOST_TEST(msg.getString(11) == "order1");
+            shutdown();
+        }
+        bool validateLogon(const FixMessage& logon) override { return true; }
+    };
+
+    EngineOptions options;
+    options.workerCpus = {0};
+    options.pollerCpu = 0;
+    options.incomingCpu = true;
+    options.pooledStacks = true;
+    TestAcceptor acceptor(9001, DefaultSessionConfig("server", "*"), options);
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+
+    // give time for acceptor to start
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    class TestInitiator : public Initiator<> {
+    public:
+        TestInitiator(const Endpoint& server, const DefaultSessionConfig& config) : Initiator(server, config) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onConnected() override {
+            FixBuilder msg;
+            Initiator::onConnected();
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+            msg.addField(11, "order1");
+            sendMessage("D", msg);
+        }
+    };
+
+    TestInitiator initiator(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("client", "server"));
+    initiator.connect();
+    BOOST_TEST(initiator.isConnected());
+    t.join();
+    initiator.disconnect();
+}
+
+BOOST_AUTO_TEST_CASE( read_budget ) {
+    std::cout << "----- read budget test\n";
+    class TestAcceptor : public Acceptor<> {
+    public:
+        int orders = 0;
+        TestAcceptor(int port, const DefaultSessionConfig& config, EngineOptions options) : Acceptor(port, config, 1, options) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() == Logon::msgType) session.setPriority(Priority::High);
+            if (msg.msgType() != "D") return;
+            BOOST_TEST((session.priority() == Priority::High));
+            // the session's fiber is scheduled with it
+            BOOST_TEST((boost::this_fiber::properties<FiberPriority>().priority == Priority::High));
+            BOOST_TEST(msg.getInt(11) == orders);
+            if (++orders == 1000) shutdown();
+        }
+        bool validateLogon(const FixMessage& logon) override { return true; }
+    };
+
+    EngineOptions options;
+    options.readBudget = 4;
+    options.priorities = true;
+    TestAcceptor acceptor(9001, DefaultSessionConfig("server", "*"), options);
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+
+    // give time for acceptor to start
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    class TestInitiator : public Initiator<> {
+    public:
+        TestInitiator(const Endpoint& server, const DefaultSessionConfig& config) : Initiator(server, config) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onConnected() override {
+            FixBuilder msg;
+            Initiator::onConnected();
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+            for (int i = 0; i < 1000; i++) {
+                msg.addField(11, i);
+                sendMessage("D", msg);
+            }
+        }
+    };
+
+    TestInitiator initiator(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("client", "server"));
+    initiator.connect();
+    BOOST_TEST(initiator.isConnected());
+    t.join();
+    BOOST_TEST(acceptor.orders == 1000);
+    initiator.disconnect();
+}
+
+BOOST_AUTO_TEST_CASE( receive_timestamps ) {
+    std::cout << "----- receive timestamps test\n";
+    class TestAcceptor : public Acceptor<> {
+    public:
+        TestAcceptor(int port, const DefaultSessionConfig& config, EngineOptions options) : Acceptor(port, config, 1, options) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() != "D") return;
+            auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            BOOST_TEST(session.receiveTime() > 0);
+            BOOST_TEST(session.receiveTime() <= uint64_t(now));
+            BOOST_TEST(uint64_t(now) - session.receiveTime() < 5000000000ULL);
+            shutdown();
+        }
+        bool validateLogon(const FixMessage& logon) override { return true; }
+    };
+
+    EngineOptions options;
+    options.receiveTimestamps = true;
+    TestAcceptor acceptor(9001, DefaultSessionConfig("server", "*"), options);
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+
+    // give time for acceptor to start
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    class TestInitiator : public Initiator<> {
+    public:
+        TestInitiator(const Endpoint& server, const DefaultSessionConfig& config) : Initiator(server, config) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onConnected() override {
+            FixBuilder msg;
+            Initiator::onConnected();
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+            msg.addField(11, "order1");
+            sendMessage("D", msg);
+        }
+    };
+
+    TestInitiator initiator(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("client", "server"));
+    initiator.connect();
+    BOOST_TEST(initiator.isConnected());
+    t.join();
+    // the logon and the order
+    BOOST_TEST(acceptor.receiveLatency().count() >= 1);
+    std::cout << "socket to handler p50 " << acceptor.receiveLatency().percentile(50) << " nsec\n";
+    initiator.disconnect();
+}
+
+BOOST_AUTO_TEST_CASE( throttle ) {
+    std::cout << "----- throttle test\n";
+    class TestAcceptor : public Acceptor<> {
+    public:
+        std::atomic<int> orders = 0;
+        ThrottleStats stats;
+        TestAcceptor(int port, const DefaultSessionConfig& config) : Acceptor(port, config, 1) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() == "D") orders++;
+        }
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onDisconnected(const Session<>& session) override {
+            stats = session.throttleStats();
+            Acceptor::onDisconnected(session);
+            shutdown();
+        }
+    };
+
+    // a burst of 5 orders, then one per 10 seconds, and 6 application messages in all
+    DefaultSessionConfig config("server", "*");
+    config.throttle.limits.push_back({"D", 0.1, 5});
+    config.throttle.limits.push_back({"", 0.1, 6});
+    TestAcceptor acceptor(9001, config);
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+
+    // give time for acceptor to start
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    class TestInitiator : public Initiator<> {
+    public:
+        std::atomic<int> rejects = 0;
+        TestInitiator(const Endpoint& server, const DefaultSessionConfig& config) : Initiator(server, config) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() == Reject::msgType) rejects++;
+        }
+        void onConnected() override {
+            FixBuilder msg;
+            Initiator::onConnected();
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+            for (int i = 0; i < 10; i++) {
+                msg.addField(11, i);
+                sendMessage("D", msg);
+            }
+            // session level messages are not limited by the application message limit
+            for (int i = 0; i < 10; i++) sendMessage("0", msg);
+        }
+    };
+
+    TestInitiator initiator(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("client", "server"));
+    initiator.connect();
+    BOOST_TEST(initiator.isConnected());
+    auto reader = std::thread([&initiator](){
+        initiator.handle();
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    initiator.disconnect();
+    reader.join();
+    t.join();
+    BOOST_TEST(acceptor.orders == 5);
+    BOOST_TEST(acceptor.stats.rejected == 5u);
+    BOOST_TEST(initiator.rejects == 5);
+}
+
+BOOST_AUTO_TEST_CASE( drop_copy ) {
+    std::cout << "----- drop copy test\n";
+    class TestAcceptor : public Acceptor<> {
+    public:
+        std::atomic<bool> dropCopyNonBlocking = false;
+        TestAcceptor(int port, const DefaultSessionConfig& config) : Acceptor(port, config, 1) {}
+        void onLoggedOn(const Session<>& session) override {
+            Acceptor::onLoggedOn(session);
+            if (session.id() == "server:dropcopy") dropCopyNonBlocking = session.isNonBlocking();
+        }
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() != "D") return;
+            FixBuilder report;
+            report.addField(11, msg.getString(11));
+            report.addField(58, "filled");
+            session.sendMessage("8", report);
+            // not copied
+            session.sendMessage("0", report);
+        }
+        bool validateLogon(const FixMessage& logon) override { return true; }
+    };
+
+    DefaultSessionConfig config("server", "*");
+    TestAcceptor acceptor(9001, config);
+    acceptor.addDropCopy("server:dropcopy", {"8"});
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+
+    // give time for acceptor to start
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    class TestInitiator : public Initiator<> {
+    public:
+        int orders;
+        std::atomic<int> reports = 0;
+        std::atomic<int> heartbeats = 0;
+        std::vector<std::string> deliverTo;
+        std::vector<std::string> orderIds;
+        std::vector<std::string> texts;
+        TestInitiator(const Endpoint& server, const DefaultSessionConfig& config, int orders) : Initiator(server, config), orders(orders) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() == "0") heartbeats++;
+            if (msg.msgType() != "8") return;
+            deliverTo.emplace_back(msg.getString(128));
+            orderIds.emplace_back(msg.getString(11));
+            texts.emplace_back(msg.getString(58));
+            reports++;
+        }
+        void onConnected() override {
+            FixBuilder msg;
+            Initiator::onConnected();
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+            for (int i = 0; i < orders; i++) {
+                msg.addField(11, i);
+                sendMessage("D", msg);
+            }
+        }
+    };
+
+    TestInitiator dropCopy(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("dropcopy", "server"), 0);
+    dropCopy.connect();
+    auto dropCopyReader = std::thread([&dropCopy](){
+        dropCopy.handle();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    TestInitiator client(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("client", "server"), 10);
+    client.connect();
+    auto clientReader = std::thread([&client](){
+        client.handle();
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    client.disconnect();
+    dropCopy.disconnect();
+    clientReader.join();
+    dropCopyReader.join();
+    acceptor.shutdown();
+    t.join();
+
+    BOOST_TEST(client.reports == 10);
+    BOOST_TEST(dropCopy.reports == 10);
+    BOOST_TEST(dropCopy.heartbeats == 0);
+    BOOST_TEST(acceptor.dropCopyStats()->copied == 10u);
+    BOOST_TEST(acceptor.dropCopyStats()->dropped == 0u);
+    // the drop copy session does not set outboundHighWatermark, but never blocks the writer
+    BOOST_TEST(acceptor.dropCopyNonBlocking);
+    for (int i = 0; i < dropCopy.reports; i++) {
+        BOOST_TEST(dropCopy.deliverTo[i] == "client");
+        BOOST_TEST(dropCopy.orderIds[i] == std::to_string(i));
+        BOOST_TEST(dropCopy.texts[i] == "filled");
+    }
+}
+
+BOOST_AUTO_TEST_CASE( shared_memory ) {
+    std::cout << "----- shared memory test\n";
+    class TestAcceptor : public Acceptor<> {
+    public:
+        TestAcceptor(const Endpoint& endpoint, const DefaultSessionConfig& config, EngineOptions options) : Acceptor(endpoint, config, 1, options) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() != "D") return;
+            FixBuilder report;
+            report.addField(11, msg.getString(11));
+            session.sendMessage("8", report);
+        }
+        bool validateLogon(const FixMessage& logon) override { return true; }
+    };
+
+    class TestInitiator : public Initiator<> {
+    public:
+        std::atomic<int> reports = 0;
+        TestInitiator(const Endpoint& server, const DefaultSessionConfig& config) : Initiator(server, config) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() == "8") reports++;
+        }
+        void onConnected() override {
+            FixBuilder msg;
+            Initiator::onConnected();
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+            for (int i = 0; i < 100; i++) {
+                msg.addField(11, i);
+                sendMessage("D", msg);
+            }
+        }
+    };
+
+    EngineOptions options;
+    options.sharedMemory = true;
+    auto endpoint = Endpoint::unixDomain("/tmp/fix_engine_test." + std::to_string(getpid()));
+    TestAcceptor acceptor(endpoint, DefaultSessionConfig("server", "*"), options);
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    // the hello handshake switches the session to the rings, the socket is the doorbell
+    TestInitiator initiator(endpoint, DefaultSessionConfig("client", "server"));
+    initiator.connect(Transport::SharedMemory);
+    BOOST_REQUIRE(initiator.isConnected());
+    auto reader = std::thread([&initiator](){
+        initiator.handle();
+    });
+    for (int i = 0; i < 100 && initiator.reports < 100; i++) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    BOOST_TEST(initiator.reports == 100);
+    initiator.disconnect();
+    reader.join();
+    acceptor.shutdown();
+    t.join();
+    unlink(endpoint.path().c_str());
+}
+
+BOOST_AUTO_TEST_CASE( exchange_symbols ) {
+    std::cout << "----- exchange symbols test\n";
+    class TestAcceptor : public Acceptor<> {
+        // each session may add one symbol
+        Exchange exchange{*this, nullptr, 1};
+    public:
+        TestAcceptor(int port, const DefaultSessionConfig& config) : Acceptor(port, config) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override { exchange.onMessage(session, msg); }
+        bool validateLogon(const FixMessage& logon) override { return true; }
+    };
+
+    class TestInitiator : public Initiator<> {
+    public:
+        std::atomic<int> reports = 0, rejects = 0;
+        TestInitiator(const Endpoint& server, const DefaultSessionConfig& config) : Initiator(server, config) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() == ExecutionReport::msgType) reports++;
+            if (msg.msgType() == BusinessMessageReject::msgType && msg.getString(380) == "2") rejects++;
+        }
+        void onConnected() override {
+            FixBuilder msg;
+            Initiator::onConnected();
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+            for (auto symbol : {"SYMBOL.A", "SYMBOL.B", "SYMBOL.A"}) {
+                NewOrderSingle::build<7>(msg, symbol, OrderType::Limit, OrderSide::Buy, F(10.0), F(1.0), "order");
+                sendMessage(NewOrderSingle::msgType, msg);
+            }
+        }
+    };
+
+    TestAcceptor acceptor(9001, DefaultSessionConfig("server", "*"));
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    TestInitiator initiator(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("client", "server"));
+    initiator.connect();
+    BOOST_REQUIRE(initiator.isConnected());
+    auto reader = std::thread([&initiator](){
+        initiator.handle();
+    });
+    for (int i = 0; i < 100 && (initiator.reports < 2 || initiator.rejects < 1); i++) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    // the second symbol is over the session's limit, so it was not added
+    BOOST_TEST(initiator.reports == 2);
+    BOOST_TEST(initiator.rejects == 1);
+    BOOST_TEST(InternTable::symbols().find("SYMBOL.B") == InternTable::NONE);
+    initiator.disconnect();
+    reader.join();
+    acceptor.shutdown();
+    t.join();
+}
+
+BOOST_AUTO_TEST_CASE( symbol_quota ) {
+    auto& symbols = InternTable::symbols();
+    // one symbol per session, two in total
+    SymbolQuota quota(1, 2);
+    auto id = quota.add("A", "QUOTA.A");
+    BOOST_TEST(id == symbols.find("QUOTA.A"));
+    BOOST_TEST(quota.add("A", "QUOTA.B") == InternTable::NONE);
+    id = quota.add("B", "QUOTA.B");
+    BOOST_TEST(id == symbols.find("QUOTA.B"));
+    // a new session id cannot add more once the exchange is at its limit
+    BOOST_TEST(quota.add("C", "QUOTA.C") == InternTable::NONE);
+    BOOST_TEST(symbols.find("QUOTA.C") == InternTable::NONE);
+}
+
+BOOST_AUTO_TEST_CASE( replication ) {
+    std::cout << "----- replication test\n";
+    class TestAcceptor : public Acceptor<> {
+    public:
+        TestAcceptor(int port, const DefaultSessionConfig& config, EngineOptions options) : Acceptor(port, config, 1, options) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() != "D") return;
+            FixBuilder report;
+            report.addField(11, msg.getString(11));
+            session.sendMessage("8", report);
+        }
+        bool validateLogon(const FixMessage& logon) override { return true; }
+    };
+
+    class TestInitiator : public Initiator<> {
+    public:
+        int orders;
+        std::atomic<bool> loggedOn = false;
+        std::atomic<int> reports = 0;
+        std::atomic<int> lastSeqNum = 0;
+        TestInitiator(const Endpoint& server, const DefaultSessionConfig& config, int orders) : Initiator(server, config), orders(orders) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onLoggedOn(const Session<>& session) override { loggedOn = true; }
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            lastSeqNum = msg.seqNum();
+            if (msg.msgType() == "8") reports++;
+        }
+        void onConnected() override {
+            FixBuilder msg;
+            Initiator::onConnected();
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+            for (int i = 0; i < orders; i++) {
+                msg.addField(11, i);
+                sendMessage("D", msg);
+            }
+        }
+        void run() {
+            connect();
+            auto reader = std::thread([this](){
+                handle();
+            });
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            disconnect();
+            reader.join();
+        }
+    };
+
+    DefaultSessionConfig config("server", "*");
+    auto segment = "/cppfix.fix_engine_test." + std::to_string(getpid());
+    auto replicator = Replicator::create(segment, 1024 * 1024);
+    auto standby = Standby::open(segment);
+    {
+        EngineOptions options;
+        options.replicator = replicator.get();
+        TestAcceptor primary(9001, config, options);
+        auto t = std::thread([&primary](){
+            primary.listen();
+        });
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        TestInitiator client(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("client", "server"), 5);
+        client.run();
+        primary.shutdown();
+        t.join();
+        BOOST_TEST(client.reports == 5);
+    }
+
+    // the logon, 5 orders and the client's logon reply received, the logon and 5 reports sent
+    BOOST_TEST(standby->poll() > 0u);
+    auto& replicated = standby->sessions().at("server:client");
+    BOOST_TEST(replicated.expectedSeqNum == 8);
+    BOOST_TEST(replicated.nextSeqNum == 7);
+    BOOST_TEST(replicated.journal.size() == 6u);
+
+    TestAcceptor takeover(9001, config, EngineOptions());
+    takeover.takeover(*standby);
+    auto t = std::thread([&takeover](){
+        takeover.listen();
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    // a logon with the wrong sequence number is rejected, and does not use up the replicated sequences
+    TestInitiator rejected(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("client", "server"), 0);
+    rejected.run();
+    BOOST_TEST(!rejected.loggedOn);
+    // the client continues its sequences
+    DefaultSessionConfig clientConfig("client", "server");
+    clientConfig.nextSeqNum = 8;
+    clientConfig.expectedSeqNum = 7;
+    TestInitiator client(Endpoint::resolve("127.0.0.1", 9001), clientConfig, 1);
+    client.run();
+    takeover.shutdown();
+    t.join();
+    BOOST_TEST(client.loggedOn);
+    BOOST_TEST(client.reports == 1);
+    BOOST_TEST(client.lastSeqNum == 8);
+}
+
+BOOST_AUTO_TEST_CASE( node_buffer_pool ) {
+    BufferPool pool(4096, Affinity::nodeOf(0));
+    std::vector<char*> buffers;
+    // more than a slab
+    for (int i = 0; i < 100; i++) {
+        buffers.push_back(pool.acquire());
+        memset(buffers.back(), i, 4096);
+    }
+    for (int i = 0; i < 100; i++) BOOST_TEST(buffers[i][4095] == char(i));
+    for (auto buffer : buffers) pool.release(buffer);
+    BOOST_TEST(pool.acquire() == buffers.back());
+}
+
+BOOST_AUTO_TEST_CASE( buffer_pool ) {
+    BufferPool pool(1024);
+    BOOST_TEST(pool.size() == 1024u);
+    auto a = pool.acquire();
+    auto b = pool.acquire();
+    BOOST_TEST(a != b);
+    memset(a, 'a', 1024);
+    memset(b, 'b', 1024);
+    pool.release(a);
+    pool.release(b);
+    // recycled most recently released first
+    BOOST_TEST(pool.acquire() == b);
+    BOOST_TEST(pool.acquire() == a);
+    pool.release(a);
+    pool.release(b);
+}
+
+BOOST_AUTO_TEST_CASE( stack_pool ) {
+    for (bool hugePages : {false, true}) {
+        StackPool pool(64 * 1024, hugePages);
+        auto first = pool.allocate();
+        auto second = pool.allocate();
+        BOOST_TEST(first.size >= 64u * 1024);
+        BOOST_TEST(first.sp != second.sp);
+        // the whole stack is writable
+        for (auto& sctx : {first, second}) memset(static_cast<char*>(sctx.sp) - sctx.size, 1, sctx.size);
+        if (pool.slabStacks() > 0) {
+            // several stacks share a huge page, separated by a guard gap
+            BOOST_TEST(pool.slabStacks() > 1u);
+            auto distance = std::abs(static_cast<char*>(first.sp) - static_cast<char*>(second.sp));
+            BOOST_TEST(size_t(distance) > first.size);
+            BOOST_TEST(size_t(distance) < 2 * first.size);
+        }
+        auto sp = second.sp;
+        pool.deallocate(second);
+        BOOST_TEST(pool.allocate().sp == sp);
+        pool.deallocate(first);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( borrowed_buffers ) {
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    BufferPool pool(256);
+    ParkSupport ps;
+    Socketbuf sbuf(fds[0], ps, pool, true);
+    BOOST_REQUIRE(::write(fds[1], "abc", 3) == 3);
+    BOOST_TEST(sbuf.sgetc() == 'a');
+    auto buffer = sbuf.available().data();
+    for (char c : std::string("abc")) BOOST_TEST(sbuf.sbumpc() == c);
+
+    // the next read finds the socket empty, so the buffer is returned to the pool before parking
+    bool released = false;
+    std::thread writer([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        auto reused = pool.acquire();
+        released = reused == buffer;
+        pool.release(reused);
+        (void)!::write(fds[1], "def", 3);
+        ps.unpark();
+    });
+    BOOST_TEST(sbuf.sgetc() == 'd');
+    writer.join();
+    BOOST_TEST(released);
+    // and acquired again once there is data
+    BOOST_TEST(sbuf.available() == "def");
+    BOOST_TEST(sbuf.available().data() == buffer);
+    ::close(fds[1]);
+}
+
+BOOST_AUTO_TEST_CASE( batch_messages ) {
+    std::cout << "----- batch messages test\n";
+    class TestAcceptor : public Acceptor<> {
+    public:
+        int orders = 0;
+        TestAcceptor(int port, const DefaultSessionConfig& config, EngineOptions options) : Acceptor(port, config, 1, options) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            BOOST_FAIL("onMessage() called with batching enabled");
+        }
+        void onMessages(Session<>& session, std::span<const FixMessage> msgs) override {
+            BOOST_TEST(msgs.size() <= 16u);
+            for (auto& msg : msgs) {
+                if (msg.msgType() != "D") continue;
+                BOOST_TEST(msg.getString(11) == "order" + std::to_string(orders++));
+            }
+            if (orders == 100) shutdown();
+        }
+        bool validateLogon(const FixMessage& logon) override { return true; }
+    };
+
+    class TestInitiator : public Initiator<> {
+    public:
+        TestInitiator(const Endpoint& server, const DefaultSessionConfig& config) : Initiator(server, config) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onConnected() override {
+            FixBuilder msg;
+            Initiator::onConnected();
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+            for (int i = 0; i < 100; i++) {
+                msg.addField(11, "order" + std::to_string(i));
+                sendMessage("D", msg);
+            }
+        }
+    };
+
+    for (bool coroutines : {false, true}) {
+        EngineOptions options;
+        options.batchSize = 16;
+        options.coroutines = coroutines;
+        TestAcceptor acceptor(9001, DefaultSessionConfig("server", "*"), options);
+        auto t = std::thread([&acceptor](){
+            acceptor.listen();
+        });
+
+        // give time for acceptor to start
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        TestInitiator initiator(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("client", "server"));
+        initiator.connect();
+        BOOST_TEST(initiator.isConnected());
+        t.join();
+        initiator.disconnect();
+        BOOST_TEST(acceptor.orders == 100);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( slow_consumer ) {
+    std::cout << "----- slow consumer test\n";
+    static const int N_QUOTES = 100000;
+    class TestAcceptor : public Acceptor<> {
+    public:
+        std::atomic<int> becameSlow = 0;
+        std::atomic<int> recovered = 0;
+        bool sent = false;
+        TestAcceptor(int port, const DefaultSessionConfig& config) : Acceptor(port, config) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() != Logon::msgType || sent) return;
+            sent = true;
+            // the client is not reading, so these are conflated once the outbound buffer is full
+            FixBuilder fix;
+            for (int i = 0; i < N_QUOTES; i++) {
+                fix.addField(55, "IBM");
+                fix.addField(58, i);
+                session.sendMessage("X", fix, "IBM");
+            }
+            BOOST_TEST(session.isSlowConsumer());
+        }
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onSlowConsumer(const Session<>& session, bool slow) override {
+            (slow ? becameSlow : recovered) += 1;
+        }
+        void onDisconnected(const Session<>& session) override {
+            Acceptor::onDisconnected(session);
+            shutdown();
+        }
+    };
+
+    DefaultSessionConfig serverConfig("server", "*");
+    serverConfig.outboundHighWatermark = 16 * 1024;
+    serverConfig.outboundLowWatermark = 4 * 1024;
+    serverConfig.outboundLimit = 1024 * 1024;
+    TestAcceptor acceptor(9001, serverConfig);
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+
+    // give time for acceptor to start
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    class TestInitiator : public Initiator<> {
+    public:
+        int received = 0;
+        int last = -1;
+        TestInitiator(const sockaddr_in server, const DefaultSessionConfig& config) : Initiator(server, config) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onConnected() override {
+            FixBuilder msg;
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+        }
+        void onMessage(Session<>& session, const FixMessage& msg) override {
+            if (msg.msgType() != "X") return;
+            received++;
+            last = msg.getInt(58);
+            if (last == N_QUOTES - 1) disconnect();
+        }
+    };
+
+    sockaddr_in server;
+    server.sin_family = AF_INET;
+    server.sin_port = htons(9001);
+    inet_pton(AF_INET, "127.0.0.1", &server.sin_addr);
+
+    TestInitiator initiator(server, DefaultSessionConfig("client", "server"));
+    initiator.connect();
+    BOOST_TEST(initiator.isConnected());
+    // let the server fill the socket and outbound buffer before reading
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    initiator.handle();
+    t.join();
+
+    BOOST_TEST(acceptor.becameSlow == 1);
+    BOOST_TEST(acceptor.recovered == 1);
+    // the client always receives the latest quote, but not all of them
+    BOOST_TEST(initiator.last == N_QUOTES - 1);
+    BOOST_TEST(initiator.received < N_QUOTES);
+}
+
+BOOST_AUTO_TEST_CASE( sequenced_sessions ) {
+    std::cout << "----- sequenced sessions test\n";
+    struct TestLogic : BusinessLogic {
+        std::atomic<int> loggedOn{0};
+        void onLoggedOn(SessionHandle session, const std::string& sessionId) override { loggedOn++; }
+        void onMessage(SessionHandle session, const FixMessage& msg) override {}
+    };
+    class TestAcceptor : public Acceptor<> {
+    public:
+        TestAcceptor(int port, const DefaultSessionConfig& config) : Acceptor(port, config) {}
+        void onMessage(Session<>& session, const FixMessage& msg) override {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onDisconnected(const Session<>& session) override {
+            Acceptor::onDisconnected(session);
+            shutdown();
+        }
+    };
+    class TestInitiator : public Initiator<> {
+    public:
+        TestInitiator(const Endpoint& server, const DefaultSessionConfig& config) : Initiator(server, config) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onConnected() override {
+            FixBuilder msg;
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+        }
+    };
+
+    // a session whose sends could block the sequencer's thread is terminated on logon
+    for (size_t watermark : {size_t(0), size_t(64 * 1024)}) {
+        TestLogic logic;
+        Sequencer sequencer(logic, 1024);
+        sequencer.start();
+        DefaultSessionConfig config("server", "*");
+        config.outboundHighWatermark = watermark;
+        TestAcceptor acceptor(9001, config);
+        acceptor.addStage(sequencer);
+        auto t = std::thread([&acceptor](){
+            acceptor.listen();
+        });
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        TestInitiator initiator(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("client", "server"));
+        initiator.connect();
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        initiator.disconnect();
+        t.join();
+        sequencer.stop();
+        BOOST_TEST(logic.loggedOn == (watermark ? 1 : 0));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( encoded_message ) {
+    FixBuilder body;
+    body.addField(55, "IBM");
+    body.addField(58, "market open");
+    EncodedMessage encoded("FIX.4.4", "X", body);
+
+    EncodedMessage::SessionHeader header(DefaultSessionConfig("server", "client").headerPrefix());
+    EncodedMessage::Scratch scratch;
+    struct iovec iov[EncodedMessage::IOV_COUNT];
+    int count = encoded.render(header, 123, scratch, iov);
+    std::string rendered;
+    for (int i = 0; i < count; i++) rendered.append(static_cast<char*>(iov[i].iov_base), iov[i].iov_len);
+
+    // BodyLength counts the bytes after the BodyLength field up to the CheckSum field
+    auto bodyStart = rendered.find('\001', rendered.find("9=")) + 1;
+    auto checksumStart = rendered.size() - 7;
+    BOOST_TEST(std::stoi(rendered.substr(rendered.find("9=") + 2)) == int(checksumStart - bodyStart));
+    int sum = EncodedMessage::checksum(std::string_view(rendered).substr(0, checksumStart));
+    BOOST_TEST(std::stoi(rendered.substr(checksumStart + 3)) == sum % 256);
+
+    std::istringstream is(rendered);
+    FixMessage msg;
+    FixMessage::parse(is, msg, GroupDefs());
+    BOOST_TEST(msg.msgType() == "X");
+    BOOST_TEST(msg.seqNum() == 123);
+    BOOST_TEST(msg.getString(Tag::SENDER_COMP_ID) == "server");
+    BOOST_TEST(msg.getString(Tag::TARGET_COMP_ID) == "client");
+    BOOST_TEST(msg.getString(58) == "market open");
+}
+
+// a session config resolving the handler and features at compile time, see SessionPolicies
+class StaticAcceptor;
+struct StaticSessionConfig : DefaultSessionConfig {
+    struct Policies : SessionPolicies {
+        static constexpr bool stages = false;
+        static constexpr bool instrumentation = true;
+    };
+    using Handler = StaticAcceptor;
+    using DefaultSessionConfig::DefaultSessionConfig;
+};
+
+class StaticAcceptor final : public Acceptor<StaticSessionConfig> {
+   public:
+    int orders = 0;
+    uint64_t counted = 0;
+    StaticAcceptor(int port) : Acceptor(port, StaticSessionConfig("server", "*"), 1) {}
+    void onMessage(Session<StaticSessionConfig>& session, const FixMessage& msg) override {
+        if (msg.msgType() != "D") return;
+        counted = session.stats().messages;
+        if (++orders == 10) shutdown();
+    }
+    bool validateLogon(const FixMessage& logon) override { return true; }
+};
+
+BOOST_AUTO_TEST_CASE( static_dispatch ) {
+    std::cout << "----- static dispatch test\n";
+    StaticAcceptor acceptor(9001);
+    auto t = std::thread([&acceptor](){
+        acceptor.listen();
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    class TestInitiator : public Initiator<> {
+    public:
+        TestInitiator(const Endpoint& server, const DefaultSessionConfig& config) : Initiator(server, config) {}
+        bool validateLogon(const FixMessage& logon) override { return true; }
+        void onConnected() override {
+            FixBuilder msg;
+            Logon::build(msg);
+            sendMessage(Logon::msgType, msg);
+            for (int i = 0; i < 10; i++) {
+                msg.addField(11, "order" + std::to_string(i));
+                sendMessage("D", msg);
+            }
+        }
+    };
+    TestInitiator initiator(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("client", "server"));
+    initiator.connect();
+    t.join();
+    initiator.disconnect();
+    BOOST_TEST(acceptor.orders == 10);
+    // the Logon and the 9 orders before the last were counted
+    BOOST_TEST(acceptor.counted == 10u);
+}
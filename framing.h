@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <streambuf>
+#include <string_view>
+
+#include "simd.h"
+
+// Detects complete FIX messages in a buffer of received bytes using the BodyLength (9) field, so a message is only
+// parsed once all of its bytes have arrived and the parser never needs to wait for the socket.
+struct Framing {
+    // the length of the trailer "10=nnn\001"
+    static const size_t CHECKSUM_LENGTH = 7;
+
+    // returns the length of the complete message at the start of the buffer, or 0 if more bytes are needed.
+    // Throws if the bytes are not a FIX message, or as soon as its BodyLength makes it longer than maxLength.
+    static size_t messageLength(const char* p, size_t len, size_t maxLength = SIZE_MAX) {
+        if (len == 0) return 0;
+        if (p[0] != '8' || (len > 1 && p[1] != '=')) throw std::runtime_error("message does not start with BeginString");
+        size_t pos = simd::find(p, len, '\001');
+        if (pos == len) return 0;
+        pos++;
+        if (len < pos + 2) return 0;
+        if (p[pos] != '9' || p[pos + 1] != '=') throw std::runtime_error("BodyLength must be the second field");
+        pos += 2;
+        size_t bodyLength = 0;
+        int digits = 0;
+        for (; pos < len && p[pos] != '\001'; pos++) {
+            if (p[pos] < '0' || p[pos] > '9' || ++digits > 9) throw std::runtime_error("invalid BodyLength");
+            bodyLength = bodyLength * 10 + (p[pos] - '0');
+        }
+        if (pos == len) return 0;
+        if (digits == 0) throw std::runtime_error("invalid BodyLength");
+        auto total = pos + 1 + bodyLength + CHECKSUM_LENGTH;
+        if (total > maxLength) throw std::runtime_error("message too large");
+        if (len < total) return 0;
+        if (memcmp(p + total - CHECKSUM_LENGTH, "10=", 3) != 0 || p[total - 1] != '\001') throw std::runtime_error("BodyLength does not match the message");
+        return total;
+    }
+
+    // the CheckSum (10) value for the bytes preceding the trailer
+    static int checksum(const char* p, size_t len) { return simd::sum(p, len) % 256; }
+
+    // returns true if the CheckSum of the complete message of length total matches its bytes
+    static bool checksumValid(const char* p, size_t total) {
+        if (total < CHECKSUM_LENGTH) return false;
+        return checksumValid(std::string_view(p + total - CHECKSUM_LENGTH + 3, 3), simd::sum(p, total));
+    }
+    // returns true if the CheckSum value of a message matches sum, the sum of all of its bytes including the trailer,
+    // e.g. from Socketbuf::inboundSum() when the bytes were parsed from the stream
+    static bool checksumValid(std::string_view value, uint32_t sum) {
+        if (value.size() != 3) return false;
+        int expected = 0;
+        for (auto c : value) {
+            if (c < '0' || c > '9') return false;
+            expected = expected * 10 + (c - '0');
+            sum -= uint8_t(c);
+        }
+        sum -= '1' + '0' + '=' + '\001';
+        return sum % 256 == uint32_t(expected);
+    }
+};
+
+// a read only streambuf over the bytes of a framed message, for FixMessage::parse()
+struct FrameBuf : std::streambuf {
+    FrameBuf(const char* p, size_t len) {
+        auto begin = const_cast<char*>(p);
+        setg(begin, begin, begin + len);
+    }
+};
@@ -0,0 +1,89 @@
+#define BOOST_TEST_MODULE framing_test
+#include <boost/test/included/unit_test.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "fix_builder.h"
+#include "framing.h"
+
+static std::string encode(const std::string& clOrdId) {
+    FixBuilder msg;
+    msg.addField(8, "FIX.4.4");
+    msg.addField(9, "0000");
+    msg.addField(35, "D");
+    msg.addField(11, clOrdId);
+    std::ostringstream os;
+    msg.writeTo(os);
+    return os.str();
+}
+
+BOOST_AUTO_TEST_CASE( message_length ) {
+    auto msg = encode("order1");
+    auto buffer = msg + encode("order2");
+    BOOST_TEST(Framing::messageLength(buffer.data(), buffer.size()) == msg.size());
+    BOOST_TEST(Framing::messageLength(buffer.data() + msg.size(), buffer.size() - msg.size()) == buffer.size() - msg.size());
+    // every prefix of a message is incomplete
+    for (size_t len = 0; len < msg.size(); len++) {
+        BOOST_TEST(Framing::messageLength(msg.data(), len) == 0u);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( invalid_messages ) {
+    std::string garbage = "35=D\00111=x\001";
+    BOOST_CHECK_THROW(Framing::messageLength(garbage.data(), garbage.size()), std::runtime_error);
+    std::string noLength = "8=FIX.4.4\00135=D\001";
+    BOOST_CHECK_THROW(Framing::messageLength(noLength.data(), noLength.size()), std::runtime_error);
+    // the BodyLength is one short, so the checksum is not where expected
+    auto msg = encode("order1");
+    auto pos = msg.find("\0019=") + 3;
+    msg[pos + 3]--;
+    BOOST_CHECK_THROW(Framing::messageLength(msg.data(), msg.size()), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE( checksum ) {
+    auto msg = encode("order1");
+    BOOST_TEST(Framing::checksumValid(msg.data(), msg.size()));
+    // from the sum of the whole message, as parsed from a stream
+    auto value = std::string_view(msg).substr(msg.size() - 4, 3);
+    BOOST_TEST(Framing::checksumValid(value, simd::sum(msg.data(), msg.size())));
+    BOOST_TEST(!Framing::checksumValid(value, simd::sum(msg.data(), msg.size()) + 1));
+    BOOST_TEST(!Framing::checksumValid(std::string_view("1x3"), 0));
+    msg[msg.find("order1")] = 'O';
+    BOOST_TEST(!Framing::checksumValid(msg.data(), msg.size()));
+}
+
+// every kernel supported by the cpu matches the scalar version for all lengths and alignments
+BOOST_AUTO_TEST_CASE( simd_kernels ) {
+    std::string bytes;
+    for (int i = 0; i < 4200; i++) bytes += char(i * 7 + 200);
+    std::vector<simd::Level> levels = {simd::Level::Scalar};
+#ifdef SIMD_X86
+    levels.push_back(simd::Level::SSE2);
+    if (simd::detect() == simd::Level::AVX2) levels.push_back(simd::Level::AVX2);
+#endif
+    for (auto level : levels) {
+        auto kernels = simd::Kernels::of(level);
+        for (size_t offset = 0; offset < 33; offset++) {
+            for (size_t len : {0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 1000, 4096}) {
+                auto p = bytes.data() + offset;
+                BOOST_TEST(kernels.sum(p, len) == simd::scalar::sum(p, len), simd::name(level) << " sum " << offset << "," << len);
+                BOOST_TEST(kernels.find(p, len, '\001') == simd::scalar::find(p, len, '\001'), simd::name(level) << " find " << offset << "," << len);
+                std::string soh(p, len);
+                if (len) soh[len - 1] = '\001';
+                BOOST_TEST(kernels.find(soh.data(), len, '\001') == simd::scalar::find(soh.data(), len, '\001'));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( max_length ) {
+    auto msg = encode("order1");
+    BOOST_TEST(Framing::messageLength(msg.data(), msg.size(), msg.size()) == msg.size());
+    BOOST_CHECK_THROW(Framing::messageLength(msg.data(), msg.size(), msg.size() - 1), std::runtime_error);
+    // rejected from the BodyLength, before the rest of the message arrives
+    std::string header = "8=FIX.4.4\0019=999999999\001";
+    BOOST_CHECK_THROW(Framing::messageLength(header.data(), header.size(), 1024 * 1024), std::runtime_error);
+    BOOST_TEST(Framing::messageLength(header.data(), header.size()) == 0u);
+}
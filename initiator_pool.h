@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <boost/fiber/all.hpp>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "fix_engine.h"
+#include "poller.h"
+
+// The delay before a reconnect doubles with each failed attempt from initialDelay up to maxDelay, and is reduced by
+// a random fraction of up to jitter, so sessions disconnected together do not reconnect together.
+struct ReconnectPolicy {
+    std::chrono::milliseconds initialDelay{100};
+    std::chrono::milliseconds maxDelay{30000};
+    double jitter = 0.5;
+    std::chrono::milliseconds connectTimeout{5000};
+
+    std::chrono::milliseconds delay(int attempt, std::minstd_rand& random) const {
+        auto delay = initialDelay.count() << std::min(attempt, 20);
+        delay = std::min<long>(delay, maxDelay.count());
+        double fraction = std::uniform_real_distribution<double>(0, jitter)(random);
+        return std::chrono::milliseconds(long(delay * (1 - fraction)));
+    }
+};
+
+// Runs many Initiators on a shared Poller and set of worker threads, with a fiber per initiator. The fiber connects
+// without blocking the thread, runs the session until it disconnects, and reconnects after a delay, see
+// ReconnectPolicy. Initiator::onConnected() is called on each connect, so an initiator sending its Logon there logs
+// on again after a reconnect. The session sequence numbers restart from the initiator's SessionConfig.
+//
+// Only the socket transport is supported. The initiators must remain valid until stop() returns.
+template <class SessionConfig = DefaultSessionConfig>
+class InitiatorPool {
+    const ReconnectPolicy policy;
+    Poller poller;
+    std::thread pollerThread;
+    std::vector<std::thread> workers;
+    // the workers join the shared fiber pool before any fibers start, a member since a worker may still be
+    // returning from wait() when the constructor returns
+    boost::fibers::barrier started;
+    boost::fibers::buffered_channel<Initiator<SessionConfig>*> chan{1024};
+
+    std::mutex lock;
+    std::vector<Initiator<SessionConfig>*> initiators;
+    // the number of initiator fibers still running
+    std::atomic<int> active = 0;
+    std::atomic<bool> stopping = false;
+    // wakes the fibers waiting to reconnect on stop()
+    boost::fibers::mutex stopLock;
+    boost::fibers::condition_variable stopped;
+
+    void manage(Initiator<SessionConfig>* initiator) {
+        std::minstd_rand random(std::random_device{}());
+        int attempt = 0;
+        while (!stopping) {
+            if (initiator->connect(policy.connectTimeout)) {
+                // stop() may have run before the connection was made
+                if (stopping) initiator->disconnect();
+                if (initiator->run()) attempt = 0;
+            }
+            if (stopping) break;
+            auto delay = policy.delay(attempt++, random);
+            std::unique_lock<boost::fibers::mutex> lk(stopLock);
+            stopped.wait_for(lk, delay, [this] { return stopping.load(); });
+        }
+        active--;
+    }
+
+   public:
+    InitiatorPool(int workerThreads = std::max(int(std::thread::hardware_concurrency() / 2), 1), ReconnectPolicy policy = ReconnectPolicy()) : policy(policy), started(workerThreads + 1) {
+        pollerThread = std::thread([this]() {
+            while (true) {
+                try {
+                    poller.poll();
+                } catch (std::runtime_error& err) {
+                    return;
+                }
+            }
+        });
+        for (int i = 0; i < workerThreads; i++) {
+            workers.push_back(std::thread([this] {
+                boost::fibers::use_scheduling_algorithm<boost::fibers::algo::shared_work>(true);
+                started.wait();
+                Initiator<SessionConfig>* initiator;
+                while (chan.pop(initiator) == boost::fibers::channel_op_status::success) {
+                    boost::fibers::fiber([this, initiator] { manage(initiator); }).detach();
+                }
+            }));
+        }
+        started.wait();
+    }
+    ~InitiatorPool() { stop(); }
+
+    // start connecting the initiator, which must have been created without a Poller
+    void add(Initiator<SessionConfig>& initiator) {
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            initiators.push_back(&initiator);
+        }
+        initiator.poller = &poller;
+        active++;
+        chan.push(&initiator);
+    }
+    // disconnect the sessions and wait for the fibers to finish, a connect in progress may take up to the
+    // connect timeout
+    void stop() {
+        if (stopping.exchange(true)) return;
+        {
+            std::lock_guard<boost::fibers::mutex> lk(stopLock);
+        }
+        stopped.notify_all();
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            for (auto initiator : initiators) initiator->disconnect();
+        }
+        while (active > 0) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        chan.close();
+        for (auto& worker : workers) worker.join();
+        poller.close();
+        pollerThread.join();
+    }
+};
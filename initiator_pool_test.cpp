@@ -0,0 +1,108 @@
+#define BOOST_TEST_MODULE initiator_pool_test
+#include <boost/test/included/unit_test.hpp>
+
+#include <atomic>
+#include <csignal>
+#include <chrono>
+#include <thread>
+
+#include "initiator_pool.h"
+#include "msg_logon.h"
+
+class TestAcceptor : public Acceptor<> {
+public:
+    TestAcceptor(int port, const DefaultSessionConfig& config) : Acceptor(port, config) {}
+    void onMessage(Session<>& session, const FixMessage& msg) override {}
+    bool validateLogon(const FixMessage& logon) override { return true; }
+};
+
+class TestInitiator : public Initiator<> {
+public:
+    std::atomic<int> connects = 0, logons = 0;
+    TestInitiator(const Endpoint& server, const DefaultSessionConfig& config) : Initiator(server, config) {}
+    bool validateLogon(const FixMessage& logon) override { return true; }
+    void onConnected() override {
+        connects++;
+        FixBuilder msg;
+        Logon::build(msg);
+        sendMessage(Logon::msgType, msg);
+    }
+    void onLoggedOn(const Session<>& session) override { logons++; }
+};
+
+static bool waitFor(std::atomic<int>& value, int expected) {
+    for (int i = 0; i < 1000 && value < expected; i++) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return value >= expected;
+}
+
+BOOST_AUTO_TEST_CASE( reconnect ) {
+    ReconnectPolicy policy;
+    policy.initialDelay = std::chrono::milliseconds(20);
+    policy.maxDelay = std::chrono::milliseconds(200);
+    InitiatorPool<> pool(1, policy);
+    TestInitiator initiator(Endpoint::resolve("127.0.0.1", 9001), DefaultSessionConfig("client", "server"));
+    // the acceptor is not running, so the connects are refused and retried
+    pool.add(initiator);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    BOOST_TEST(initiator.connects == 0);
+
+    for (int logons = 1; logons <= 2; logons++) {
+        TestAcceptor acceptor(9001, DefaultSessionConfig("server", "*"));
+        auto t = std::thread([&acceptor]() { acceptor.listen(); });
+        BOOST_TEST(waitFor(initiator.logons, logons));
+        // the session is terminated, and the initiator logs on again to the next acceptor
+        acceptor.shutdown();
+        t.join();
+    }
+    BOOST_TEST(initiator.connects == 2);
+    pool.stop();
+}
+
+BOOST_AUTO_TEST_CASE( send_while_reconnecting ) {
+    ReconnectPolicy policy;
+    policy.initialDelay = std::chrono::milliseconds(20);
+    policy.maxDelay = std::chrono::milliseconds(200);
+    InitiatorPool<> pool(1, policy);
+    // the sends never park, so the sender cannot hold up the logon
+    DefaultSessionConfig config("client", "server");
+    config.outboundHighWatermark = 64 * 1024;
+    TestInitiator initiator(Endpoint::resolve("127.0.0.1", 9001), config);
+    pool.add(initiator);
+
+    // a send to the socket closed by the acceptor would otherwise terminate the process
+    signal(SIGPIPE, SIG_IGN);
+    // an application thread sends while the pool releases each disconnected session
+    std::atomic<bool> sending = true;
+    std::atomic<long> sent = 0;
+    auto sender = std::thread([&]() {
+        FixBuilder msg;
+        while (sending) {
+            msg.addField(11, "order");
+            initiator.sendMessage("D", msg);
+            sent++;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+    for (int logons = 1; logons <= 3; logons++) {
+        TestAcceptor acceptor(9001, DefaultSessionConfig("server", "*"));
+        auto t = std::thread([&acceptor]() { acceptor.listen(); });
+        BOOST_TEST(waitFor(initiator.logons, logons));
+        acceptor.shutdown();
+        t.join();
+    }
+    sending = false;
+    sender.join();
+    BOOST_TEST(sent > 0);
+    pool.stop();
+}
+
+BOOST_AUTO_TEST_CASE( backoff ) {
+    ReconnectPolicy policy;
+    std::minstd_rand random(1);
+    for (int attempt = 0; attempt < 30; attempt++) {
+        auto delay = policy.delay(attempt, random);
+        auto max = std::min(policy.initialDelay * (1L << std::min(attempt, 20)), std::chrono::milliseconds(policy.maxDelay));
+        BOOST_TEST(delay <= max);
+        BOOST_TEST(delay >= max / 2);
+    }
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Maps strings, e.g. symbols or frequently repeated ids such as QuoteIDs, to dense integer ids from 0, so per string
+// state can be kept in flat arrays indexed by the id rather than in hash maps keyed by the string. An id is never
+// reused or removed, and the table holds at most capacity strings.
+//
+// Lookups take no lock and may run concurrently with additions, which are serialized by a mutex. The slots are an
+// open addressing table of ids published with release stores after the string is copied to the arena.
+class InternTable {
+    struct Entry {
+        const char* data;
+        uint32_t length;
+        uint32_t hash;
+    };
+    static const size_t ARENA_CHUNK = 64 * 1024;
+
+    const size_t capacity_;
+    const size_t mask;
+    // the id + 1 of the string in each slot, 0 if empty
+    std::unique_ptr<std::atomic<uint32_t>[]> slots;
+    std::unique_ptr<Entry[]> entries;
+    std::atomic<uint32_t> count{0};
+    std::mutex lock;
+    std::vector<std::unique_ptr<char[]>> arena;
+    size_t arenaUsed = 0;
+
+    static uint32_t hashOf(std::string_view s) { return uint32_t(std::hash<std::string_view>()(s)); }
+
+    // the slot holding the string, or the empty slot where it would be added
+    size_t probe(std::string_view s, uint32_t hash, uint32_t& id) const {
+        for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+            id = slots[slot].load(std::memory_order_acquire);
+            if (!id) return slot;
+            auto& entry = entries[id - 1];
+            if (entry.hash == hash && std::string_view(entry.data, entry.length) == s) return slot;
+        }
+    }
+    const char* copy(std::string_view s) {
+        if (s.size() > ARENA_CHUNK) {
+            arena.push_back(std::make_unique<char[]>(s.size()));
+            memcpy(arena.back().get(), s.data(), s.size());
+            return arena.back().get();
+        }
+        if (arena.empty() || arenaUsed + s.size() > ARENA_CHUNK) {
+            arena.push_back(std::make_unique<char[]>(ARENA_CHUNK));
+            arenaUsed = 0;
+        }
+        char* p = arena.back().get() + arenaUsed;
+        memcpy(p, s.data(), s.size());
+        arenaUsed += s.size();
+        return p;
+    }
+
+   public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    // the table size is a power of two of at least twice the capacity, so probes stay short
+    explicit InternTable(size_t capacity = 65536)
+        : capacity_(capacity), mask(std::bit_ceil(capacity * 2) - 1), slots(new std::atomic<uint32_t>[mask + 1]()), entries(new Entry[capacity]) {}
+    InternTable(const InternTable&) = delete;
+    InternTable& operator=(const InternTable&) = delete;
+
+    // the table of instrument symbols shared by the engine and the application, see EngineOptions::symbolFile
+    static InternTable& symbols() {
+        static InternTable table;
+        return table;
+    }
+
+    // the id of the string, or NONE if it has not been added
+    uint32_t find(std::string_view s) const {
+        uint32_t id;
+        probe(s, hashOf(s), id);
+        return id ? id - 1 : NONE;
+    }
+    // the id of the string, adding it if new, or NONE if the table is full
+    uint32_t intern(std::string_view s) {
+        auto hash = hashOf(s);
+        uint32_t id;
+        probe(s, hash, id);
+        if (id) return id - 1;
+        std::lock_guard<std::mutex> mu(lock);
+        // added by another thread since the probe
+        auto slot = probe(s, hash, id);
+        if (id) return id - 1;
+        auto next = count.load(std::memory_order_relaxed);
+        if (next == capacity_) return NONE;
+        entries[next] = Entry{copy(s), uint32_t(s.size()), hash};
+        count.store(next + 1, std::memory_order_release);
+        slots[slot].store(next + 1, std::memory_order_release);
+        return next;
+    }
+    // the string of an id returned by intern() or find()
+    std::string_view name(uint32_t id) const {
+        auto& entry = entries[id];
+        return std::string_view(entry.data, entry.length);
+    }
+    // the number of strings added, the ids are 0 to size() - 1
+    size_t size() const { return count.load(std::memory_order_acquire); }
+    size_t capacity() const { return capacity_; }
+
+    // add the strings in the file, one per line ignoring blank lines, so their ids are assigned in the order of the
+    // file. Returns the number of lines read, or -1 if the file cannot be read or the table is full.
+    long load(const std::string& path) {
+        std::ifstream file(path);
+        if (!file) return -1;
+        long added = 0;
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
+            if (intern(line) == NONE) return -1;
+            added++;
+        }
+        return added;
+    }
+};
@@ -0,0 +1,66 @@
+#define BOOST_TEST_MODULE intern_table_test
+#include <boost/test/included/unit_test.hpp>
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "intern_table.h"
+
+BOOST_AUTO_TEST_CASE( intern_and_lookup ) {
+    InternTable table(16);
+    BOOST_TEST(table.find("IBM") == InternTable::NONE);
+    BOOST_TEST(table.intern("IBM") == 0u);
+    BOOST_TEST(table.intern("AAPL") == 1u);
+    BOOST_TEST(table.intern("") == 2u);
+    BOOST_TEST(table.intern("IBM") == 0u);
+    BOOST_TEST(table.find("AAPL") == 1u);
+    BOOST_TEST(table.name(1) == "AAPL");
+    BOOST_TEST(table.name(2) == "");
+    BOOST_TEST(table.size() == 3u);
+}
+
+BOOST_AUTO_TEST_CASE( capacity ) {
+    InternTable table(4);
+    for (int i = 0; i < 4; i++) BOOST_TEST(table.intern("S" + std::to_string(i)) == uint32_t(i));
+    BOOST_TEST(table.intern("S4") == InternTable::NONE);
+    BOOST_TEST(table.intern("S3") == 3u);
+    // longer than an arena chunk
+    InternTable large(2);
+    std::string big(100000, 'x');
+    BOOST_TEST(large.name(large.intern(big)) == big);
+}
+
+BOOST_AUTO_TEST_CASE( load_file ) {
+    char path[] = "/tmp/intern_table_testXXXXXX";
+    int fd = mkstemp(path);
+    std::string contents = "IBM\nMSFT\r\n\nAAPL\nIBM\n";
+    BOOST_TEST(write(fd, contents.data(), contents.size()) == ssize_t(contents.size()));
+    close(fd);
+    InternTable table;
+    BOOST_TEST(table.load(path) == 4);
+    BOOST_TEST(table.size() == 3u);
+    BOOST_TEST(table.find("MSFT") == 1u);
+    BOOST_TEST(table.find("AAPL") == 2u);
+    unlink(path);
+    BOOST_TEST(table.load(path) == -1);
+}
+
+BOOST_AUTO_TEST_CASE( concurrent_intern ) {
+    InternTable table(10000);
+    std::vector<std::vector<uint32_t>> ids(4);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&table, &ids, t] {
+            for (int i = 0; i < 5000; i++) ids[t].push_back(table.intern("ID" + std::to_string((i * (t + 1)) % 5000)));
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    BOOST_TEST(table.size() == 5000u);
+    for (int t = 0; t < 4; t++) {
+        for (int i = 0; i < 5000; i++) BOOST_TEST(table.name(ids[t][i]) == "ID" + std::to_string((i * (t + 1)) % 5000));
+    }
+}
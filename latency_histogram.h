@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// A histogram of latencies in nanoseconds, recorded from any thread without a lock. Each power of two range is
+// split into 8 linear buckets, so a percentile is within 12.5% of the recorded value.
+class LatencyHistogram {
+    static const int SUB_BITS = 3;
+    static const uint64_t SUB_BUCKETS = 1 << SUB_BITS;
+    static const size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    std::atomic<uint64_t> counts[BUCKETS] = {};
+
+    static size_t indexOf(uint64_t nanos) {
+        if (nanos < SUB_BUCKETS) return nanos;
+        int shift = 63 - __builtin_clzll(nanos) - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + ((nanos >> shift) & (SUB_BUCKETS - 1));
+    }
+    // the lowest value recorded in the bucket
+    static uint64_t lowerBound(size_t index) {
+        if (index < SUB_BUCKETS) return index;
+        int shift = index / SUB_BUCKETS - 1;
+        return (SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+    }
+
+   public:
+    void record(uint64_t nanos, uint64_t count = 1) { counts[indexOf(nanos)].fetch_add(count, std::memory_order_relaxed); }
+
+    uint64_t count() const {
+        uint64_t total = 0;
+        for (auto& count : counts) total += count.load(std::memory_order_relaxed);
+        return total;
+    }
+    // the latency at the percentile (0-100), i.e. the lower bound of its bucket, or 0 if none are recorded
+    uint64_t percentile(double p) const {
+        auto total = count();
+        if (!total) return 0;
+        uint64_t rank = total * p / 100, seen = 0;
+        if (rank >= total) rank = total - 1;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen > rank) return lowerBound(i);
+        }
+        return 0;
+    }
+    void clear() {
+        for (auto& count : counts) count.store(0, std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,30 @@
+#define BOOST_TEST_MODULE latency_histogram_test
+#include <boost/test/included/unit_test.hpp>
+
+#include "latency_histogram.h"
+
+BOOST_AUTO_TEST_CASE( percentiles ) {
+    LatencyHistogram histogram;
+    BOOST_TEST(histogram.percentile(50) == 0);
+    for (uint64_t i = 1; i <= 1000; i++) histogram.record(i * 1000);
+    BOOST_TEST(histogram.count() == 1000);
+    // within the 12.5% bucket width, below the recorded value
+    auto p50 = histogram.percentile(50);
+    BOOST_TEST((p50 <= 501000 && p50 >= 501000 * 7 / 8));
+    auto p99 = histogram.percentile(99);
+    BOOST_TEST((p99 <= 991000 && p99 >= 991000 * 7 / 8));
+    BOOST_TEST(histogram.percentile(100) <= 1000000);
+    histogram.clear();
+    BOOST_TEST(histogram.count() == 0);
+}
+
+BOOST_AUTO_TEST_CASE( exact_small_values ) {
+    LatencyHistogram histogram;
+    for (uint64_t i = 0; i < 16; i++) histogram.record(i, 2);
+    BOOST_TEST(histogram.count() == 32);
+    BOOST_TEST(histogram.percentile(0) == 0);
+    BOOST_TEST(histogram.percentile(50) == 8);
+    BOOST_TEST(histogram.percentile(100) == 15);
+    histogram.record(~uint64_t(0));
+    BOOST_TEST(histogram.percentile(100) >= (uint64_t(1) << 63));
+}
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// An errno value logged as its description, captured when constructed, e.g. Logger::error("connect failed: {}", Errno())
+struct Errno {
+    int value = errno;
+};
+
+// Asynchronous logging. A call records the format and the raw argument values in a ring owned by the calling thread,
+// without a lock or a system call unless it wakes the idle writer, and a background thread formats the records and writes them to stdout (info) or
+// stderr (error). The format must be a string literal, its address identifies the format, and each {} in it is
+// replaced by the next argument. Strings are copied and truncated to fit a record. If a thread's ring is full the
+// record is dropped and the number dropped is reported later.
+class Logger {
+   public:
+    enum Level : uint8_t { INFO,
+                           ERROR };
+
+   private:
+    static const size_t RECORD_SIZE = 256;
+    static const size_t RING_SIZE = 256;
+
+    enum Type : uint8_t { INT,
+                          UINT,
+                          DOUBLE,
+                          STRING,
+                          ERRNO };
+
+    struct Record {
+        const char* format;
+        Level level;
+        uint16_t size;
+        char args[RECORD_SIZE - sizeof(const char*) - 4];
+    };
+
+    // single producer, single consumer
+    struct Ring {
+        alignas(64) std::atomic<uint64_t> head{0};
+        alignas(64) std::atomic<uint64_t> tail{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> closed{false};
+        Record records[RING_SIZE];
+    };
+
+    // the calling thread's ring, closed when the thread exits so the writer releases it once drained
+    struct Producer {
+        std::shared_ptr<Ring> ring;
+        Producer(Logger& logger) : ring(std::make_shared<Ring>()) {
+            std::lock_guard<std::mutex> mu(logger.lock);
+            logger.rings.push_back(ring);
+        }
+        ~Producer() { ring->closed = true; }
+    };
+
+    // appends the encoded arguments to a record, truncating those which do not fit
+    struct Encoder {
+        char* p;
+        char* end;
+
+        void put(Type type, const void* value, size_t len) {
+            if (p + 1 + len > end) {
+                p = end;
+                return;
+            }
+            *p++ = type;
+            memcpy(p, value, len);
+            p += len;
+        }
+        void putString(std::string_view s) {
+            if (p + 3 > end) {
+                p = end;
+                return;
+            }
+            uint16_t len = std::min<size_t>(s.size(), end - p - 3);
+            *p++ = STRING;
+            memcpy(p, &len, 2);
+            memcpy(p + 2, s.data(), len);
+            p += 2 + len;
+        }
+        template <class T>
+        void add(const T& value) {
+            if constexpr (std::is_same_v<T, Errno>) {
+                put(ERRNO, &value.value, sizeof(int));
+            } else if constexpr (std::is_same_v<T, bool>) {
+                putString(value ? "true" : "false");
+            } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+                int64_t v = value;
+                put(INT, &v, sizeof(v));
+            } else if constexpr (std::is_integral_v<T>) {
+                uint64_t v = value;
+                put(UINT, &v, sizeof(v));
+            } else if constexpr (std::is_floating_point_v<T>) {
+                double v = value;
+                put(DOUBLE, &v, sizeof(v));
+            } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+                putString(value);
+            } else {
+                // other types are formatted by the caller, used off the hot path e.g. for a session config
+                std::ostringstream os;
+                os << value;
+                putString(os.str());
+            }
+        }
+    };
+
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::vector<std::shared_ptr<Ring>> rings;
+    // incremented by flush(), the writer sets flushed once it has drained the rings
+    uint64_t flushRequested = 0, flushed = 0;
+    std::condition_variable flushDone;
+    std::atomic<bool> stopped{false};
+    // set by the writer while it waits for records, see run()
+    std::atomic<bool> idle{false};
+    std::thread writer;
+
+    Logger() : writer(&Logger::run, this) {}
+
+    static void append(std::string& out, const Record& record) {
+        const char* p = record.args;
+        const char* end = record.args + record.size;
+        for (const char* f = record.format; *f; f++) {
+            if (f[0] != '{' || f[1] != '}' || p >= end) {
+                out += *f;
+                continue;
+            }
+            f++;
+            Type type = Type(*p++);
+            char buf[32];
+            switch (type) {
+                case INT: {
+                    int64_t v;
+                    memcpy(&v, p, sizeof(v));
+                    p += sizeof(v);
+                    out.append(buf, snprintf(buf, sizeof(buf), "%lld", (long long)v));
+                    break;
+                }
+                case UINT: {
+                    uint64_t v;
+                    memcpy(&v, p, sizeof(v));
+                    p += sizeof(v);
+                    out.append(buf, snprintf(buf, sizeof(buf), "%llu", (unsigned long long)v));
+                    break;
+                }
+                case DOUBLE: {
+                    double v;
+                    memcpy(&v, p, sizeof(v));
+                    p += sizeof(v);
+                    out.append(buf, snprintf(buf, sizeof(buf), "%g", v));
+                    break;
+                }
+                case STRING: {
+                    uint16_t len;
+                    memcpy(&len, p, 2);
+                    out.append(p + 2, len);
+                    p += 2 + len;
+                    break;
+                }
+                case ERRNO: {
+                    int v;
+                    memcpy(&v, p, sizeof(v));
+                    p += sizeof(v);
+                    out += strerror(v);
+                    break;
+                }
+            }
+        }
+        out += '\n';
+    }
+
+    static void writeAll(int fd, const std::string& s) {
+        size_t written = 0;
+        while (written < s.size()) {
+            auto n = ::write(fd, s.data() + written, s.size() - written);
+            if (n <= 0 && errno != EINTR) return;
+            if (n > 0) written += n;
+        }
+    }
+
+    // format and write the pending records, returns the number written
+    size_t drain() {
+        std::vector<std::shared_ptr<Ring>> current;
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            // release the rings of exited threads once empty
+            std::erase_if(rings, [](auto& ring) { return ring->closed && ring->head.load() == ring->tail.load(); });
+            current = rings;
+        }
+        std::string out[2];
+        size_t count = 0;
+        for (auto& ring : current) {
+            auto tail = ring->tail.load(std::memory_order_relaxed);
+            auto head = ring->head.load(std::memory_order_acquire);
+            for (; tail != head; tail++, count++) {
+                auto& record = ring->records[tail % RING_SIZE];
+                append(out[record.level], record);
+            }
+            ring->tail.store(tail, std::memory_order_release);
+            if (auto dropped = ring->dropped.exchange(0)) {
+                out[ERROR] += "logger dropped " + std::to_string(dropped) + " messages\n";
+            }
+        }
+        writeAll(STDOUT_FILENO, out[INFO]);
+        writeAll(STDERR_FILENO, out[ERROR]);
+        return count;
+    }
+
+    void run() {
+        while (true) {
+            uint64_t requested;
+            {
+                std::lock_guard<std::mutex> mu(lock);
+                requested = flushRequested;
+            }
+            if (drain()) continue;
+            std::unique_lock<std::mutex> lk(lock);
+            flushed = requested;
+            flushDone.notify_all();
+            if (stopped) return;
+            // the first record logged while idle wakes the writer, see log(), and the rings are checked again after
+            // setting the flag. A record published as the flag is set may still miss it, so the wait is bounded.
+            idle.store(true);
+            if (std::any_of(rings.begin(), rings.end(), [](auto& ring) { return ring->head.load() != ring->tail.load(); })) {
+                idle.store(false);
+                continue;
+            }
+            wakeup.wait_for(lk, std::chrono::milliseconds(100), [this] { return stopped || flushRequested != flushed || !idle; });
+            idle.store(false);
+        }
+    }
+
+    Ring& threadRing() {
+        thread_local Producer producer(*this);
+        return *producer.ring;
+    }
+
+    template <class... Args>
+    void log(Level level, const char* format, const Args&... args) {
+        if (stopped) {
+            // after exit() began, write synchronously
+            Record record;
+            encode(record, level, format, args...);
+            std::string out;
+            append(out, record);
+            writeAll(level == INFO ? STDOUT_FILENO : STDERR_FILENO, out);
+            return;
+        }
+        auto& ring = threadRing();
+        auto head = ring.head.load(std::memory_order_relaxed);
+        if (head - ring.tail.load(std::memory_order_acquire) == RING_SIZE) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        encode(ring.records[head % RING_SIZE], level, format, args...);
+        ring.head.store(head + 1, std::memory_order_release);
+        // only the first producer to see the writer idle takes the lock
+        if (idle.load(std::memory_order_relaxed) && idle.exchange(false)) {
+            std::lock_guard<std::mutex> mu(lock);
+            wakeup.notify_one();
+        }
+    }
+
+    template <class... Args>
+    static void encode(Record& record, Level level, const char* format, const Args&... args) {
+        Encoder encoder{record.args, record.args + sizeof(record.args)};
+        (encoder.add(args), ...);
+        record.format = format;
+        record.level = level;
+        record.size = encoder.p - record.args;
+    }
+
+   public:
+    // never destroyed, since threads may log during exit; the writer is stopped by exit() after draining
+    static Logger& instance() {
+        static Logger* logger = [] {
+            auto logger = new Logger();
+            std::atexit([] { instance().stop(); });
+            return logger;
+        }();
+        return *logger;
+    }
+
+    template <class... Args>
+    static void info(const char* format, const Args&... args) { instance().log(INFO, format, args...); }
+    template <class... Args>
+    static void error(const char* format, const Args&... args) { instance().log(ERROR, format, args...); }
+
+    // wait until the records logged before the call are written
+    void flush() {
+        std::unique_lock<std::mutex> lk(lock);
+        if (stopped) return;
+        auto requested = ++flushRequested;
+        wakeup.notify_one();
+        flushDone.wait(lk, [&] { return flushed >= requested || stopped; });
+    }
+    // write the pending records and stop the writer, later records are written synchronously
+    void stop() {
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            if (stopped) return;
+            stopped = true;
+        }
+        wakeup.notify_one();
+        writer.join();
+        drain();
+    }
+};
@@ -0,0 +1,102 @@
+#define BOOST_TEST_MODULE logger_test
+#include <boost/test/included/unit_test.hpp>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+
+// the output written by the logger to stderr while running fn
+template <class Fn>
+static std::string captureErrors(Fn fn) {
+    Logger::instance().flush();
+    FILE* file = tmpfile();
+    int saved = dup(STDERR_FILENO);
+    dup2(fileno(file), STDERR_FILENO);
+    fn();
+    Logger::instance().flush();
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+    std::string out;
+    rewind(file);
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) out.append(buf, n);
+    fclose(file);
+    return out;
+}
+
+BOOST_AUTO_TEST_CASE( format ) {
+    auto out = captureErrors([] {
+        errno = ENOENT;
+        Logger::error("int {} uint {} double {} string {} {} bool {} errno {}", -42, 7u, 1.5, "abc", std::string("def"), true, Errno());
+        Logger::error("missing {} {}", 1);
+        Logger::error("no arguments");
+    });
+    BOOST_TEST(out == "int -42 uint 7 double 1.5 string abc def bool true errno " + std::string(strerror(ENOENT)) + "\nmissing 1 {}\nno arguments\n");
+}
+
+BOOST_AUTO_TEST_CASE( truncated_string ) {
+    auto out = captureErrors([] { Logger::error("{}", std::string(1000, 'x')); });
+    BOOST_TEST(out.size() > 200u);
+    BOOST_TEST(out.size() < 256u);
+    BOOST_TEST(out.find_first_not_of('x') == out.size() - 1);
+}
+
+// each thread's records are written in order, and a record which does not fit in a full ring is counted as dropped
+BOOST_AUTO_TEST_CASE( threads_and_drops ) {
+    const int threads = 4, count = 5000;
+    auto out = captureErrors([] {
+        std::vector<std::thread> producers;
+        for (int t = 0; t < threads; t++) {
+            producers.emplace_back([t] {
+                for (int i = 0; i < count; i++) Logger::error("thread {} message {}", t, i);
+            });
+        }
+        for (auto& producer : producers) producer.join();
+    });
+    std::istringstream is(out);
+    std::string line;
+    std::vector<int> last(threads, -1);
+    long written = 0, dropped = 0;
+    while (std::getline(is, line)) {
+        int t, i;
+        long n;
+        if (sscanf(line.c_str(), "thread %d message %d", &t, &i) == 2) {
+            BOOST_REQUIRE(i > last[t]);
+            last[t] = i;
+            written++;
+        } else if (sscanf(line.c_str(), "logger dropped %ld messages", &n) == 1) {
+            dropped += n;
+        } else {
+            BOOST_FAIL("unexpected line " + line);
+        }
+    }
+    BOOST_TEST(written + dropped == threads * count);
+}
+
+// the idle writer waits without polling, and is woken by the next record rather than its timeout
+BOOST_AUTO_TEST_CASE( idle_wakeup ) {
+    auto out = captureErrors([] {
+        struct stat st = {};
+        for (int i = 0; i < 5; i++) {
+            fstat(STDERR_FILENO, &st);
+            auto size = st.st_size;
+            std::this_thread::sleep_for(std::chrono::milliseconds(30));
+            auto start = std::chrono::steady_clock::now();
+            Logger::error("after idle");
+            while (st.st_size == size && std::chrono::steady_clock::now() - start < std::chrono::milliseconds(20)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                fstat(STDERR_FILENO, &st);
+            }
+            BOOST_TEST(st.st_size > size);
+        }
+    });
+    BOOST_TEST(out.size() == 5 * std::string("after idle\n").size());
+}
@@ -1,3 +1,5 @@
+#pragma once
+
 #include "fix_builder.h"
 #include "fixed.h"
 
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <string>
 #include "fix_builder.h"
 #include "fixed.h"
@@ -73,7 +75,7 @@ struct OrderCancelReject {
 };
 
 struct ExecutionReport {
-    constexpr const static char * msgType = "b";
+    constexpr const static char * msgType = "8";
     template <int nPlaces=7> static void build(FixBuilder& fix,const std::string_view& orderId,const std::string_view& symbol, const OrderSide& side, Fixed<nPlaces> lastPrice,Fixed<nPlaces> lastQty,Fixed<nPlaces> cumQty,Fixed<nPlaces> avgPrice, Fixed<nPlaces> remaining,const long exchangeId,const ExecType& execType,const long execId,const OrderStatus& status) {
         fix.addField(37,exchangeId);
         fix.addField(11,orderId);
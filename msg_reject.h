@@ -1,9 +1,30 @@
+#pragma once
+
 #include "fix_builder.h"
 
-struct Logout {
+struct Reject {
     constexpr const static char * msgType = "3";
     static void build(FixBuilder& fix,int refSeqNum,std::string text) {
         fix.addField(45,refSeqNum);
         fix.addField(58,text);
     }
-};
\ No newline at end of file
+};
+
+enum class BusinessRejectReason {
+    Other=0,
+    UnknownId=1,
+    UnknownSecurity=2,
+    UnsupportedMessageType=3,
+    NotAuthorized=6
+};
+
+struct BusinessMessageReject {
+    constexpr const static char * msgType = "j";
+    static void build(FixBuilder& fix,int refSeqNum,const std::string_view& refMsgType,const std::string_view& refId,BusinessRejectReason reason,const std::string_view& text) {
+        fix.addField(45,refSeqNum);
+        fix.addField(372,refMsgType);
+        fix.addField(379,refId);
+        fix.addField(380,int(reason));
+        fix.addField(58,text);
+    }
+};
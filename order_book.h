@@ -0,0 +1,388 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "msg_orders.h"
+
+// A limit order book for a single symbol with price-time priority. Prices are mapped to integer ticks on a
+// fixed grid, and the price levels are arrays indexed by tick, allocated in pages on first use. Orders are
+// nodes in a pool, linked into the FIFO of their level by index, and the exchange id of an order encodes its
+// pool index so a cancel finds the order in O(1).
+//
+// A quote is a bid and offer which replaces the previous bid and offer of the quote, which the caller tracks
+// using QuoteOrders, see SessionQuotes.
+//
+// The book is not thread safe. Matching appends Executions to a vector rather than calling back, so that the
+// caller can send the reports after releasing any lock held on the book.
+class OrderBook {
+   public:
+    // prices are in units of 1e-7, the same as Fixed<7>
+    typedef int64_t Units;
+    static const Units SCALE = 10000000;
+
+    struct Execution {
+        std::string owner;
+        std::string orderId;
+        long exchangeId = 0;
+        long execId = 0;
+        OrderSide side = OrderSide::Buy;
+        ExecType execType = ExecType::New;
+        OrderStatus status = OrderStatus::New;
+        Units lastPrice = 0;
+        int64_t lastQty = 0;
+        int64_t cumQty = 0;
+        Units avgPrice = 0;
+        int64_t remaining = 0;
+        // true if the execution is for a mass quote, then the orderId is the quote entry id
+        bool quote = false;
+        // the reason for a reject
+        const char* text = "";
+        // the userData of the order
+        void* userData = nullptr;
+    };
+
+    // the exchange ids of the resting orders of a quote, 0 if none
+    struct QuoteOrders {
+        long bid = 0;
+        long ask = 0;
+    };
+
+   private:
+    static const uint32_t NIL = UINT32_MAX;
+    static const int PAGE_BITS = 10;
+    static const int PAGE_SIZE = 1 << PAGE_BITS;
+
+    struct Order {
+        uint32_t prev = NIL;
+        uint32_t next = NIL;
+        int32_t tick = 0;
+        OrderSide side = OrderSide::Buy;
+        bool live = false;
+        bool quote = false;
+        long exchangeId = 0;
+        int64_t quantity = 0;
+        int64_t remaining = 0;
+        // sum of price * quantity of the fills, for the average price
+        Units filledValue = 0;
+        std::string owner;
+        std::string orderId;
+        void* userData = nullptr;
+    };
+    struct Level {
+        uint32_t head = NIL;
+        uint32_t tail = NIL;
+    };
+
+    const Units minPrice;
+    const Units tickSize;
+    const int32_t nLevels;
+    std::vector<std::unique_ptr<Level[]>> pages;
+    std::vector<Order> orders;
+    std::vector<uint32_t> freeList;
+    // no bids below bestBid+1 and no offers below bestAsk, bestBid < bestAsk
+    int32_t bestBid = -1;
+    int32_t bestAsk;
+    uint32_t sequence = 0;
+    long execId = 0;
+
+    Level& level(int32_t tick) {
+        auto& page = pages[tick >> PAGE_BITS];
+        if (!page) page.reset(new Level[PAGE_SIZE]);
+        return page[tick & (PAGE_SIZE - 1)];
+    }
+    bool isEmpty(int32_t tick) const {
+        auto& page = pages[tick >> PAGE_BITS];
+        return !page || page[tick & (PAGE_SIZE - 1)].head == NIL;
+    }
+    // the lowest non-empty level at or above tick, or nLevels, skipping unallocated pages
+    int32_t scanUp(int32_t tick) const {
+        while (tick < nLevels) {
+            if (!pages[tick >> PAGE_BITS]) {
+                tick = (tick | (PAGE_SIZE - 1)) + 1;
+            } else if (isEmpty(tick)) {
+                tick++;
+            } else {
+                return tick;
+            }
+        }
+        return nLevels;
+    }
+    // the highest non-empty level at or below tick, or -1
+    int32_t scanDown(int32_t tick) const {
+        while (tick >= 0) {
+            if (!pages[tick >> PAGE_BITS]) {
+                tick = (tick & ~(PAGE_SIZE - 1)) - 1;
+            } else if (isEmpty(tick)) {
+                tick--;
+            } else {
+                return tick;
+            }
+        }
+        return -1;
+    }
+
+    uint32_t allocate(std::string_view owner, std::string_view orderId, OrderSide side, int32_t tick, int64_t quantity, bool quote) {
+        uint32_t index;
+        if (freeList.empty()) {
+            index = orders.size();
+            orders.emplace_back();
+        } else {
+            index = freeList.back();
+            freeList.pop_back();
+        }
+        auto& order = orders[index];
+        order.prev = order.next = NIL;
+        order.tick = tick;
+        order.side = side;
+        order.live = true;
+        order.quote = quote;
+        order.exchangeId = (long(++sequence) << 32) | index;
+        order.quantity = order.remaining = quantity;
+        order.filledValue = 0;
+        // assign rather than construct so the pooled node reuses the string capacity
+        order.owner.assign(owner);
+        order.orderId.assign(orderId);
+        order.userData = nullptr;
+        return index;
+    }
+    void release(uint32_t index) {
+        orders[index].live = false;
+        freeList.push_back(index);
+    }
+
+    void rest(uint32_t index) {
+        auto& order = orders[index];
+        auto& l = level(order.tick);
+        order.prev = l.tail;
+        order.next = NIL;
+        if (l.tail == NIL) l.head = index; else orders[l.tail].next = index;
+        l.tail = index;
+        if (order.side == OrderSide::Buy) {
+            if (order.tick > bestBid) bestBid = order.tick;
+        } else {
+            if (order.tick < bestAsk) bestAsk = order.tick;
+        }
+    }
+    void unlink(uint32_t index) {
+        auto& order = orders[index];
+        auto& l = level(order.tick);
+        if (order.prev == NIL) l.head = order.next; else orders[order.prev].next = order.next;
+        if (order.next == NIL) l.tail = order.prev; else orders[order.next].prev = order.prev;
+        if (l.head != NIL) return;
+        if (order.tick == bestBid) bestBid = scanDown(bestBid - 1);
+        if (order.tick == bestAsk) bestAsk = scanUp(bestAsk + 1);
+    }
+
+    Execution& report(std::vector<Execution>& out, const Order& order, ExecType execType, OrderStatus status) {
+        auto& e = out.emplace_back();
+        e.owner = order.owner;
+        e.orderId = order.orderId;
+        e.exchangeId = order.exchangeId;
+        e.execId = ++execId;
+        e.side = order.side;
+        e.execType = execType;
+        e.status = status;
+        e.cumQty = order.quantity - order.remaining;
+        e.avgPrice = e.cumQty ? order.filledValue / e.cumQty : 0;
+        e.remaining = order.remaining;
+        e.quote = order.quote;
+        e.userData = order.userData;
+        return e;
+    }
+    void fill(std::vector<Execution>& out, Order& order, int32_t tick, int64_t quantity) {
+        order.remaining -= quantity;
+        order.filledValue += priceOf(tick) * quantity;
+        bool filled = order.remaining == 0;
+        auto& e = report(out, order, filled ? ExecType::Filled : ExecType::PartiallyFilled, filled ? OrderStatus::Filled : OrderStatus::PartiallyFilled);
+        e.lastPrice = priceOf(tick);
+        e.lastQty = quantity;
+    }
+
+    // match the order against the opposite side of the book, at the price of the resting orders
+    void match(uint32_t index, std::vector<Execution>& out) {
+        bool buy = orders[index].side == OrderSide::Buy;
+        while (orders[index].remaining > 0) {
+            int32_t tick = buy ? bestAsk : bestBid;
+            if (buy ? tick > orders[index].tick : tick < orders[index].tick) return;
+            auto& l = level(tick);
+            while (l.head != NIL && orders[index].remaining > 0) {
+                auto restingIndex = l.head;
+                auto& resting = orders[restingIndex];
+                auto quantity = std::min(resting.remaining, orders[index].remaining);
+                fill(out, resting, tick, quantity);
+                fill(out, orders[index], tick, quantity);
+                if (resting.remaining == 0) {
+                    unlink(restingIndex);
+                    release(restingIndex);
+                }
+            }
+        }
+    }
+
+    // the pool index of the live order with the exchange id, or NIL
+    uint32_t find(long exchangeId) const {
+        auto index = uint32_t(exchangeId & 0xFFFFFFFF);
+        if (exchangeId == 0 || index >= orders.size() || !orders[index].live || orders[index].exchangeId != exchangeId) return NIL;
+        return index;
+    }
+    void remove(long exchangeId) {
+        auto index = find(exchangeId);
+        if (index == NIL) return;
+        unlink(index);
+        release(index);
+    }
+
+    // enter an order, returns true if it rests in the book
+    bool enter(uint32_t index, bool market, std::vector<Execution>& out) {
+        match(index, out);
+        auto& order = orders[index];
+        if (order.remaining == 0) {
+            release(index);
+            return false;
+        }
+        if (market) {
+            // the unfilled quantity of a market order is canceled
+            report(out, order, ExecType::Canceled, OrderStatus::Canceled);
+            release(index);
+            return false;
+        }
+        rest(index);
+        return true;
+    }
+
+   public:
+    // the book covers prices from minPrice to minPrice + (levels-1) * tickSize
+    OrderBook(Units minPrice = 0, Units tickSize = SCALE / 100, int32_t levels = 1000000)
+        : minPrice(minPrice), tickSize(tickSize), nLevels(levels), pages((levels + PAGE_SIZE - 1) / PAGE_SIZE), bestAsk(levels) {}
+    OrderBook(const OrderBook&) = delete;
+    OrderBook& operator=(const OrderBook&) = delete;
+
+    // parse a decimal price or quantity, returns false if it is not a valid non-negative number with at most 7 places,
+    // or does not fit in Units
+    static bool parse(std::string_view s, Units& units) {
+        if (s.empty()) return false;
+        units = 0;
+        Units scale = 0;
+        for (auto c : s) {
+            if (c == '.' && scale == 0) {
+                scale = SCALE;
+            } else if (c >= '0' && c <= '9') {
+                if (scale != 0 && (scale /= 10) == 0) return false;
+                if (__builtin_mul_overflow(units, 10, &units) || __builtin_add_overflow(units, c - '0', &units)) return false;
+            } else {
+                return false;
+            }
+        }
+        // scale is the multiplier remaining for the number of places parsed
+        return !__builtin_mul_overflow(units, scale == 0 ? SCALE : scale, &units);
+    }
+    // the tick for the price, returns false if the price is not on the grid
+    bool toTick(Units price, int32_t& tick) const {
+        if (price < minPrice || (price - minPrice) % tickSize != 0) return false;
+        auto t = (price - minPrice) / tickSize;
+        if (t >= nLevels) return false;
+        tick = int32_t(t);
+        return true;
+    }
+    Units priceOf(int32_t tick) const { return minPrice + tick * tickSize; }
+
+    // enter a new order. The executions are a New (or Rejected) for the order, followed by the fills of the order and
+    // the resting orders it matched, and a Canceled for any unfilled quantity of a market order. The userData is
+    // returned in the order's executions, e.g. the account it was checked against, see PreTradeRisk::onExecution().
+    void newOrder(std::string_view owner, std::string_view orderId, OrderSide side, OrderType type, Units price, int64_t quantity, std::vector<Execution>& out,
+                  void* userData = nullptr) {
+        bool market = type == OrderType::Market;
+        int32_t tick = side == OrderSide::Buy ? nLevels - 1 : 0;
+        if (quantity <= 0 || (!market && !toTick(price, tick))) {
+            Order rejected;
+            rejected.owner = owner;
+            rejected.orderId = orderId;
+            rejected.side = side;
+            rejected.userData = userData;
+            report(out, rejected, ExecType::Rejected, OrderStatus::Rejected).text = quantity <= 0 ? "invalid quantity" : "invalid price";
+            return;
+        }
+        auto index = allocate(owner, orderId, side, tick, quantity, false);
+        orders[index].userData = userData;
+        report(out, orders[index], ExecType::New, OrderStatus::New);
+        enter(index, market, out);
+    }
+
+    // cancel a resting order of the owner, returns false if the order is not found (e.g. already filled)
+    bool cancel(std::string_view owner, long exchangeId, std::vector<Execution>& out) {
+        auto index = find(exchangeId);
+        if (index == NIL) return false;
+        auto& order = orders[index];
+        if (order.quote || order.owner != owner) return false;
+        unlink(index);
+        report(out, order, ExecType::Canceled, OrderStatus::Canceled);
+        release(index);
+        return true;
+    }
+
+    // replace the quote's resting orders, a side with a zero quantity is not quoted. The new quote may trade, and only
+    // these fills are reported, with the userData. Returns false if the quote is invalid, in which case the previous
+    // quote is removed.
+    bool quote(std::string_view owner, std::string_view quoteEntryId, QuoteOrders& quote, Units bidPrice, int64_t bidQty, Units askPrice, int64_t askQty, std::vector<Execution>& out,
+               void* userData = nullptr) {
+        cancelQuote(quote);
+
+        int32_t bidTick = -1, askTick = nLevels;
+        if ((bidQty > 0 && !toTick(bidPrice, bidTick)) || (askQty > 0 && !toTick(askPrice, askTick)) || bidQty < 0 || askQty < 0) return false;
+        // a crossed quote would trade with itself
+        if (bidQty > 0 && askQty > 0 && bidTick >= askTick) return false;
+
+        if (bidQty > 0) {
+            auto index = allocate(owner, quoteEntryId, OrderSide::Buy, bidTick, bidQty, true);
+            orders[index].userData = userData;
+            auto exchangeId = orders[index].exchangeId;
+            if (enter(index, false, out)) quote.bid = exchangeId;
+        }
+        if (askQty > 0) {
+            auto index = allocate(owner, quoteEntryId, OrderSide::Sell, askTick, askQty, true);
+            orders[index].userData = userData;
+            auto exchangeId = orders[index].exchangeId;
+            if (enter(index, false, out)) quote.ask = exchangeId;
+        }
+        return true;
+    }
+    // remove the quote's resting orders, if they have not traded
+    void cancelQuote(QuoteOrders& quote) {
+        remove(quote.bid);
+        remove(quote.ask);
+        quote = QuoteOrders();
+    }
+
+    // remove all orders and quotes of the owner, e.g. when the owner disconnects. The Canceled executions are not
+    // sent, but are appended to canceled if given so the caller can release what the orders held.
+    void cancelAll(std::string_view owner, std::vector<Execution>* canceled = nullptr) {
+        for (uint32_t index = 0; index < orders.size(); index++) {
+            if (orders[index].live && orders[index].owner == owner) {
+                unlink(index);
+                if (canceled) report(*canceled, orders[index], ExecType::Canceled, OrderStatus::Canceled);
+                release(index);
+            }
+        }
+    }
+
+    // the best bid and offer prices, or 0 if that side of the book is empty
+    Units bid() const { return bestBid < 0 ? 0 : priceOf(bestBid); }
+    Units ask() const { return bestAsk >= nLevels ? 0 : priceOf(bestAsk); }
+    // the total quantity resting at the price on the given side
+    int64_t quantityAt(OrderSide side, Units price) const {
+        int32_t tick;
+        if (!toTick(price, tick) || isEmpty(tick)) return 0;
+        int64_t quantity = 0;
+        for (auto index = pages[tick >> PAGE_BITS][tick & (PAGE_SIZE - 1)].head; index != NIL; index = orders[index].next) {
+            if (orders[index].side == side) quantity += orders[index].remaining;
+        }
+        return quantity;
+    }
+    // the number of resting orders and quotes
+    size_t size() const { return orders.size() - freeList.size(); }
+};
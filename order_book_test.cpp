@@ -0,0 +1,167 @@
+#include <limits>
+#define BOOST_TEST_MODULE order_book_test
+#include <boost/test/included/unit_test.hpp>
+
+#include "order_book.h"
+#include "quote_book.h"
+
+static const OrderBook::Units P100 = 100 * OrderBook::SCALE;
+static const OrderBook::Units P101 = 101 * OrderBook::SCALE;
+static const OrderBook::Units P99 = 99 * OrderBook::SCALE;
+
+BOOST_AUTO_TEST_CASE( parse ) {
+    OrderBook::Units units;
+    BOOST_TEST(OrderBook::parse("100", units));
+    BOOST_TEST(units == P100);
+    BOOST_TEST(OrderBook::parse("100.25", units));
+    BOOST_TEST(units == 1002500000);
+    BOOST_TEST(OrderBook::parse("0.0000001", units));
+    BOOST_TEST(units == 1);
+    BOOST_TEST(!OrderBook::parse("0.00000001", units));
+    BOOST_TEST(!OrderBook::parse("-1", units));
+    BOOST_TEST(!OrderBook::parse("", units));
+    // too large for Units, in the digits or once scaled
+    BOOST_TEST(OrderBook::parse("922337203685.4775807", units));
+    BOOST_TEST(units == std::numeric_limits<OrderBook::Units>::max());
+    BOOST_TEST(!OrderBook::parse("922337203685.4775808", units));
+    BOOST_TEST(!OrderBook::parse("922337203686", units));
+    BOOST_TEST(!OrderBook::parse("99999999999999999999", units));
+
+    OrderBook book;
+    int32_t tick = 0;
+    BOOST_TEST(book.toTick(1002500000, tick));
+    BOOST_TEST(book.priceOf(tick) == 1002500000);
+    BOOST_TEST(!book.toTick(1002510000, tick));
+}
+
+BOOST_AUTO_TEST_CASE( price_time_priority ) {
+    OrderBook book;
+    std::vector<OrderBook::Execution> out;
+    book.newOrder("A", "a1", OrderSide::Sell, OrderType::Limit, P101, 10, out);
+    book.newOrder("B", "b1", OrderSide::Sell, OrderType::Limit, P100, 10, out);
+    book.newOrder("C", "c1", OrderSide::Sell, OrderType::Limit, P100, 10, out);
+    book.newOrder("D", "d1", OrderSide::Buy, OrderType::Limit, P99, 10, out);
+    BOOST_TEST(out.size() == 4);
+    BOOST_TEST(book.bid() == P99);
+    BOOST_TEST(book.ask() == P100);
+    out.clear();
+
+    // fills B then part of C at 100, and does not reach A at 101
+    book.newOrder("E", "e1", OrderSide::Buy, OrderType::Limit, P100, 15, out);
+    BOOST_TEST(out.size() == 5);
+    BOOST_TEST(out[0].owner == "E");
+    BOOST_TEST(int(out[0].execType) == int(ExecType::New));
+    BOOST_TEST(out[1].owner == "B");
+    BOOST_TEST(int(out[1].status) == int(OrderStatus::Filled));
+    BOOST_TEST(out[3].owner == "C");
+    BOOST_TEST(out[3].lastQty == 5);
+    BOOST_TEST(int(out[3].status) == int(OrderStatus::PartiallyFilled));
+    BOOST_TEST(out[4].owner == "E");
+    BOOST_TEST(out[4].cumQty == 15);
+    BOOST_TEST(out[4].avgPrice == P100);
+    BOOST_TEST(int(out[4].status) == int(OrderStatus::Filled));
+    BOOST_TEST(book.quantityAt(OrderSide::Sell, P100) == 5);
+    BOOST_TEST(book.size() == 3);
+    out.clear();
+
+    // a market order sweeps the levels and the remainder is canceled
+    book.newOrder("F", "f1", OrderSide::Buy, OrderType::Market, 0, 20, out);
+    BOOST_TEST(out.back().owner == "F");
+    BOOST_TEST(int(out.back().status) == int(OrderStatus::Canceled));
+    BOOST_TEST(out.back().cumQty == 15);
+    BOOST_TEST(out.back().avgPrice == (5 * P100 + 10 * P101) / 15);
+    BOOST_TEST(book.ask() == 0);
+}
+
+BOOST_AUTO_TEST_CASE( cancel ) {
+    OrderBook book;
+    std::vector<OrderBook::Execution> out;
+    book.newOrder("A", "a1", OrderSide::Buy, OrderType::Limit, P100, 10, out);
+    auto exchangeId = out[0].exchangeId;
+    out.clear();
+    BOOST_TEST(!book.cancel("B", exchangeId, out));
+    BOOST_TEST(book.cancel("A", exchangeId, out));
+    BOOST_TEST(int(out[0].status) == int(OrderStatus::Canceled));
+    BOOST_TEST(!book.cancel("A", exchangeId, out));
+    BOOST_TEST(book.bid() == 0);
+
+    // the pooled node is reused with a new exchange id
+    out.clear();
+    book.newOrder("A", "a2", OrderSide::Buy, OrderType::Limit, P100, 10, out);
+    BOOST_TEST(out[0].exchangeId != exchangeId);
+    BOOST_TEST(!book.cancel("A", exchangeId, out));
+}
+
+BOOST_AUTO_TEST_CASE( mass_quote ) {
+    OrderBook book;
+    std::vector<OrderBook::Execution> out;
+    OrderBook::QuoteOrders quote;
+    BOOST_TEST(book.quote("Q", "e1", quote, P99, 10, P101, 10, out));
+    BOOST_TEST(book.bid() == P99);
+    BOOST_TEST(book.ask() == P101);
+
+    // replaces the previous quote
+    BOOST_TEST(book.quote("Q", "e1", quote, P100, 5, P101, 5, out));
+    BOOST_TEST(book.quantityAt(OrderSide::Buy, P99) == 0);
+    BOOST_TEST(book.quantityAt(OrderSide::Buy, P100) == 5);
+    BOOST_TEST(book.size() == 2);
+    BOOST_TEST(out.empty());
+
+    // an order trades with the quote
+    book.newOrder("A", "a1", OrderSide::Sell, OrderType::Limit, P100, 5, out);
+    BOOST_TEST(out.size() == 3);
+    BOOST_TEST(out[1].quote);
+    BOOST_TEST(out[1].orderId == "e1");
+    BOOST_TEST(book.bid() == 0);
+
+    // the traded bid is no longer canceled by a replace
+    book.newOrder("A", "a2", OrderSide::Buy, OrderType::Limit, P99, 5, out);
+    BOOST_TEST(!book.quote("Q", "e1", quote, P101, 5, P100, 5, out));
+    BOOST_TEST(book.size() == 1);
+    BOOST_TEST(book.bid() == P99);
+
+    OrderBook::QuoteOrders other;
+    book.quote("Q", "e2", other, P99, 10, P101, 10, out);
+    book.cancelQuote(other);
+    BOOST_TEST(book.size() == 1);
+    BOOST_TEST(book.ask() == 0);
+}
+
+BOOST_AUTO_TEST_CASE( quote_book ) {
+    SessionQuotes a("A"), b("B");
+    SymbolQuotes view;
+
+    auto& setA = a.set("s1");
+    auto& a1 = a.entry(setA, 0, "e1");
+    auto& a2 = a.entry(setA, 1, "e2");
+    BOOST_TEST(&a1 != &a2);
+    // a refresh in the same order matches by position, and in a different order by id
+    BOOST_TEST(&a.entry(setA, 0, "e1") == &a1);
+    BOOST_TEST(&a.entry(setA, 0, "e2") == &a2);
+
+    a1.bidPrice = P99;
+    a1.bidQty = 10;
+    a2.askPrice = P101;
+    a2.askQty = 10;
+    view.update(a.owner, a1);
+    view.update(a.owner, a2);
+
+    auto& b1 = b.entry(b.set("s1"), 0, "e1");
+    b1.bidPrice = P100;
+    b1.bidQty = 5;
+    view.update(b.owner, b1);
+    BOOST_TEST(view.size() == 3);
+    BOOST_TEST(view.bestBid() == P100);
+    BOOST_TEST(view.bestAsk() == P101);
+
+    // removing moves the last quote into the hole
+    view.remove(a1);
+    BOOST_TEST(view.size() == 2);
+    BOOST_TEST(b1.viewIndex == 0);
+    BOOST_TEST(*view.quotes()[b1.viewIndex].owner == "B");
+    view.remove(b1);
+    view.remove(b1);
+    BOOST_TEST(view.size() == 1);
+    BOOST_TEST(view.bestBid() == 0);
+    BOOST_TEST(a.size() == 2);
+}
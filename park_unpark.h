@@ -17,6 +17,15 @@ struct ParkSupport {
         signaled = false;
     }
 
+    // returns false if not unparked within the timeout
+    template <typename Duration>
+    bool parkFor(const Duration& timeout) {
+        std::unique_lock<boost::fibers::mutex> lk(mutex);
+        if (!cv.wait_for(lk, timeout, [this] { return signaled; })) return false;
+        signaled = false;
+        return true;
+    }
+
     void unpark() {
         std::lock_guard<boost::fibers::mutex> lock(mutex);
         signaled = true;
@@ -1,14 +1,23 @@
+#pragma once
+
 #include <sys/event.h>
 #include <unistd.h>
+#include <atomic>
 #include <cerrno>
+#include <mutex>
+#include <stdexcept>
 #include <vector>
 #include <functional>
 
 struct Poller {
+    typedef std::pair<std::function<void(struct kevent&, void*)>, void*> callback_t;
+
     int kqueue_fd;
     std::vector<struct kevent> events;
-
-    static const uint32_t events_mask = EVFILT_READ | EVFILT_WRITE | EV_ERROR;
+    // the registered callback by socket. Callbacks are made holding the lock, so once remove_socket() returns
+    // no callback is in progress or will be made for the socket, and its user data can be freed.
+    std::mutex lock;
+    std::vector<callback_t*> registered;
 
     std::atomic<bool> running = true;
 
@@ -23,22 +32,65 @@ struct Poller {
         ::close(kqueue_fd);
     }
 
-    void add_socket(int socket_fd, void* user_data, std::function<void(struct kevent&, void*)> callback) {
+    // the callback is invoked with event.filter EVFILT_READ when the socket is readable, and if writable is true,
+    // with EVFILT_WRITE when the socket becomes writable (edge triggered)
+    void add_socket(int socket_fd, void* user_data, std::function<void(struct kevent&, void*)> callback, bool writable = false) {
+        add(socket_fd, user_data, callback, writable ? 2 : 1, EV_ADD);
+    }
+    // the callback is invoked with event.filter EVFILT_READ when connections are pending on the listening socket.
+    // Edge triggered, so the connections must be accepted until EAGAIN.
+    void add_listener(int socket_fd, void* user_data, std::function<void(struct kevent&, void*)> callback) {
+        add(socket_fd, user_data, callback, 1, EV_ADD | EV_CLEAR);
+    }
+
+    // add the EVFILT_WRITE callback to a socket registered without it, e.g. once its writes become non-blocking
+    void add_writable(int socket_fd) {
+        callback_t* cb_data = nullptr;
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            if (size_t(socket_fd) < registered.size()) cb_data = registered[socket_fd];
+        }
+        if (!cb_data) return;
         struct kevent event;
-        auto* cb_data = new std::pair<std::function<void(struct kevent&, void*)>, void*>(callback, user_data);
-        EV_SET(&event, socket_fd, events_mask, EV_ADD, 0, 0, reinterpret_cast<void*>(cb_data));
+        EV_SET(&event, socket_fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, reinterpret_cast<void*>(cb_data));
         if (kevent(kqueue_fd, &event, 1, nullptr, 0, nullptr) == -1) {
+            throw std::runtime_error("Failed to add socket to kqueue");
+        }
+    }
+
+   private:
+    void add(int socket_fd, void* user_data, std::function<void(struct kevent&, void*)>& callback, int filters, uint16_t readFlags) {
+        struct kevent events[2];
+        auto* cb_data = new callback_t(callback, user_data);
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            if (registered.size() <= size_t(socket_fd)) registered.resize(socket_fd + 1);
+            registered[socket_fd] = cb_data;
+        }
+        EV_SET(&events[0], socket_fd, EVFILT_READ, readFlags, 0, 0, reinterpret_cast<void*>(cb_data));
+        EV_SET(&events[1], socket_fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, reinterpret_cast<void*>(cb_data));
+        if (kevent(kqueue_fd, events, filters, nullptr, 0, nullptr) == -1) {
+            std::lock_guard<std::mutex> mu(lock);
+            registered[socket_fd] = nullptr;
             delete cb_data;
             throw std::runtime_error("Failed to add socket to kqueue");
         }
     }
 
+   public:
     void remove_socket(int socket_fd) {
-        struct kevent event;
-        EV_SET(&event, socket_fd, events_mask, EV_DELETE, 0, 0, nullptr);
-        if (kevent(kqueue_fd, &event, 1, nullptr, 0, nullptr) == -1) {
-            if(errno==EBADF || errno==ENOENT) return;
-            throw std::runtime_error("failed to remove socket from kqueue");
+        for (auto filter : {EVFILT_READ, EVFILT_WRITE}) {
+            struct kevent event;
+            EV_SET(&event, socket_fd, filter, EV_DELETE, 0, 0, nullptr);
+            if (kevent(kqueue_fd, &event, 1, nullptr, 0, nullptr) == -1) {
+                if(errno==EBADF || errno==ENOENT) continue;
+                throw std::runtime_error("failed to remove socket from kqueue");
+            }
+        }
+        std::lock_guard<std::mutex> mu(lock);
+        if (size_t(socket_fd) < registered.size()) {
+            delete registered[socket_fd];
+            registered[socket_fd] = nullptr;
         }
     }
 
@@ -47,8 +99,12 @@ struct Poller {
         if (num_events == -1) {
             throw std::runtime_error("error during kqueue wait");
         }
+        std::lock_guard<std::mutex> mu(lock);
         for (int i = 0; i < num_events; i++) {
-            auto* cb_data = reinterpret_cast<std::pair<std::function<void(struct kevent&, void*)>, void*>*>(events[i].udata);
+            auto* cb_data = reinterpret_cast<callback_t*>(events[i].udata);
+            // skip events for sockets removed since the wait returned
+            auto fd = events[i].ident;
+            if (fd >= registered.size() || registered[fd] != cb_data) continue;
             cb_data->first(events[i], cb_data->second);
         }
     }
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <boost/fiber/all.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// the scheduling class of a session fiber, see PriorityScheduler
+enum class Priority { High, Normal, Low };
+
+struct FiberPriority : boost::fibers::fiber_properties {
+    Priority priority = Priority::Normal;
+    FiberPriority(boost::fibers::context* ctx) : fiber_properties(ctx) {}
+};
+
+// A fiber scheduler running the ready fibers of a higher Priority before any of a lower one, and fibers of the same
+// priority in order. Shared, it distributes the fibers across all threads using a shared instance like
+// boost::fibers::algo::shared_work, otherwise the fibers stay on the thread that created them. The thread's main
+// and dispatcher fibers run after the ready fibers of all priorities.
+//
+// The priority of a fiber is read each time it becomes ready, so a change takes effect on its next yield or park.
+class PriorityScheduler : public boost::fibers::algo::algorithm_with_properties<FiberPriority> {
+    typedef boost::fibers::context context;
+
+    struct ReadyQueues {
+        std::mutex lock;
+        std::deque<context*> queues[3];
+    };
+    static ReadyQueues& sharedQueues() {
+        static ReadyQueues queues;
+        return queues;
+    }
+
+    const bool shared;
+    ReadyQueues local;
+    ReadyQueues& ready;
+    boost::fibers::scheduler::ready_queue_type pinned;
+    std::mutex mtx;
+    std::condition_variable cnd;
+    bool flag = false;
+
+   public:
+    PriorityScheduler(bool shared) : shared(shared), ready(shared ? sharedQueues() : local) {}
+
+    void awakened(context* ctx, FiberPriority& props) noexcept override {
+        if (ctx->is_context(boost::fibers::type::pinned_context)) {
+            ctx->ready_link(pinned);
+            return;
+        }
+        if (shared) ctx->detach();
+        std::lock_guard<std::mutex> lk(ready.lock);
+        ready.queues[int(props.priority)].push_back(ctx);
+    }
+
+    context* pick_next() noexcept override {
+        {
+            std::unique_lock<std::mutex> lk(ready.lock);
+            for (auto& queue : ready.queues) {
+                if (queue.empty()) continue;
+                auto ctx = queue.front();
+                queue.pop_front();
+                lk.unlock();
+                if (shared) context::active()->attach(ctx);
+                return ctx;
+            }
+        }
+        if (pinned.empty()) return nullptr;
+        auto ctx = &pinned.front();
+        pinned.pop_front();
+        return ctx;
+    }
+
+    bool has_ready_fibers() const noexcept override {
+        std::lock_guard<std::mutex> lk(ready.lock);
+        for (auto& queue : ready.queues) {
+            if (!queue.empty()) return true;
+        }
+        return !pinned.empty();
+    }
+
+    void suspend_until(std::chrono::steady_clock::time_point const& time_point) noexcept override {
+        std::unique_lock<std::mutex> lk(mtx);
+        if (time_point == std::chrono::steady_clock::time_point::max()) {
+            cnd.wait(lk, [this] { return flag; });
+        } else {
+            cnd.wait_until(lk, time_point, [this] { return flag; });
+        }
+        flag = false;
+    }
+
+    void notify() noexcept override {
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            flag = true;
+        }
+        cnd.notify_all();
+    }
+};
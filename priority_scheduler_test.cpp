@@ -0,0 +1,63 @@
+#define BOOST_TEST_MODULE priority_scheduler_test
+#include <boost/test/included/unit_test.hpp>
+
+#include <thread>
+#include <vector>
+
+#include "priority_scheduler.h"
+
+BOOST_AUTO_TEST_CASE( priority_order ) {
+    std::vector<int> order;
+    std::thread t([&order] {
+        boost::fibers::use_scheduling_algorithm<PriorityScheduler>(false);
+        // the fibers wait until all have set their priority, and become ready together
+        boost::fibers::mutex lock;
+        boost::fibers::condition_variable cv;
+        int waiting = 0;
+        bool go = false;
+        std::vector<boost::fibers::fiber> fibers;
+        const Priority priorities[] = {Priority::Low, Priority::Normal, Priority::High, Priority::Low, Priority::High};
+        for (int i = 0; i < 5; i++) {
+            auto priority = priorities[i];
+            fibers.emplace_back([&, priority, i] {
+                boost::this_fiber::properties<FiberPriority>().priority = priority;
+                std::unique_lock<boost::fibers::mutex> lk(lock);
+                waiting++;
+                cv.wait(lk, [&] { return go; });
+                order.push_back(i);
+            });
+        }
+        while (waiting < 5) boost::this_fiber::yield();
+        {
+            std::lock_guard<boost::fibers::mutex> lk(lock);
+            go = true;
+        }
+        cv.notify_all();
+        for (auto& fiber : fibers) fiber.join();
+    });
+    t.join();
+    BOOST_TEST(order == std::vector<int>({2, 4, 1, 0, 3}), boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE( shared_threads ) {
+    std::atomic<int> done = 0;
+    std::vector<std::thread> threads;
+    boost::fibers::barrier started(3);
+    for (int i = 0; i < 2; i++) {
+        threads.emplace_back([&] {
+            boost::fibers::use_scheduling_algorithm<PriorityScheduler>(true);
+            started.wait();
+            std::vector<boost::fibers::fiber> fibers;
+            for (int j = 0; j < 100; j++) {
+                fibers.emplace_back([&done] {
+                    for (int k = 0; k < 10; k++) boost::this_fiber::yield();
+                    done++;
+                });
+            }
+            for (auto& fiber : fibers) fiber.join();
+        });
+    }
+    started.wait();
+    for (auto& thread : threads) thread.join();
+    BOOST_TEST(done == 200);
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "order_book.h"
+
+// one entry of a MassQuote
+struct QuoteEntry {
+    std::string_view setId;
+    std::string_view entryId;
+    std::string_view symbol;
+    OrderBook::Units bidPrice = 0;
+    int64_t bidQty = 0;
+    OrderBook::Units askPrice = 0;
+    int64_t askQty = 0;
+};
+
+// the live quote of a session for a quote entry
+struct Quote {
+    static const uint32_t NONE = UINT32_MAX;
+
+    std::string entryId;
+    std::string symbol;
+    OrderBook::Units bidPrice = 0;
+    int64_t bidQty = 0;
+    OrderBook::Units askPrice = 0;
+    int64_t askQty = 0;
+    // the resting orders in the OrderBook of the symbol
+    OrderBook::QuoteOrders orders;
+    // the position in the SymbolQuotes of the symbol, or NONE if not quoted
+    uint32_t viewIndex = NONE;
+
+    bool isQuoted() const { return bidQty > 0 || askQty > 0; }
+};
+
+// The quotes of all sessions for a symbol, as last quoted, in a dense array so the view is cheap to scan. A quote
+// is added, updated and removed in O(1), a removal moves the last quote into the hole.
+class SymbolQuotes {
+   public:
+    struct Entry {
+        const std::string* owner;
+        Quote* quote;
+        OrderBook::Units bidPrice;
+        int64_t bidQty;
+        OrderBook::Units askPrice;
+        int64_t askQty;
+    };
+
+   private:
+    std::vector<Entry> entries;
+
+   public:
+    // the owner must remain valid until the quote is removed
+    void update(const std::string& owner, Quote& quote) {
+        if (quote.viewIndex == Quote::NONE) {
+            quote.viewIndex = entries.size();
+            entries.push_back({&owner, &quote});
+        }
+        auto& e = entries[quote.viewIndex];
+        e.bidPrice = quote.bidPrice;
+        e.bidQty = quote.bidQty;
+        e.askPrice = quote.askPrice;
+        e.askQty = quote.askQty;
+    }
+    void remove(Quote& quote) {
+        if (quote.viewIndex == Quote::NONE) return;
+        auto& last = entries.back();
+        last.quote->viewIndex = quote.viewIndex;
+        entries[quote.viewIndex] = last;
+        entries.pop_back();
+        quote.viewIndex = Quote::NONE;
+    }
+    const std::vector<Entry>& quotes() const { return entries; }
+    size_t size() const { return entries.size(); }
+    // the best quoted prices across the sessions, 0 if none
+    OrderBook::Units bestBid() const {
+        OrderBook::Units best = 0;
+        for (auto& e : entries) {
+            if (e.bidQty > 0 && e.bidPrice > best) best = e.bidPrice;
+        }
+        return best;
+    }
+    OrderBook::Units bestAsk() const {
+        OrderBook::Units best = 0;
+        for (auto& e : entries) {
+            if (e.askQty > 0 && (best == 0 || e.askPrice < best)) best = e.askPrice;
+        }
+        return best;
+    }
+};
+
+// The quotes of a session, keyed by quote set and entry. Market makers refresh the same entries of a set in the
+// same order, so an entry is first matched by its position in the set, and the set's index is only used when the
+// order changes or a new entry is added. A refresh of a whole set costs one map lookup rather than one per entry.
+//
+// Quotes are kept when they are withdrawn, so their addresses are stable until clear().
+class SessionQuotes {
+   public:
+    struct QuoteSet {
+        std::deque<Quote> entries;
+        std::unordered_map<std::string, uint32_t> index;
+    };
+
+   private:
+    std::unordered_map<std::string, QuoteSet> sets;
+
+   public:
+    const std::string owner;
+
+    SessionQuotes(const std::string& owner) : owner(owner) {}
+    SessionQuotes(const SessionQuotes&) = delete;
+    SessionQuotes& operator=(const SessionQuotes&) = delete;
+
+    QuoteSet& set(std::string_view setId) {
+        return sets[std::string(setId)];
+    }
+    // the quote for the entry at the position in the message, created if the entry is new
+    Quote& entry(QuoteSet& set, size_t position, std::string_view entryId) {
+        if (position < set.entries.size() && set.entries[position].entryId == entryId) return set.entries[position];
+        auto [itr, inserted] = set.index.try_emplace(std::string(entryId), uint32_t(set.entries.size()));
+        if (inserted) set.entries.emplace_back().entryId = entryId;
+        return set.entries[itr->second];
+    }
+    template <typename Fn>
+    void forEach(Fn&& fn) {
+        for (auto& set : sets) {
+            for (auto& quote : set.second.entries) fn(quote);
+        }
+    }
+    // the number of quoted entries
+    size_t size() const {
+        size_t n = 0;
+        for (auto& set : sets) {
+            for (auto& quote : set.second.entries) n += quote.isQuoted();
+        }
+        return n;
+    }
+    void clear() { sets.clear(); }
+};
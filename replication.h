@@ -0,0 +1,356 @@
+#pragma once
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "framing.h"
+#include "shm_channel.h"
+
+// The shared memory segment replicating the session state of a primary Acceptor to a standby process on the same
+// host, see Replicator and Standby. The segment is a Header whose ShmRing is followed by its data, a sequence of
+// records each a Record followed by the session id and, for OUTBOUND, the bytes sent, padded to ALIGNMENT.
+//
+// The ring has many producers: the ShmRing head is the end of the space reserved by the sessions, and each record
+// is committed by storing its length last, so the standby reads the records in the order reserved and stops at
+// one not yet committed. The standby zeroes the records it reads before advancing the tail.
+struct ReplicationFormat {
+    static constexpr char MAGIC[4] = {'F', 'X', 'R', 'P'};
+
+    enum Kind : uint8_t {
+        // the session's next expected inbound MsgSeqNum
+        INBOUND,
+        // bytes sent by the session, complete messages unless a message was larger than the socket buffer
+        OUTBOUND
+    };
+    struct Record {
+        // the length of the record including this header, 0 until the record is committed
+        uint32_t length;
+        Kind kind;
+        uint8_t idLength;
+        uint16_t reserved;
+        int32_t seqNum;
+    };
+    struct Header {
+        char magic[4];
+        // the primary process, see Standby::primaryAlive()
+        pid_t primary;
+        // the records dropped since the ring was full
+        std::atomic<uint64_t> lost{0};
+        // must be last, its data follows it
+        ShmRing ring;
+    };
+    // records start at multiples of the alignment, so the length is never split by the end of the ring
+    static constexpr uint64_t ALIGNMENT = 8;
+    static uint64_t padded(uint64_t length) {
+        return (length + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+   protected:
+    char* data;
+    // a private copy, the segment can be written by the other process at any time
+    uint64_t capacity;
+
+    ReplicationFormat(Header* header, uint64_t capacity) : data(reinterpret_cast<char*>(&header->ring) + sizeof(ShmRing)), capacity(capacity) {}
+    std::atomic_ref<uint32_t> committed(uint64_t pos) {
+        return std::atomic_ref<uint32_t>(*reinterpret_cast<uint32_t*>(data + (pos & (capacity - 1))));
+    }
+    void copyIn(uint64_t pos, const void* src, size_t len) {
+        auto offset = pos & (capacity - 1);
+        auto first = std::min(len, size_t(capacity - offset));
+        memcpy(data + offset, src, first);
+        memcpy(data, static_cast<const char*>(src) + first, len - first);
+    }
+    void copyOut(uint64_t pos, void* dst, size_t len) {
+        auto offset = pos & (capacity - 1);
+        auto first = std::min(len, size_t(capacity - offset));
+        memcpy(dst, data + offset, first);
+        memcpy(static_cast<char*>(dst) + first, data, len - first);
+    }
+    void clear(uint64_t pos, size_t len) {
+        auto offset = pos & (capacity - 1);
+        auto first = std::min(len, size_t(capacity - offset));
+        memset(data + offset, 0, first);
+        memset(data, 0, len - first);
+    }
+};
+
+// The primary side of hot standby replication, see EngineOptions::replicator. Each logged on session appends its
+// outbound bytes and its expected inbound sequence number to a ring in shared memory, read by a Standby. A session
+// reserves the space for its record with a compare and swap of the head, then copies and commits the record, so
+// the sessions append concurrently and replication adds no system calls. If the standby falls behind and the ring
+// is full the record is dropped and counted in lost(), the primary never waits for the standby.
+class Replicator : public ReplicationFormat {
+    std::string name;
+    void* base;
+    size_t length;
+    Header* header;
+
+    Replicator(const std::string& name, void* base, size_t length, size_t capacity)
+        : ReplicationFormat(static_cast<Header*>(base), capacity), name(name), base(base), length(length), header(static_cast<Header*>(base)) {}
+
+    void append(Kind kind, const std::string& id, int32_t seqNum, const char* p, size_t len) {
+        Record record{uint32_t(sizeof(Record) + id.size() + len), kind, uint8_t(id.size()), 0, seqNum};
+        auto size = padded(record.length);
+        auto& ring = header->ring;
+        auto pos = ring.head.load(std::memory_order_relaxed);
+        do {
+            if (pos + size - ring.tail.load(std::memory_order_acquire) > capacity) {
+                header->lost.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        } while (!ring.head.compare_exchange_weak(pos, pos + size, std::memory_order_relaxed));
+        auto fields = offsetof(Record, kind);
+        copyIn(pos + fields, reinterpret_cast<const char*>(&record) + fields, sizeof(Record) - fields);
+        copyIn(pos + sizeof(Record), id.data(), id.size());
+        copyIn(pos + sizeof(Record) + id.size(), p, len);
+        committed(pos).store(record.length, std::memory_order_release);
+    }
+
+   public:
+    // the replication state of a session, owned by the Session
+    class Connection {
+        Replicator& replicator;
+        // at most 255 bytes, see Record::idLength
+        const std::string id;
+
+       public:
+        Connection(Replicator& replicator, const std::string& id) : replicator(replicator), id(id.substr(0, 255)) {}
+        void outbound(const char* p, size_t len) { replicator.append(OUTBOUND, id, 0, p, len); }
+        void outbound(const struct iovec* iov, int count) {
+            for (int i = 0; i < count; i++) outbound(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+        }
+        void inbound(int expectedSeqNum) { replicator.append(INBOUND, id, expectedSeqNum, nullptr, 0); }
+    };
+
+    ~Replicator() {
+        ::munmap(base, length);
+        shm_unlink(name.c_str());
+    }
+    Replicator(const Replicator&) = delete;
+    Replicator& operator=(const Replicator&) = delete;
+
+    // create the segment, replacing any left by a previous primary. The capacity must be a power of two, and
+    // an OUTBOUND record must fit, i.e. it should be several times the socket buffer size.
+    static std::unique_ptr<Replicator> create(const std::string& name, size_t capacity = 16 * 1024 * 1024) {
+        if (capacity < ALIGNMENT || (capacity & (capacity - 1))) throw std::runtime_error("replication capacity must be a power of two");
+        shm_unlink(name.c_str());
+        auto length = sizeof(Header) + capacity;
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) throw std::runtime_error("unable to create shared memory " + name);
+        if (ftruncate(fd, length) < 0) {
+            ::close(fd);
+            shm_unlink(name.c_str());
+            throw std::runtime_error("unable to size shared memory " + name);
+        }
+        void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            throw std::runtime_error("unable to map shared memory " + name);
+        }
+        auto header = new (base) Header();
+        header->primary = getpid();
+        header->ring.capacity = capacity;
+        memcpy(header->magic, MAGIC, sizeof(MAGIC));
+        return std::unique_ptr<Replicator>(new Replicator(name, base, length, capacity));
+    }
+    uint64_t lost() const {
+        return header->lost.load(std::memory_order_relaxed);
+    }
+};
+
+// the state of a session replicated to a Standby
+struct ReplicatedSession {
+    // the MsgSeqNum of the next message sent
+    int nextSeqNum = 1;
+    // the MsgSeqNum of the next message received
+    int expectedSeqNum = 1;
+    // the last outbound messages, oldest first, see Standby::open()
+    std::deque<std::string> journal;
+    // the start of a message larger than an OUTBOUND record
+    std::string partial;
+};
+
+// The sequence numbers of the sessions of a primary taken over by a standby Acceptor, see Acceptor::takeover().
+// A session continues its sequences until its first successful logon to the standby.
+class ReplicaSequences {
+    std::mutex lock;
+    std::map<std::string, std::pair<int, int>> sequences;
+
+   public:
+    void add(const std::string& id, int nextSeqNum, int expectedSeqNum) {
+        std::lock_guard<std::mutex> mu(lock);
+        sequences[id] = {nextSeqNum, expectedSeqNum};
+    }
+    // returns false if the session was not replicated or already logged on, see remove()
+    bool find(const std::string& id, int& nextSeqNum, int& expectedSeqNum) {
+        std::lock_guard<std::mutex> mu(lock);
+        auto itr = sequences.find(id);
+        if (itr == sequences.end()) return false;
+        nextSeqNum = itr->second.first;
+        expectedSeqNum = itr->second.second;
+        return true;
+    }
+    // called once the session logged on, so a rejected logon does not lose the sequences
+    void remove(const std::string& id) {
+        std::lock_guard<std::mutex> mu(lock);
+        sequences.erase(id);
+    }
+};
+
+// The standby side of hot standby replication. poll() applies the records written by the primary's Replicator to
+// the replicated sessions, by session id. The standby polls rather than waiting on a doorbell so the primary
+// makes no system calls, e.g. calling poll() every millisecond until primaryAlive() is false, then taking over the
+// sessions with Acceptor::takeover() and calling Acceptor::listen() to accept the counterparties on the same port.
+class Standby : public ReplicationFormat {
+    void* base;
+    size_t length;
+    Header* header;
+    // the tail, never read back from the segment
+    uint64_t position;
+    bool isBroken = false;
+    const size_t journalDepth;
+    uint64_t lostSeen = 0;
+    std::map<std::string, ReplicatedSession, std::less<>> replicated;
+    std::vector<char> buffer;
+
+    Standby(void* base, size_t length, size_t capacity, size_t journalDepth)
+        : ReplicationFormat(static_cast<Header*>(base), capacity), base(base), length(length), header(static_cast<Header*>(base)),
+          position(header->ring.tail.load(std::memory_order_relaxed)), journalDepth(journalDepth) {}
+
+    void applyOutbound(ReplicatedSession& session, const char* p, size_t len) {
+        std::string_view bytes(p, len);
+        if (!session.partial.empty()) {
+            session.partial.append(p, len);
+            bytes = session.partial;
+        }
+        size_t offset = 0;
+        while (offset < bytes.size()) {
+            size_t total;
+            try {
+                total = Framing::messageLength(bytes.data() + offset, bytes.size() - offset);
+            } catch (const std::runtime_error&) {
+                // the start of the message was in a lost record
+                offset = bytes.size();
+                break;
+            }
+            if (!total) break;
+            std::string_view msg = bytes.substr(offset, total);
+            auto seqNum = msg.find("\00134=");
+            if (seqNum != std::string_view::npos) session.nextSeqNum = atoi(msg.data() + seqNum + 4) + 1;
+            if (journalDepth) {
+                if (session.journal.size() == journalDepth) session.journal.pop_front();
+                session.journal.emplace_back(msg);
+            }
+            offset += total;
+        }
+        session.partial = std::string(bytes.substr(offset));
+    }
+
+   public:
+    ~Standby() {
+        ::munmap(base, length);
+    }
+    Standby(const Standby&) = delete;
+    Standby& operator=(const Standby&) = delete;
+
+    // map the segment created by the primary, keeping the last journalDepth outbound messages of each session
+    static std::unique_ptr<Standby> open(const std::string& name, size_t journalDepth = 1024) {
+        int fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0) throw std::runtime_error("unable to open shared memory " + name);
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            ::close(fd);
+            throw std::runtime_error("unable to stat shared memory " + name);
+        }
+        void* base = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) throw std::runtime_error("unable to map shared memory " + name);
+        auto header = static_cast<Header*>(base);
+        uint64_t capacity = size_t(st.st_size) < sizeof(Header) ? 0 : header->ring.capacity.load();
+        if (capacity < ALIGNMENT || (capacity & (capacity - 1)) || memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            capacity > size_t(st.st_size) - sizeof(Header)) {
+            ::munmap(base, st.st_size);
+            throw std::runtime_error("invalid replication segment " + name);
+        }
+        return std::unique_ptr<Standby>(new Standby(base, st.st_size, capacity, journalDepth));
+    }
+
+    // apply the records written since the last poll, returns the number applied
+    size_t poll() {
+        auto lost = header->lost.load(std::memory_order_relaxed);
+        if (lost != lostSeen) {
+            // a lost OUTBOUND record may have held the rest of a partial message
+            for (auto& entry : replicated) entry.second.partial.clear();
+            lostSeen = lost;
+        }
+        size_t applied = 0;
+        while (!isBroken) {
+            auto committedLength = committed(position).load(std::memory_order_acquire);
+            if (!committedLength) break;
+            Record record;
+            copyOut(position, &record, sizeof(record));
+            record.length = committedLength;
+            auto size = padded(record.length);
+            // a record must lie within the space reserved by the primary, and hold its id
+            if (record.length < sizeof(Record) || size > capacity || size > header->ring.head.load(std::memory_order_acquire) - position ||
+                record.idLength > record.length - sizeof(Record)) {
+                isBroken = true;
+                break;
+            }
+            buffer.resize(record.length - sizeof(Record));
+            copyOut(position + sizeof(Record), buffer.data(), buffer.size());
+            // the space reads as uncommitted once the primary reuses it
+            clear(position, size);
+            position += size;
+            header->ring.tail.store(position, std::memory_order_release);
+            std::string_view id(buffer.data(), record.idLength);
+            auto itr = replicated.find(id);
+            if (itr == replicated.end()) itr = replicated.emplace(std::string(id), ReplicatedSession()).first;
+            if (record.kind == INBOUND) {
+                itr->second.expectedSeqNum = record.seqNum;
+            } else {
+                applyOutbound(itr->second, buffer.data() + record.idLength, buffer.size() - record.idLength);
+            }
+            applied++;
+        }
+        return applied;
+    }
+    // false once the primary process has exited
+    bool primaryAlive() const {
+        return kill(header->primary, 0) == 0 || errno != ESRCH;
+    }
+    // the records the primary dropped since the ring was full, the replicated state may be behind the primary
+    uint64_t lost() const {
+        return header->lost.load(std::memory_order_relaxed);
+    }
+    // true once a malformed record was read, poll() then applies nothing, the replicated state is as of the record
+    bool broken() const {
+        return isBroken;
+    }
+    // the replicated sessions by session id, as of the last poll()
+    const std::map<std::string, ReplicatedSession, std::less<>>& sessions() const {
+        return replicated;
+    }
+};
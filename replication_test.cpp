@@ -0,0 +1,153 @@
+#define BOOST_TEST_MODULE replication_test
+#include <boost/test/included/unit_test.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fix_builder.h"
+#include "replication.h"
+
+static std::string segmentName() {
+    return "/cppfix.replication_test." + std::to_string(getpid());
+}
+
+// an outbound message as sent by a session
+static std::string message(int seqNum) {
+    FixBuilder msg;
+    msg.addField(8, "FIX.4.4");
+    msg.addField(9, "0000");
+    msg.addField(35, "8");
+    msg.addField(49, "server");
+    msg.addField(56, "client");
+    msg.addField(34, seqNum);
+    msg.addField(11, "order" + std::to_string(seqNum));
+    std::ostringstream os;
+    msg.writeTo(os);
+    return os.str();
+}
+
+BOOST_AUTO_TEST_CASE( replicate_sessions ) {
+    auto replicator = Replicator::create(segmentName(), 64 * 1024);
+    auto standby = Standby::open(segmentName(), 2);
+    BOOST_TEST(standby->primaryAlive());
+
+    Replicator::Connection a(*replicator, "server:a");
+    Replicator::Connection b(*replicator, "server:b");
+    a.inbound(2);
+    for (int seqNum = 1; seqNum <= 3; seqNum++) {
+        auto msg = message(seqNum);
+        a.outbound(msg.data(), msg.size());
+    }
+    // a message split over two writes, e.g. larger than the socket buffer
+    auto msg = message(1);
+    b.outbound(msg.data(), 10);
+    b.outbound(msg.data() + 10, msg.size() - 10);
+    b.inbound(5);
+
+    BOOST_TEST(standby->poll() == 7u);
+    BOOST_TEST(standby->poll() == 0u);
+    auto& sessions = standby->sessions();
+    BOOST_TEST(sessions.size() == 2u);
+    auto& first = sessions.at("server:a");
+    BOOST_TEST(first.expectedSeqNum == 2);
+    BOOST_TEST(first.nextSeqNum == 4);
+    // only the last 2 are kept
+    BOOST_TEST(first.journal.size() == 2u);
+    BOOST_TEST(first.journal.front() == message(2));
+    BOOST_TEST(first.journal.back() == message(3));
+    auto& second = sessions.at("server:b");
+    BOOST_TEST(second.expectedSeqNum == 5);
+    BOOST_TEST(second.nextSeqNum == 2);
+    BOOST_TEST(second.journal.back() == msg);
+    BOOST_TEST(second.partial.empty());
+}
+
+BOOST_AUTO_TEST_CASE( full_ring ) {
+    auto replicator = Replicator::create(segmentName(), 1024);
+    auto standby = Standby::open(segmentName());
+    Replicator::Connection connection(*replicator, "server:client");
+    auto msg = message(1);
+    int written = 0;
+    for (; replicator->lost() == 0; written++) connection.outbound(msg.data(), msg.size());
+    // the primary drops records rather than waiting for the standby
+    BOOST_TEST(standby->lost() == 1u);
+    BOOST_TEST(standby->poll() == size_t(written - 1));
+    auto next = message(2);
+    connection.outbound(next.data(), next.size());
+    BOOST_TEST(standby->poll() == 1u);
+    BOOST_TEST(standby->sessions().at("server:client").nextSeqNum == 3);
+}
+
+BOOST_AUTO_TEST_CASE( replica_sequences ) {
+    ReplicaSequences sequences;
+    sequences.add("server:client", 7, 8);
+    int nextSeqNum = 1, expectedSeqNum = 1;
+    // found until the session logs on
+    for (int i = 0; i < 2; i++) {
+        BOOST_TEST(sequences.find("server:client", nextSeqNum, expectedSeqNum));
+        BOOST_TEST(nextSeqNum == 7);
+        BOOST_TEST(expectedSeqNum == 8);
+    }
+    sequences.remove("server:client");
+    BOOST_TEST(!sequences.find("server:client", nextSeqNum, expectedSeqNum));
+}
+
+BOOST_AUTO_TEST_CASE( invalid_segment ) {
+    BOOST_CHECK_THROW(Standby::open("/cppfix.replication_test.missing"), std::runtime_error);
+    BOOST_CHECK_THROW(Replicator::create(segmentName(), 1000), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE( concurrent_append ) {
+    auto replicator = Replicator::create(segmentName(), 1024 * 1024);
+    auto standby = Standby::open(segmentName());
+    const int THREADS = 4, RECORDS = 2000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&replicator, t] {
+            Replicator::Connection connection(*replicator, "server:" + std::to_string(t));
+            for (int seqNum = 1; seqNum <= RECORDS; seqNum++) {
+                auto msg = message(seqNum);
+                connection.outbound(msg.data(), msg.size());
+            }
+        });
+    }
+    // the standby reads while the sessions append
+    size_t applied = 0;
+    while (applied < size_t(THREADS * RECORDS) && !standby->broken()) applied += standby->poll();
+    for (auto& thread : threads) thread.join();
+    BOOST_TEST(replicator->lost() == 0u);
+    BOOST_TEST(!standby->broken());
+    BOOST_TEST(applied == size_t(THREADS * RECORDS));
+    for (int t = 0; t < THREADS; t++) {
+        auto& session = standby->sessions().at("server:" + std::to_string(t));
+        BOOST_TEST(session.nextSeqNum == RECORDS + 1);
+        BOOST_TEST(session.journal.back() == message(RECORDS));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( malformed_record ) {
+    const size_t CAPACITY = 1024;
+    for (uint32_t length : {uint32_t(4), uint32_t(CAPACITY * 2), uint32_t(sizeof(ReplicationFormat::Record) + 1)}) {
+        auto replicator = Replicator::create(segmentName(), CAPACITY);
+        auto standby = Standby::open(segmentName());
+        Replicator::Connection connection(*replicator, "server:client");
+        connection.inbound(2);
+        // overwrite the committed record, whose id no longer fits the last case
+        int fd = shm_open(segmentName().c_str(), O_RDWR, 0600);
+        BOOST_REQUIRE(fd >= 0);
+        auto size = sizeof(ReplicationFormat::Header) + CAPACITY;
+        auto base = static_cast<char*>(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+        ::close(fd);
+        memcpy(base + sizeof(ReplicationFormat::Header), &length, sizeof(length));
+        munmap(base, size);
+        BOOST_TEST(standby->poll() == 0u);
+        BOOST_TEST(standby->broken());
+        BOOST_TEST(standby->sessions().empty());
+    }
+}
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "fix.h"
+#include "fix_engine.h"
+#include "intern_table.h"
+#include "msg_massquote.h"
+#include "msg_orders.h"
+#include "msg_reject.h"
+#include "order_book.h"
+
+// the limits of an account, 0 is unlimited
+struct RiskLimits {
+    int maxOrdersPerSecond = 0;
+    int64_t maxOrderQty = 0;
+    // the price times quantity of an order, in units of OrderBook::Units
+    OrderBook::Units maxNotional = 0;
+    // the net quantity of the accepted orders less their canceled quantity, i.e. the position if they all fill, plus
+    // the filled quantity of the quotes. Each side of a quote must keep the position within the limit if it fills
+    int64_t maxPosition = 0;
+    // the maximum deviation of a price from the symbol's reference price
+    int priceBandPercent = 0;
+};
+
+// The counters of an account, updated with atomics by the sessions trading the account. Aligned so that
+// accounts used from different threads do not share a cache line.
+struct alignas(64) AccountRisk {
+    const RiskLimits limits;
+    // the SenderCompIDs, besides the account's own, whose orders may name the account
+    const std::vector<std::string> senders;
+    // the order count in the current one second window
+    std::atomic<int64_t> windowStart{0};
+    std::atomic<int> windowCount{0};
+    std::atomic<int64_t> position{0};
+
+    AccountRisk(const RiskLimits& limits, std::vector<std::string> senders = {}) : limits(limits), senders(std::move(senders)) {}
+
+    bool allows(std::string_view senderCompId) const {
+        return std::find(senders.begin(), senders.end(), senderCompId) != senders.end();
+    }
+
+    // count an order against the rate limit, the window is reset by the first order in each second so the
+    // limit can be exceeded briefly by orders racing the reset
+    bool countOrder(int64_t nowSeconds) {
+        if (!limits.maxOrdersPerSecond) return true;
+        auto start = windowStart.load(std::memory_order_relaxed);
+        if (start != nowSeconds && windowStart.compare_exchange_strong(start, nowSeconds)) {
+            windowCount.store(0, std::memory_order_relaxed);
+        }
+        return windowCount.fetch_add(1, std::memory_order_relaxed) < limits.maxOrdersPerSecond;
+    }
+    // add the quantity to the position if it stays within the limit
+    bool reservePosition(int64_t quantity) {
+        auto current = position.load(std::memory_order_relaxed);
+        do {
+            if (limits.maxPosition && std::abs(current + quantity) > limits.maxPosition) return false;
+        } while (!position.compare_exchange_weak(current, current + quantity, std::memory_order_relaxed));
+        return true;
+    }
+    // remove the quantity of a canceled or rejected order from the position
+    void releasePosition(int64_t quantity) { position.fetch_sub(quantity, std::memory_order_relaxed); }
+    // true if a fill of the quantity would keep the position within the limit, e.g. of one side of a quote
+    bool allowsPosition(int64_t quantity) const {
+        return !limits.maxPosition || std::abs(position.load(std::memory_order_relaxed) + quantity) <= limits.maxPosition;
+    }
+    // add a fill of a quote, which holds no position until it trades
+    void addPosition(int64_t quantity) { position.fetch_add(quantity, std::memory_order_relaxed); }
+};
+
+// A MessageStage enforcing per-account order rate, order quantity, notional, position and price band limits on
+// NewOrderSingle and MassQuote messages. The account is the Account (1) field, or the SenderCompID if absent, and
+// a session may only name the accounts it was allowed when the account was added.
+// Rejected messages are answered with a BusinessMessageReject and not passed to the handler. The application
+// releases the positions of the orders that do not fill, see onExecution(), as Exchange does when given the stage.
+//
+// Accounts and symbols are added before any sessions start, so lookups need no lock. The reference prices may
+// be updated at any time, and are indexed by the symbol's id in InternTable::symbols().
+class PreTradeRisk : public MessageStage<> {
+    // heterogeneous lookup by string_view
+    struct Hash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>()(s); }
+    };
+    std::unordered_map<std::string, std::unique_ptr<AccountRisk>, Hash, std::equal_to<>> accounts;
+    struct SymbolRisk {
+        std::atomic<OrderBook::Units> referencePrice{0};
+        bool added = false;
+    };
+    InternTable& symbols = InternTable::symbols();
+    std::unique_ptr<SymbolRisk[]> symbolRisk{new SymbolRisk[InternTable::symbols().capacity()]};
+
+    // the symbol's risk state, or nullptr if not added
+    SymbolRisk* symbol(std::string_view symbol) {
+        auto id = symbols.find(symbol);
+        if (id == InternTable::NONE || !symbolRisk[id].added) return nullptr;
+        return &symbolRisk[id];
+    }
+
+    static int64_t nowSeconds() {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    const char* checkPrice(AccountRisk& account, std::string_view symbol, OrderBook::Units price, int64_t quantity) {
+        auto& limits = account.limits;
+        if (quantity <= 0) return "invalid quantity";
+        if (limits.maxOrderQty && quantity > limits.maxOrderQty) return "order quantity limit exceeded";
+        if (limits.maxNotional) {
+            OrderBook::Units notional;
+            if (__builtin_mul_overflow(price, quantity, &notional) || notional > limits.maxNotional) return "notional limit exceeded";
+        }
+        if (limits.priceBandPercent) {
+            if (auto risk = this->symbol(symbol)) {
+                auto reference = risk->referencePrice.load(std::memory_order_relaxed);
+                OrderBook::Units difference, deviation, band;
+                // a band too wide to represent admits any price whose deviation can be computed
+                bool unbounded = __builtin_mul_overflow(reference, limits.priceBandPercent, &band);
+                if (reference && (__builtin_sub_overflow(price, reference, &difference) || __builtin_mul_overflow(difference, 100, &deviation) ||
+                                  (!unbounded && (deviation > band || deviation < -band)))) {
+                    return "price outside band";
+                }
+            }
+        }
+        return nullptr;
+    }
+
+   public:
+    // the account is traded by the session whose SenderCompID is the account, and by the senders naming it in the
+    // Account (1) field
+    void addAccount(const std::string& account, const RiskLimits& limits, std::vector<std::string> senders = {}) {
+        accounts[account] = std::make_unique<AccountRisk>(limits, std::move(senders));
+    }
+    AccountRisk* account(std::string_view account) {
+        auto itr = accounts.find(account);
+        return itr == accounts.end() ? nullptr : itr->second.get();
+    }
+    // the symbol must have been added before sessions start, otherwise returns false
+    bool setReferencePrice(std::string_view symbol, OrderBook::Units price) {
+        auto risk = this->symbol(symbol);
+        if (!risk) return false;
+        risk->referencePrice.store(price, std::memory_order_relaxed);
+        return true;
+    }
+    // returns false if the symbol table is full
+    bool addSymbol(std::string_view symbol, OrderBook::Units referencePrice = 0) {
+        auto id = symbols.intern(symbol);
+        if (id == InternTable::NONE) return false;
+        symbolRisk[id].referencePrice.store(referencePrice);
+        symbolRisk[id].added = true;
+        return true;
+    }
+
+    // the account an order is checked against, the Account (1) field or the SenderCompID, or nullptr if not added or
+    // the sender may not trade it
+    AccountRisk* accountOf(const FixMessage& msg) {
+        auto sender = msg.getString(Tag::SENDER_COMP_ID);
+        auto accountId = msg.getString(1);
+        if (accountId.empty() || accountId == sender) return this->account(sender);
+        auto account = this->account(accountId);
+        return account && account->allows(sender) ? account : nullptr;
+    }
+
+    // Returns the reason the message is rejected, or nullptr if it passes the checks. An accepted NewOrderSingle
+    // holds its quantity in the account's position until it is released, see onExecution() and release(), and an
+    // accepted MassQuote adds its fills.
+    const char* check(const FixMessage& msg) {
+        auto msgType = msg.msgType();
+        bool order = msgType == NewOrderSingle::msgType;
+        if (!order && msgType != MassQuote::msgType) return nullptr;
+
+        auto account = accountOf(msg);
+        if (!account) return this->account(msg.getString(1)) ? "account not allowed" : "unknown account";
+
+        OrderBook::Units price = 0;
+        auto symbol = msg.getString(55);
+        const char* reason;
+        if (order) {
+            int64_t quantity = 0;
+            if (OrderBook::parse(msg.getString(38), quantity)) quantity /= OrderBook::SCALE;
+            // a market order has no price to check
+            if (msg.getChar(40) != '1' && !OrderBook::parse(msg.getString(44), price)) return "invalid price";
+            if ((reason = checkPrice(*account, symbol, price, quantity))) return reason;
+            auto signedQuantity = msg.getChar(54) == '2' ? -quantity : quantity;
+            if (!account->reservePosition(signedQuantity)) return "position limit exceeded";
+            // counted last, so that an order rejected by the other checks does not use up the rate
+            if (!account->countOrder(nowSeconds())) {
+                account->releasePosition(signedQuantity);
+                return "order rate limit exceeded";
+            }
+        } else {
+            for (auto [priceTag, qtyTag] : {std::pair(132, 134), std::pair(133, 135)}) {
+                int64_t quantity = 0;
+                if (!OrderBook::parse(msg.getString(qtyTag), quantity) || quantity == 0) continue;
+                if (!OrderBook::parse(msg.getString(priceTag), price)) return "invalid price";
+                quantity /= OrderBook::SCALE;
+                if ((reason = checkPrice(*account, symbol, price, quantity))) return reason;
+                // the worst case, the side filling completely, since a quote holds no position until it trades
+                if (!account->allowsPosition(qtyTag == 134 ? quantity : -quantity)) return "position limit exceeded";
+            }
+            if (!account->countOrder(nowSeconds())) return "order rate limit exceeded";
+        }
+        return nullptr;
+    }
+
+    // Update the position for the execution, whose userData is the AccountRisk from accountOf(), see
+    // OrderBook::newOrder() and OrderBook::quote(). A Canceled execution of an order releases the unfilled quantity,
+    // e.g. of a canceled order or the rest of a market order. Fills of an order do not change the position, as it
+    // already counts the order as filled, while fills of a quote are added to it.
+    static void onExecution(const OrderBook::Execution& e) {
+        if (!e.userData) return;
+        auto account = static_cast<AccountRisk*>(e.userData);
+        if (e.quote) {
+            if (e.execType == ExecType::Filled || e.execType == ExecType::PartiallyFilled) account->addPosition(e.side == OrderSide::Sell ? -e.lastQty : e.lastQty);
+        } else if (e.execType == ExecType::Canceled) {
+            account->releasePosition(e.side == OrderSide::Sell ? -e.remaining : e.remaining);
+        }
+    }
+    // release the position held by an accepted NewOrderSingle that is then rejected, e.g. by the OrderBook
+    void release(const FixMessage& msg) {
+        auto account = accountOf(msg);
+        int64_t quantity = 0;
+        if (!account || !OrderBook::parse(msg.getString(38), quantity)) return;
+        quantity /= OrderBook::SCALE;
+        account->releasePosition(msg.getChar(54) == '2' ? -quantity : quantity);
+    }
+
+    bool process(Session<>& session, const FixMessage& msg) override {
+        auto reason = check(msg);
+        if (!reason) return true;
+        FixBuilder fix;
+        auto msgType = msg.msgType();
+        auto refId = msgType == NewOrderSingle::msgType ? msg.getString(11) : msg.getString(117);
+        BusinessMessageReject::build(fix, msg.seqNum(), msgType, refId, BusinessRejectReason::Other, reason);
+        session.sendMessage(BusinessMessageReject::msgType, fix);
+        return false;
+    }
+};
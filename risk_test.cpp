@@ -0,0 +1,224 @@
+#include <limits>
+#include <sstream>
+#define BOOST_TEST_MODULE risk_test
+#include <boost/test/included/unit_test.hpp>
+
+#include "risk.h"
+
+static void order(FixMessage& msg, OrderSide side, F price, F quantity, const std::string& account = "") {
+    FixBuilder body, full;
+    NewOrderSingle::build<7>(body, "IBM", OrderType::Limit, side, price, quantity, "order");
+    if (!account.empty()) body.addField(1, account);
+    full.addField(35, NewOrderSingle::msgType);
+    full.addField(49, "CLIENT");
+    full.addBuilder(body);
+    full.addField(10, "000");
+    std::ostringstream os;
+    full.writeTo(os);
+    std::istringstream is(os.str());
+    FixMessage::parse(is, msg, GroupDefs());
+}
+
+static void quote(FixMessage& msg, F bidPrice, F bidQty, F offerPrice, F offerQty) {
+    FixBuilder body, full;
+    MassQuote::build<7>(body, "quote", "entry", "IBM", bidPrice, bidQty, offerPrice, offerQty);
+    full.addField(35, MassQuote::msgType);
+    full.addField(49, "CLIENT");
+    full.addBuilder(body);
+    full.addField(10, "000");
+    std::ostringstream os;
+    full.writeTo(os);
+    std::istringstream is(os.str());
+    FixMessage::parse(is, msg, GroupDefs());
+}
+
+BOOST_AUTO_TEST_CASE( pre_trade_risk ) {
+    PreTradeRisk risk;
+    RiskLimits limits;
+    limits.maxOrderQty = 100;
+    limits.maxNotional = 5000 * OrderBook::SCALE;
+    limits.maxPosition = 150;
+    limits.priceBandPercent = 10;
+    limits.maxOrdersPerSecond = 1000;
+    risk.addAccount("CLIENT", limits);
+    risk.addSymbol("IBM", 40 * OrderBook::SCALE);
+
+    FixMessage msg;
+    order(msg, OrderSide::Buy, F(40.0), F(100.0));
+    BOOST_TEST(risk.check(msg) == nullptr);
+    order(msg, OrderSide::Buy, F(40.0), F(101.0));
+    BOOST_TEST(std::string(risk.check(msg)) == "order quantity limit exceeded");
+    order(msg, OrderSide::Buy, F(45.0), F(10.0));
+    BOOST_TEST(std::string(risk.check(msg)) == "price outside band");
+    risk.setReferencePrice("IBM", 60 * OrderBook::SCALE);
+    order(msg, OrderSide::Buy, F(60.0), F(100.0));
+    BOOST_TEST(std::string(risk.check(msg)) == "notional limit exceeded");
+    // the position is 100 after the first order
+    order(msg, OrderSide::Buy, F(60.0), F(60.0));
+    BOOST_TEST(std::string(risk.check(msg)) == "position limit exceeded");
+    order(msg, OrderSide::Sell, F(60.0), F(60.0));
+    BOOST_TEST(risk.check(msg) == nullptr);
+    BOOST_TEST(risk.account("CLIENT")->position == 40);
+    order(msg, OrderSide::Buy, F(60.0), F(10.0), "OTHER");
+    BOOST_TEST(std::string(risk.check(msg)) == "unknown account");
+}
+
+BOOST_AUTO_TEST_CASE( account_senders ) {
+    PreTradeRisk risk;
+    RiskLimits limits;
+    limits.maxPosition = 100;
+    risk.addAccount("CLIENT", limits);
+    risk.addAccount("FUND", limits, {"CLIENT"});
+    risk.addAccount("OTHER", limits);
+
+    FixMessage msg;
+    order(msg, OrderSide::Buy, F(10.0), F(60.0), "FUND");
+    BOOST_TEST(risk.check(msg) == nullptr);
+    BOOST_TEST(risk.account("FUND")->position == 60);
+    order(msg, OrderSide::Buy, F(10.0), F(60.0), "CLIENT");
+    BOOST_TEST(risk.check(msg) == nullptr);
+    BOOST_TEST(risk.account("CLIENT")->position == 60);
+    // another account's limits cannot be used, or escaped
+    order(msg, OrderSide::Buy, F(10.0), F(60.0), "OTHER");
+    BOOST_TEST(std::string(risk.check(msg)) == "account not allowed");
+    BOOST_TEST(risk.accountOf(msg) == nullptr);
+    BOOST_TEST(risk.account("OTHER")->position == 0);
+}
+
+BOOST_AUTO_TEST_CASE( rate_counted_last ) {
+    PreTradeRisk risk;
+    RiskLimits limits;
+    limits.maxOrderQty = 100;
+    limits.maxPosition = 100;
+    limits.maxOrdersPerSecond = 1;
+    risk.addAccount("CLIENT", limits);
+
+    FixMessage msg;
+    // orders rejected by the other checks do not use up the rate
+    order(msg, OrderSide::Buy, F(10.0), F(101.0));
+    BOOST_TEST(std::string(risk.check(msg)) == "order quantity limit exceeded");
+    order(msg, OrderSide::Buy, F(10.0), F(60.0));
+    BOOST_TEST(risk.check(msg) == nullptr);
+    order(msg, OrderSide::Buy, F(10.0), F(60.0));
+    BOOST_TEST(std::string(risk.check(msg)) == "position limit exceeded");
+    // an order over the rate does not hold a position
+    order(msg, OrderSide::Sell, F(10.0), F(10.0));
+    BOOST_TEST(std::string(risk.check(msg)) == "order rate limit exceeded");
+    BOOST_TEST(risk.account("CLIENT")->position == 60);
+}
+
+BOOST_AUTO_TEST_CASE( notional_overflow ) {
+    PreTradeRisk risk;
+    RiskLimits limits;
+    limits.maxNotional = 5000 * OrderBook::SCALE;
+    risk.addAccount("CLIENT", limits);
+    FixMessage msg;
+    // the price times quantity does not fit in 64 bits
+    order(msg, OrderSide::Buy, F(900000000000.0), F(100.0));
+    BOOST_TEST(std::string(risk.check(msg)) == "notional limit exceeded");
+}
+
+BOOST_AUTO_TEST_CASE( price_band_overflow ) {
+    PreTradeRisk risk;
+    RiskLimits limits;
+    limits.priceBandPercent = 10;
+    risk.addAccount("CLIENT", limits);
+    // the reference price times the band percent does not fit in 64 bits
+    risk.addSymbol("IBM", std::numeric_limits<OrderBook::Units>::max() / 2);
+    FixMessage msg;
+    order(msg, OrderSide::Buy, F(40.0), F(10.0));
+    BOOST_TEST(std::string(risk.check(msg)) == "price outside band");
+    risk.setReferencePrice("IBM", 40 * OrderBook::SCALE);
+    BOOST_TEST(risk.check(msg) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE( release_position ) {
+    PreTradeRisk risk;
+    RiskLimits limits;
+    limits.maxPosition = 1000;
+    risk.addAccount("CLIENT", limits);
+    auto account = risk.account("CLIENT");
+    OrderBook book;
+    std::vector<OrderBook::Execution> executions;
+    auto release = [&]() {
+        for (auto& e : executions) PreTradeRisk::onExecution(e);
+        executions.clear();
+    };
+
+    FixMessage msg;
+    order(msg, OrderSide::Buy, F(10.0), F(100.0));
+    BOOST_TEST(risk.check(msg) == nullptr);
+    book.newOrder("owner", "buy", OrderSide::Buy, OrderType::Limit, 10 * OrderBook::SCALE, 100, executions, risk.accountOf(msg));
+    auto exchangeId = executions.front().exchangeId;
+    release();
+    BOOST_TEST(account->position == 100);
+
+    // a partial fill leaves the position, and the cancel releases the unfilled quantity
+    book.newOrder("other", "sell", OrderSide::Sell, OrderType::Limit, 10 * OrderBook::SCALE, 30, executions);
+    release();
+    BOOST_TEST(account->position == 100);
+    BOOST_TEST(book.cancel("owner", exchangeId, executions));
+    release();
+    BOOST_TEST(account->position == 30);
+
+    // the unfilled quantity of a market order
+    order(msg, OrderSide::Sell, F(10.0), F(50.0));
+    BOOST_TEST(risk.check(msg) == nullptr);
+    BOOST_TEST(account->position == -20);
+    book.newOrder("owner", "market", OrderSide::Sell, OrderType::Market, 0, 50, executions, risk.accountOf(msg));
+    release();
+    BOOST_TEST(account->position == 30);
+
+    // the resting orders of a disconnected owner
+    order(msg, OrderSide::Buy, F(10.0), F(40.0));
+    BOOST_TEST(risk.check(msg) == nullptr);
+    book.newOrder("owner", "resting", OrderSide::Buy, OrderType::Limit, 10 * OrderBook::SCALE, 40, executions, risk.accountOf(msg));
+    release();
+    BOOST_TEST(account->position == 70);
+    book.cancelAll("owner", &executions);
+    release();
+    BOOST_TEST(account->position == 30);
+
+    // an order the book rejects, here for a price off the tick grid
+    order(msg, OrderSide::Buy, F(10.001), F(40.0));
+    BOOST_TEST(risk.check(msg) == nullptr);
+    book.newOrder("owner", "off grid", OrderSide::Buy, OrderType::Limit, 10 * OrderBook::SCALE + 10000, 40, executions, risk.accountOf(msg));
+    BOOST_TEST((executions.front().execType == ExecType::Rejected));
+    risk.release(msg);
+    BOOST_TEST(account->position == 30);
+}
+
+BOOST_AUTO_TEST_CASE( quote_position ) {
+    PreTradeRisk risk;
+    RiskLimits limits;
+    limits.maxPosition = 100;
+    risk.addAccount("CLIENT", limits);
+    auto account = risk.account("CLIENT");
+    OrderBook book;
+    std::vector<OrderBook::Execution> executions;
+
+    FixMessage msg;
+    // each side must keep the position within the limit if it fills
+    quote(msg, F(9.0), F(101.0), F(11.0), F(10.0));
+    BOOST_TEST(std::string(risk.check(msg)) == "position limit exceeded");
+    quote(msg, F(9.0), F(80.0), F(11.0), F(80.0));
+    BOOST_TEST(risk.check(msg) == nullptr);
+    BOOST_TEST(account->position == 0);
+
+    // the quote holds no position until it trades
+    OrderBook::QuoteOrders orders;
+    BOOST_TEST(book.quote("owner", "entry", orders, 9 * OrderBook::SCALE, 80, 11 * OrderBook::SCALE, 80, executions, risk.accountOf(msg)));
+    book.newOrder("other", "sell", OrderSide::Sell, OrderType::Limit, 9 * OrderBook::SCALE, 50, executions);
+    for (auto& e : executions) PreTradeRisk::onExecution(e);
+    executions.clear();
+    BOOST_TEST(account->position == 50);
+    // the worst case now includes the fill
+    BOOST_TEST(std::string(risk.check(msg)) == "position limit exceeded");
+    quote(msg, F(9.0), F(50.0), F(11.0), F(80.0));
+    BOOST_TEST(risk.check(msg) == nullptr);
+
+    // replacing or withdrawing the quote releases nothing
+    book.cancelAll("owner", &executions);
+    for (auto& e : executions) PreTradeRisk::onExecution(e);
+    BOOST_TEST(account->position == 50);
+}
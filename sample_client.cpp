@@ -8,6 +8,7 @@
 #include <thread>
 
 #include "fix_engine.h"
+#include "initiator_pool.h"
 #include "msg_logon.h"
 #include "msg_massquote.h"
 
@@ -36,10 +37,11 @@ class MyClient : public Initiator<> {
     F askQty = 10;
     std::string symbol;
     std::chrono::time_point<std::chrono::system_clock> start;
-    std::latch& latch;
+    // counted down on disconnect, unless the client is pooled and reconnects
+    std::latch* latch;
 
    public:
-    MyClient(const sockaddr_in &server,std::string symbol,DefaultSessionConfig sessionConfig,std::latch& latch,Poller* poller=nullptr) : Initiator(server, sessionConfig, poller), symbol(symbol), latch(latch) {};
+    MyClient(const std::vector<Endpoint> &server,std::string symbol,DefaultSessionConfig sessionConfig,std::latch* latch) : Initiator(server, sessionConfig), symbol(symbol), latch(latch) {};
     void onConnected() override {
         std::cout << "client connected!, sending logon\n";
         Logon::build(fix);
@@ -72,106 +74,50 @@ class MyClient : public Initiator<> {
         std::cout << "client logged out " << text << "\n";
     }
     void onDisconnected(const Session<>& session) override {
-        latch.count_down();
+        if(latch) latch->count_down();
         Initiator::onDisconnected(session);
     }
 };
 
 void usage() {
-    std::cout << "usage: sample_client <hostname> ( <symbol> | -bench <count> ) [-fibers]\n";
+    std::cout << "usage: sample_client ( <hostname> | unix:<path> ) ( <symbol> | -bench <count> ) [-fibers] [-shm]\n";
     exit(0);
 }
 
-void doFibers(struct sockaddr_in server, int benchCount,std::string symbol) {
+// the sessions share an InitiatorPool and reconnect if disconnected, so this runs until killed
+void doFibers(const std::vector<Endpoint>& server, int benchCount,std::string symbol,Transport transport) {
     std::cout << "using fibers\n";
-    Poller poller;
-    std::thread pollerThread([&poller]() {
-        while (true) {
-            try {
-                poller.poll();
-            } catch(const std::runtime_error& err) {
-                std::cerr << "poller error: " << err.what() << "\n";
-                return;
-            }
-        }
-    });
-
-    std::vector<MyClient*> clients;
-    int workerThreads = std::max(int(std::thread::hardware_concurrency()) / 2,1);
-
-    std::vector<std::thread> workers;
-
-    boost::fibers::use_scheduling_algorithm<boost::fibers::algo::round_robin>();
-
-    typedef boost::fibers::buffered_channel<std::string> channel_t;
-    channel_t chan{2};
-
-    // benchCount is 0 if a single symbol is being quoted
-    std::latch latch(std::max(benchCount,1));
-
-    for(int i=0;i<workerThreads;i++) {
-        workers.push_back(
-        std::thread([&chan,&server,&poller,&latch,workerThreads]() {
-            boost::fibers::use_scheduling_algorithm<boost::fibers::algo::work_stealing>(workerThreads,true);
-            while(true) {
-                std::string symbol;
-                if(chan.pop(symbol)!=boost::fibers::channel_op_status::success) {
-                    return;
-                }
-                struct DefaultSessionConfig sessionConfig("CLIENT_"+symbol, config::TARGET_COMP_ID);
-                auto client = new MyClient(server,symbol,sessionConfig,latch,&poller);
-                client->connect();
-                if(client->isConnected()) {
-                    std::cout << "client connected\n";
-                    client->handle();
-                }
-            }
-        }));
+    if(transport != Transport::Socket) {
+        std::cerr << "-shm is not supported with -fibers\n";
+        exit(1);
     }
-    auto reporter = boost::fibers::fiber(
-    [&latch]() {
-        while(!latch.try_wait()) {
-            auto start = std::chrono::system_clock::now();
-            long startCount = quoteCount;
-            boost::this_fiber::sleep_for(std::chrono::seconds(5));
-            auto end = std::chrono::system_clock::now();
-            long nQuotes = quoteCount-startCount;
-            auto duration =
-                std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    InitiatorPool<> pool;
 
-            std::cout << "round-trip " << nQuotes << " quotes, usec per quote "
-                      << (duration.count() / (double)(nQuotes)) << ", quotes per sec "
-                      << (int)(((nQuotes) / (duration.count() / 1000000.0))) << "\n";
-
-        }
-    });
-
-    if(!benchCount) {
-        chan.push(symbol);
-    } else {
-        for(int i=0;i<benchCount;i++) {
-            auto symbol = std::string("S")+std::to_string(i);
-            chan.push(symbol);
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        }
+    // benchCount is 0 if a single symbol is being quoted
+    std::vector<std::unique_ptr<MyClient>> clients;
+    for(int i=0;i<std::max(benchCount,1);i++) {
+        auto _symbol = benchCount==0 ? symbol : std::string("S")+std::to_string(i);
+        struct DefaultSessionConfig sessionConfig("CLIENT_"+_symbol, config::TARGET_COMP_ID);
+        clients.push_back(std::make_unique<MyClient>(server,_symbol,sessionConfig,nullptr));
+        pool.add(*clients.back());
     }
 
-    while(!latch.try_wait()) {
-        boost::this_fiber::sleep_for(std::chrono::milliseconds(1000));
+    while(true) {
+        auto start = std::chrono::system_clock::now();
+        long startCount = quoteCount;
+        std::this_thread::sleep_for(std::chrono::seconds(5));
+        auto end = std::chrono::system_clock::now();
+        long nQuotes = quoteCount-startCount;
+        auto duration =
+            std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+
+        std::cout << "round-trip " << nQuotes << " quotes, usec per quote "
+                  << (duration.count() / (double)(nQuotes)) << ", quotes per sec "
+                  << (int)(((nQuotes) / (duration.count() / 1000000.0))) << "\n";
     }
-
-    chan.close();
-    reporter.join();
-    
-    poller.close();
-    pollerThread.join();
-
-    for(auto& worker : workers) worker.join();
-    for(auto client : clients) delete client;
-    std::cout << "all clients disconnected\n";
 }
 
-void doThreads(struct sockaddr_in server,int benchCount,std::string symbol) {
+void doThreads(const std::vector<Endpoint>& server,int benchCount,std::string symbol,Transport transport) {
     int nThreads = std::max(benchCount,1);
     std::cout << "using " << nThreads << " threads\n";
 
@@ -195,18 +141,16 @@ void doThreads(struct sockaddr_in server,int benchCount,std::string symbol) {
     });
     for(int i=0;i<nThreads;i++) {
         std::string _symbol = benchCount==0 ? symbol : std::string("S")+std::to_string(i);
-        auto thread = std::thread([&latch,_symbol,&server]() {
+        auto thread = std::thread([&latch,_symbol,&server,transport]() {
             struct DefaultSessionConfig sessionConfig("CLIENT_"+_symbol, config::TARGET_COMP_ID);
-            MyClient client(server,_symbol,sessionConfig,latch);
-            client.connect();
+            MyClient client(server,_symbol,sessionConfig,&latch);
+            client.connect(transport);
             if(client.isConnected()) {
                 std::cout << "client connected\n";
                 client.handle();
             }
         });
         thread.detach();
-        // delay between connection requests otherwise backlog exceeded
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
 
     while(!latch.try_wait()) {
@@ -219,12 +163,10 @@ void doThreads(struct sockaddr_in server,int benchCount,std::string symbol) {
 }
 
 int main(int argc, char *argv[]) {
-    struct hostent *he;
-    struct sockaddr_in server;
-
     std::string symbol = "IBM";
     int benchCount = 0;
     bool fibers = false;
+    Transport transport = Transport::Socket;
 
     if(argc < 2 || strcmp(argv[1],"-h")==0) {
         usage();
@@ -239,28 +181,35 @@ int main(int argc, char *argv[]) {
             symbol = argv[n++];
         }
     }
-    if(n<argc) {
-        if(strcmp("-fibers",argv[n++])==0) {
+    while(n<argc) {
+        if(strcmp("-fibers",argv[n])==0) {
             fibers = true;
+        } else if(strcmp("-shm",argv[n])==0) {
+            // use the shared memory transport, the server must be on the same host
+            transport = Transport::SharedMemory;
         } else {
             usage();
         }
+        n++;
     }
-    if(n!=argc) usage();
 
-    /* resolve hostname */
-    if ((he = gethostbyname(hostname)) == NULL) {
-        std::cerr << "gethostbyname failed" << hostname << "\n";
-        exit(1); /* error */
+    // the addresses of the host, tried in order
+    std::vector<Endpoint> server;
+    try {
+        // unix:<path> connects via a unix domain socket, e.g. to a sample_server started with -uds <path>
+        if(strncmp(hostname,"unix:",5)==0) {
+            server = {Endpoint::unixDomain(hostname+5)};
+        } else {
+            server = Endpoint::resolveAll(hostname,config::PORT);
+        }
+    } catch(const std::runtime_error& err) {
+        std::cerr << err.what() << "\n";
+        exit(1);
     }
 
-    memcpy(&server.sin_addr, he->h_addr_list[0], he->h_length);
-    server.sin_port = htons(config::PORT);
-    server.sin_family = AF_INET;
-
     if(fibers) {
-        doFibers(server,benchCount,symbol);
+        doFibers(server,benchCount,symbol,transport);
     } else {
-        doThreads(server,benchCount,symbol);
+        doThreads(server,benchCount,symbol,transport);
     }
 }
\ No newline at end of file
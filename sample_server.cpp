@@ -1,22 +1,161 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "exchange.h"
 #include "fix_engine.h"
-#include "msg_massquote.h"
+#include "risk.h"
 
+// matches orders and mass quotes from the clients, see Exchange, or SequencedExchange if sequenced
 class MyServer : public Acceptor<> {
+    Exchange exchange;
 public:
-    MyServer() : Acceptor(9000,DefaultSessionConfig("SERVER","*"),std::max(int(std::thread::hardware_concurrency()/2),1)){};
-    void onMessage(Session<>& session,const FixMessage& msg) {
-        if(msg.msgType()==MassQuote::msgType) {
-            FixBuilder fix(256);
-            MassQuoteAck::build(fix,msg.getString(117),0);
-            session.sendMessage(MassQuoteAck::msgType,fix);
+    MyServer(Endpoint endpoint,SequencedExchange* sequenced,PreTradeRisk* risk,bool coroutines,AuditTrail* audit,const char* symbolFile,Replicator* replicator=nullptr) : Acceptor(endpoint,sessionConfig(sequenced),std::max(int(std::thread::hardware_concurrency()/2),1),options(sequenced,coroutines,audit,symbolFile,replicator)), exchange(*this,risk,sessionSymbols(symbolFile)){
+        // checked before the orders reach either exchange, which releases the positions
+        if(risk) addStage(*risk);
+        // the application messages are then handled by the sequencer's thread rather than onMessage()
+        if(sequenced) addStage(sequenced->sequencer());
+    };
+    // with a symbol file the clients may only trade its symbols, otherwise each may add a few
+    static size_t sessionSymbols(const char* symbolFile) {
+        return symbolFile ? 0 : 100;
+    }
+    static DefaultSessionConfig sessionConfig(SequencedExchange* sequenced) {
+        DefaultSessionConfig config("SERVER","*");
+        // the sequencer's thread sends the reports, so a slow client must not block it, see Sequencer
+        if(sequenced) {
+            config.outboundHighWatermark = 1024*1024;
+            config.outboundLowWatermark = 256*1024;
+            config.outboundLimit = 16*1024*1024;
         }
+        return config;
+    }
+    static EngineOptions options(SequencedExchange* sequenced,bool coroutines,AuditTrail* audit,const char* symbolFile,Replicator* replicator) {
+        EngineOptions options;
+        // assign the symbol ids in the order of the file, see InternTable
+        if(symbolFile) options.symbolFile = symbolFile;
+        // record the messages, see audit_query
+        options.audit = audit;
+        // stream the session state to a standby, see -standby
+        options.replicator = replicator;
+        // the default is selected at build time, see make COROUTINES=1
+        if(coroutines) options.coroutines = true;
+        // allow local clients to use the shared memory transport, see sample_client -shm, unless sequenced since
+        // a write to a full ring waits for the client
+        options.sharedMemory = !sequenced;
+        return options;
+    }
+    void onMessage(Session<>& session,const FixMessage& msg) {
+        exchange.onMessage(session,msg);
+    }
+    void onDisconnected(const Session<>& session) {
+        exchange.onDisconnected(session);
+        Acceptor::onDisconnected(session);
     }
     bool validateLogon(const FixMessage& msg) {
         return true;
     }
 };
 
+void usage() {
+    std::cout << "usage: sample_server [-uds <path>] [-sequenced] [-coroutines] [-audit <directory>] [-symbols <file>]\n"
+                 "                     [-risk <accounts file>] [-primary <shm name> | -standby <shm name>]\n";
+    exit(0);
+}
+
+// the accounts of the file, one per line, each with the same sample limits, see PreTradeRisk
+std::unique_ptr<PreTradeRisk> loadRisk(const char* accountsFile) {
+    std::ifstream in(accountsFile);
+    if(!in) throw std::runtime_error(std::string("unable to open ")+accountsFile);
+    RiskLimits limits;
+    limits.maxOrdersPerSecond = 100000;
+    limits.maxOrderQty = 1000000;
+    limits.maxNotional = 100000000 * OrderBook::SCALE;
+    limits.maxPosition = 10000000;
+    auto risk = std::make_unique<PreTradeRisk>();
+    // each line is an account, followed by any other SenderCompIDs allowed to trade it
+    std::string line;
+    while(std::getline(in,line)) {
+        std::istringstream fields(line);
+        std::string account, sender;
+        if(!(fields >> account)) continue;
+        std::vector<std::string> senders;
+        while(fields >> sender) senders.push_back(sender);
+        risk->addAccount(account,limits,std::move(senders));
+    }
+    return risk;
+}
+
 int main(int argc, char* argv[]) {
-    MyServer server;
+    const char* udsPath = nullptr;
+    bool sequenced = false;
+    bool coroutines = false;
+    const char* auditDirectory = nullptr;
+    const char* symbolFile = nullptr;
+    const char* primaryName = nullptr;
+    const char* standbyName = nullptr;
+    const char* accountsFile = nullptr;
+    for(int n=1;n<argc;n++) {
+        if(strcmp(argv[n],"-uds")==0 && n+1<argc) {
+            udsPath = argv[++n];
+        } else if(strcmp(argv[n],"-sequenced")==0) {
+            sequenced = true;
+        } else if(strcmp(argv[n],"-coroutines")==0) {
+            coroutines = true;
+        } else if(strcmp(argv[n],"-audit")==0 && n+1<argc) {
+            auditDirectory = argv[++n];
+        } else if(strcmp(argv[n],"-symbols")==0 && n+1<argc) {
+            symbolFile = argv[++n];
+        } else if(strcmp(argv[n],"-risk")==0 && n+1<argc) {
+            accountsFile = argv[++n];
+        } else if(strcmp(argv[n],"-primary")==0 && n+1<argc) {
+            primaryName = argv[++n];
+        } else if(strcmp(argv[n],"-standby")==0 && n+1<argc) {
+            standbyName = argv[++n];
+        } else {
+            usage();
+        }
+    }
+    // the accounts are shared by both acceptors, so a client is limited across its connections
+    std::unique_ptr<PreTradeRisk> risk;
+    if(accountsFile) risk = loadRisk(accountsFile);
+    // a single business logic thread shared by both acceptors
+    std::unique_ptr<SequencedExchange> sequencedExchange;
+    if(sequenced) {
+        sequencedExchange = std::make_unique<SequencedExchange>(risk.get(),MyServer::sessionSymbols(symbolFile));
+        sequencedExchange->sequencer().start();
+    }
+    std::unique_ptr<AuditTrail> audit;
+    if(auditDirectory) {
+        AuditOptions auditOptions;
+        auditOptions.directory = auditDirectory;
+        audit = std::make_unique<AuditTrail>(auditOptions);
+    }
+    // optionally also accept clients on a unix domain socket, see sample_client unix:<path>
+    std::unique_ptr<MyServer> udsServer;
+    std::thread udsThread;
+    if(udsPath) {
+        udsServer = std::make_unique<MyServer>(Endpoint::unixDomain(udsPath),sequencedExchange.get(),risk.get(),coroutines,audit.get(),symbolFile);
+        udsThread = std::thread([&udsServer]() { udsServer->listen(); });
+    }
+    std::unique_ptr<Replicator> replicator;
+    if(primaryName) replicator = Replicator::create(primaryName);
+    MyServer server(Endpoint::tcp(9000),sequencedExchange.get(),risk.get(),coroutines,audit.get(),symbolFile,replicator.get());
+    if(standbyName) {
+        // follow the primary until it exits, then continue its sessions on the same port
+        auto standby = Standby::open(standbyName);
+        Logger::info("standby for {}", standbyName);
+        while(standby->primaryAlive()) {
+            standby->poll();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        Logger::info("taking over {} sessions, {} records lost", standby->sessions().size(), standby->lost());
+        server.takeover(*standby);
+    }
     server.listen();
-}
\ No newline at end of file
+    if(udsThread.joinable()) udsThread.join();
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "affinity.h"
+#include "fix_engine.h"
+
+// A pre-allocated multi-producer, single consumer ring in the style of the LMAX Disruptor. A producer claims a
+// sequence with a single atomic increment, fills the slot in place and publishes it by storing the sequence in
+// the slot. The consumer reads the slots in sequence order without any lock, and releases them in batches.
+// An idle consumer can block in waitForPublish(), then the producers wake it (a system call) until it resumes.
+template <typename T>
+class SequencedRing {
+    struct alignas(64) Slot {
+        std::atomic<int64_t> published{-1};
+        T value;
+    };
+    const int64_t capacity;
+    std::unique_ptr<Slot[]> slots;
+    alignas(64) std::atomic<int64_t> claimed{0};
+    // the next sequence to consume, written by the consumer
+    alignas(64) std::atomic<int64_t> consumed{0};
+    alignas(64) std::atomic<bool> consumerWaiting{false};
+
+   public:
+    // the capacity must be a power of two
+    SequencedRing(int64_t capacity) : capacity(capacity), slots(new Slot[capacity]) {
+        if (capacity <= 0 || (capacity & (capacity - 1))) throw std::invalid_argument("capacity must be a power of two");
+    }
+
+    // claim the next sequence, waiting while the ring is full, and publish the slot after fill(T&) returns
+    template <typename Fn>
+    void publish(Fn&& fill) {
+        auto sequence = claimed.fetch_add(1, std::memory_order_relaxed);
+        while (sequence - consumed.load(std::memory_order_acquire) >= capacity) {
+            boost::this_fiber::yield();
+        }
+        auto& slot = slots[sequence & (capacity - 1)];
+        fill(slot.value);
+        slot.published.store(sequence, std::memory_order_seq_cst);
+        if (consumerWaiting.load(std::memory_order_seq_cst)) slot.published.notify_one();
+    }
+    // call fn(T&) for up to max published values in sequence order, returns the number consumed
+    template <typename Fn>
+    size_t consume(Fn&& fn, size_t max = 256) {
+        auto next = consumed.load(std::memory_order_relaxed);
+        size_t n = 0;
+        while (n < max) {
+            auto& slot = slots[next & (capacity - 1)];
+            if (slot.published.load(std::memory_order_acquire) != next) break;
+            fn(slot.value);
+            next++;
+            n++;
+        }
+        if (n) consumed.store(next, std::memory_order_release);
+        return n;
+    }
+    // block the consumer until the next value is published
+    void waitForPublish() {
+        auto next = consumed.load(std::memory_order_relaxed);
+        auto& slot = slots[next & (capacity - 1)];
+        consumerWaiting.store(true, std::memory_order_seq_cst);
+        auto published = slot.published.load(std::memory_order_seq_cst);
+        // returns immediately if the value changed since it was loaded
+        if (published != next) slot.published.wait(published);
+        consumerWaiting.store(false, std::memory_order_relaxed);
+    }
+};
+
+// an opaque reference to a logged on session, which is never reused
+typedef uint64_t SessionHandle;
+
+// The application logic run by a Sequencer on its single thread, so it needs no locks.
+struct BusinessLogic {
+    // the sessionId is empty if the session has already disconnected
+    virtual void onLoggedOn(SessionHandle session, const std::string& sessionId) {}
+    virtual void onMessage(SessionHandle session, const FixMessage& msg) = 0;
+    // no messages can be sent to the session
+    virtual void onDisconnected(SessionHandle session) {}
+};
+
+// A MessageStage which publishes the application messages of all sessions into a SequencedRing, consumed by a
+// single business logic thread, rather than calling SessionHandler::onMessage() on the session's thread. The
+// business logic responds using send() with the session's handle. Session level messages (Logon, Logout,
+// Heartbeat, etc.) are passed to the SessionHandler as usual.
+//
+// A send must not wait for a slow consumer, as that would stall every session, so the sessions must be
+// non-blocking (a non-zero outboundHighWatermark, and not shared memory). Other sessions are terminated on logon.
+class Sequencer : public MessageStage<> {
+    // the slots are reused, so the message is copied into the slot's existing storage
+    struct Event {
+        enum Type { LoggedOn, Message, Disconnected, Stop } type;
+        SessionHandle session;
+        FixMessage msg;
+    };
+    struct Slot {
+        Session<>* session = nullptr;
+        // a handle is never 0, see Session::userData
+        uint32_t generation = 1;
+        std::string id;
+    };
+
+    BusinessLogic& logic;
+    SequencedRing<Event> ring;
+    // the logged on sessions by handle index, the lock is held while sending so a session cannot be destroyed
+    std::shared_mutex sessionsLock;
+    std::vector<Slot> sessions;
+    std::vector<uint32_t> freeSlots;
+    std::thread thread;
+
+    static bool isSessionLevel(std::string_view msgType) {
+        return msgType.size() == 1 && strchr("012345A", msgType[0]);
+    }
+    static uint32_t indexOf(SessionHandle handle) { return uint32_t(handle); }
+    static uint32_t generationOf(SessionHandle handle) { return uint32_t(handle >> 32); }
+
+    void run(int cpu) {
+        if (cpu >= 0 && !Affinity::pin(cpu)) Logger::error("unable to pin sequencer to cpu {}", cpu);
+        // spinning is pointless with a single cpu
+        static const int spinCount = std::thread::hardware_concurrency() > 1 ? 10000 : 0;
+        int idle = 0;
+        bool running = true;
+        while (running) {
+            auto n = ring.consume([&](Event& event) {
+                switch (event.type) {
+                    case Event::LoggedOn:
+                        logic.onLoggedOn(event.session, sessionId(event.session));
+                        break;
+                    case Event::Message:
+                        logic.onMessage(event.session, event.msg);
+                        break;
+                    case Event::Disconnected:
+                        logic.onDisconnected(event.session);
+                        break;
+                    case Event::Stop:
+                        running = false;
+                        break;
+                }
+            });
+            // busy spin while messages are arriving, then block
+            if (n) {
+                idle = 0;
+            } else if (++idle > spinCount) {
+                ring.waitForPublish();
+                idle = 0;
+            }
+        }
+    }
+
+   public:
+    // the ring capacity must be a power of two
+    Sequencer(BusinessLogic& logic, int64_t capacity = 64 * 1024) : logic(logic), ring(capacity) {}
+    ~Sequencer() { stop(); }
+
+    // start the business logic thread, pinned to the cpu if not -1 (Linux only)
+    void start(int cpu = -1) {
+        thread = std::thread(&Sequencer::run, this, cpu);
+    }
+    // stop the thread after the events published so far are consumed
+    void stop() {
+        if (!thread.joinable()) return;
+        ring.publish([](Event& event) { event.type = Event::Stop; });
+        thread.join();
+    }
+
+    // send a message to the session, returns false if the session has disconnected. The msg is reset. Never waits
+    // for the peer, the bytes the socket does not accept are buffered by the session.
+    bool send(SessionHandle handle, const std::string& msgType, FixBuilder& msg) {
+        std::shared_lock<std::shared_mutex> mu(sessionsLock);
+        auto index = indexOf(handle);
+        if (index >= sessions.size() || sessions[index].generation != generationOf(handle) || !sessions[index].session) {
+            msg.reset();
+            return false;
+        }
+        sessions[index].session->sendMessage(msgType, msg);
+        return true;
+    }
+    std::string sessionId(SessionHandle handle) {
+        std::shared_lock<std::shared_mutex> mu(sessionsLock);
+        auto index = indexOf(handle);
+        if (index >= sessions.size() || sessions[index].generation != generationOf(handle)) return "";
+        return sessions[index].id;
+    }
+
+    bool process(Session<>& session, const FixMessage& msg) override {
+        if (isSessionLevel(msg.msgType()) || !session.userData) return true;
+        ring.publish([&](Event& event) {
+            event.type = Event::Message;
+            event.session = session.userData;
+            event.msg = msg;
+        });
+        return false;
+    }
+    void onLoggedOn(Session<>& session) override {
+        // terminates the session
+        if (!session.isNonBlocking()) throw std::runtime_error("sequenced sessions require an outboundHighWatermark");
+        {
+            std::unique_lock<std::shared_mutex> mu(sessionsLock);
+            uint32_t index;
+            if (freeSlots.empty()) {
+                index = sessions.size();
+                sessions.emplace_back();
+            } else {
+                index = freeSlots.back();
+                freeSlots.pop_back();
+            }
+            auto& slot = sessions[index];
+            slot.session = &session;
+            slot.id = session.id();
+            session.userData = (SessionHandle(slot.generation) << 32) | index;
+        }
+        ring.publish([&](Event& event) {
+            event.type = Event::LoggedOn;
+            event.session = session.userData;
+        });
+    }
+    void onDisconnected(Session<>& session) override {
+        if (!session.userData) return;
+        {
+            std::unique_lock<std::shared_mutex> mu(sessionsLock);
+            auto index = indexOf(session.userData);
+            sessions[index].session = nullptr;
+            if (++sessions[index].generation == 0) sessions[index].generation = 1;
+            freeSlots.push_back(index);
+        }
+        ring.publish([&](Event& event) {
+            event.type = Event::Disconnected;
+            event.session = session.userData;
+        });
+        session.userData = 0;
+    }
+};
@@ -0,0 +1,31 @@
+#define BOOST_TEST_MODULE sequencer_test
+#include <boost/test/included/unit_test.hpp>
+
+#include <thread>
+#include <vector>
+
+#include "sequencer.h"
+
+BOOST_AUTO_TEST_CASE( sequenced_ring ) {
+    SequencedRing<std::pair<int, int>> ring(64);
+    const int producers = 4, count = 10000;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&ring, p]() {
+            for (int i = 0; i < count; i++) ring.publish([&](auto& value) { value = {p, i}; });
+        });
+    }
+    // each producer's values are consumed in the order published
+    std::vector<int> next(producers);
+    int consumed = 0;
+    while (consumed < producers * count) {
+        auto n = ring.consume([&](auto& value) {
+            BOOST_REQUIRE_EQUAL(value.second, next[value.first]++);
+        });
+        if (!n) ring.waitForPublish();
+        consumed += n;
+    }
+    for (auto& thread : threads) thread.join();
+    for (int p = 0; p < producers; p++) BOOST_TEST(next[p] == count);
+    BOOST_CHECK_THROW(SequencedRing<int>(100), std::invalid_argument);
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// The shared state of a single producer/single consumer byte ring in shared memory, read and written through a
+// ShmRingView. Positions increase monotonically, and the capacity is a power of two. The data immediately follows
+// the ring header.
+struct ShmRing {
+    alignas(64) std::atomic<uint64_t> head{0};  // written by the producer
+    alignas(64) std::atomic<uint64_t> tail{0};  // written by the consumer
+    // set by the consumer before it waits for the doorbell, see ShmChannel
+    alignas(64) std::atomic<bool> readerWaiting{false};
+    // set by the creator, only read when attaching, see ShmRingView
+    std::atomic<uint64_t> capacity{0};
+};
+
+// The producer's or the consumer's end of a ShmRing. The peer can write the shared memory at any time, so the view
+// uses private copies of the capacity and of its own position, and checks the peer's position against them. A peer
+// position more than the capacity away breaks the ring, which then reads and writes nothing, see broken().
+class ShmRingView {
+    ShmRing* ring = nullptr;
+    char* data = nullptr;
+    uint64_t capacity = 0;
+    // the head for the producer, the tail for the consumer
+    uint64_t position = 0;
+    bool isBroken = false;
+
+    // the bytes between the positions, returns false if the ring is broken
+    bool distance(uint64_t h, uint64_t t, uint64_t& n) {
+        n = h - t;
+        if (n > capacity) isBroken = true;
+        return !isBroken;
+    }
+    void copyIn(uint64_t pos, const char* src, size_t len) {
+        auto offset = pos & (capacity - 1);
+        auto first = std::min(len, size_t(capacity - offset));
+        memcpy(data + offset, src, first);
+        memcpy(data, src + first, len - first);
+    }
+
+   public:
+    ShmRingView() = default;
+    // the capacity must be a power of two and the mapping must hold the ring's data
+    ShmRingView(ShmRing* ring, uint64_t capacity, bool producer)
+        : ring(ring), data(reinterpret_cast<char*>(ring) + sizeof(ShmRing)), capacity(capacity),
+          position(producer ? ring->head.load(std::memory_order_relaxed) : ring->tail.load(std::memory_order_relaxed)) {}
+
+    // returns the number of bytes written, which is less than len if the ring is full
+    size_t write(const char* src, size_t len) {
+        uint64_t used;
+        if (!distance(position, ring->tail.load(std::memory_order_acquire), used)) return 0;
+        len = std::min(len, size_t(capacity - used));
+        copyIn(position, src, len);
+        position += len;
+        ring->head.store(position, std::memory_order_release);
+        return len;
+    }
+    // returns the number of bytes read, 0 if the ring is empty
+    size_t read(char* dst, size_t len) {
+        uint64_t available;
+        if (!distance(ring->head.load(std::memory_order_acquire), position, available)) return 0;
+        len = std::min(len, size_t(available));
+        auto offset = position & (capacity - 1);
+        auto first = std::min(len, size_t(capacity - offset));
+        memcpy(dst, data + offset, first);
+        memcpy(dst + first, data, len - first);
+        position += len;
+        ring->tail.store(position, std::memory_order_release);
+        return len;
+    }
+    // write all the buffers, published to the reader at once, or nothing if they do not fit
+    bool writeAll(const struct iovec* iov, int count) {
+        size_t len = 0;
+        for (int i = 0; i < count; i++) len += iov[i].iov_len;
+        uint64_t used;
+        if (!distance(position, ring->tail.load(std::memory_order_acquire), used) || len > capacity - used) return false;
+        for (int i = 0; i < count; i++) {
+            copyIn(position, static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+            position += iov[i].iov_len;
+        }
+        ring->head.store(position, std::memory_order_release);
+        return true;
+    }
+    // the number of bytes that can be read, called by the consumer
+    size_t size() {
+        uint64_t available;
+        return distance(ring->head.load(std::memory_order_acquire), position, available) ? available : 0;
+    }
+    bool empty() {
+        return size() == 0;
+    }
+    // true once the peer moved its position out of range, the ring can no longer be used
+    bool broken() const {
+        return isBroken;
+    }
+    std::atomic<bool>& readerWaiting() {
+        return ring->readerWaiting;
+    }
+};
+
+// A pair of rings in a named shared memory segment, used as the transport for a session between processes on
+// the same host. The session's socket is kept for the lifecycle of the connection (logon handshake, disconnect)
+// and as a doorbell: a reader spins on an empty ring, then sets readerWaiting and waits for the socket to be
+// readable. A writer sends a single byte on the socket only if the reader is waiting, so while both sides are
+// busy no system calls are made.
+//
+// The initiator creates the segment and sends the HELLO with the segment name before any FIX messages, the
+// acceptor maps it, unlinks the name and replies with the ACK byte.
+class ShmChannel {
+    void* base = nullptr;
+    size_t length = 0;
+    ShmRingView inbound;
+    ShmRingView outbound;
+
+    static size_t ringSize(size_t capacity) { return sizeof(ShmRing) + capacity; }
+
+    // the capacity is the creator's, or the one validated by open(), never read again from the segment
+    ShmChannel(void* base, size_t length, size_t capacity, bool creator) : base(base), length(length) {
+        auto first = static_cast<ShmRing*>(base);
+        auto second = reinterpret_cast<ShmRing*>(static_cast<char*>(base) + ringSize(capacity));
+        if (creator) {
+            new (first) ShmRing();
+            new (second) ShmRing();
+            first->capacity = capacity;
+            second->capacity = capacity;
+        }
+        // the first ring carries initiator to acceptor messages
+        inbound = ShmRingView(creator ? second : first, capacity, false);
+        outbound = ShmRingView(creator ? first : second, capacity, true);
+    }
+
+   public:
+    static constexpr const char HELLO_PREFIX[] = "#SHM ";
+    static const int HELLO_LENGTH = 64;
+    static const char ACK = '#';
+    // iterations to spin on an empty ring before waiting on the doorbell, spinning is pointless with a single cpu
+    static int spinCount() {
+        static const int count = std::thread::hardware_concurrency() > 1 ? 2000 : 0;
+        return count;
+    }
+
+    ~ShmChannel() {
+        if (base) ::munmap(base, length);
+    }
+    ShmChannel(const ShmChannel&) = delete;
+    ShmChannel& operator=(const ShmChannel&) = delete;
+
+    // create a new segment with rings of the given capacity, which must be a power of two
+    static ShmChannel* create(const std::string& name, size_t capacity = 1024 * 1024) {
+        auto length = ringSize(capacity) * 2;
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) throw std::runtime_error("unable to create shared memory " + name);
+        if (ftruncate(fd, length) < 0) {
+            ::close(fd);
+            shm_unlink(name.c_str());
+            throw std::runtime_error("unable to size shared memory " + name);
+        }
+        void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            throw std::runtime_error("unable to map shared memory " + name);
+        }
+        return new ShmChannel(base, length, capacity, true);
+    }
+    // map a segment created by the peer, and remove its name. The name must be one from uniqueName(), and the
+    // segment must be owned by this user and hold a valid pair of rings, else it is left as is
+    static ShmChannel* open(const std::string& name) {
+        if (!isUniqueName(name)) throw std::runtime_error("invalid shared memory name " + name);
+        int fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0) throw std::runtime_error("unable to open shared memory " + name);
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            ::close(fd);
+            throw std::runtime_error("unable to stat shared memory " + name);
+        }
+        if (st.st_uid != geteuid() || size_t(st.st_size) < ringSize(1) * 2) {
+            ::close(fd);
+            throw std::runtime_error("invalid shared memory " + name);
+        }
+        void* base = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) throw std::runtime_error("unable to map shared memory " + name);
+        uint64_t capacity = static_cast<ShmRing*>(base)->capacity.load();
+        if (capacity == 0 || (capacity & (capacity - 1)) || capacity > size_t(st.st_size) || size_t(st.st_size) != ringSize(capacity) * 2) {
+            ::munmap(base, st.st_size);
+            throw std::runtime_error("invalid shared memory " + name);
+        }
+        shm_unlink(name.c_str());
+        return new ShmChannel(base, st.st_size, capacity, false);
+    }
+    // true if the name has the form of uniqueName(), i.e. /cppfix.<pid>.<n>
+    static bool isUniqueName(std::string_view name) {
+        static constexpr std::string_view prefix = "/cppfix.";
+        if (!name.starts_with(prefix)) return false;
+        name.remove_prefix(prefix.size());
+        auto dot = name.find('.');
+        if (dot == std::string_view::npos) return false;
+        auto digits = [](std::string_view s) {
+            return !s.empty() && s.size() <= 10 && std::all_of(s.begin(), s.end(), [](char c) { return c >= '0' && c <= '9'; });
+        };
+        return digits(name.substr(0, dot)) && digits(name.substr(dot + 1));
+    }
+    // a name unique to this process
+    static std::string uniqueName() {
+        static std::atomic<int> counter = 0;
+        return "/cppfix." + std::to_string(getpid()) + "." + std::to_string(counter++);
+    }
+    static void hello(char (&buffer)[HELLO_LENGTH], const std::string& name) {
+        memset(buffer, 0, HELLO_LENGTH);
+        snprintf(buffer, HELLO_LENGTH, "%s%s", HELLO_PREFIX, name.c_str());
+    }
+
+    ShmRingView& in() { return inbound; }
+    ShmRingView& out() { return outbound; }
+    // true once the peer corrupted a ring, the session must disconnect
+    bool broken() const { return inbound.broken() || outbound.broken(); }
+
+    // called by the reader after spinning, returns true if the reader must wait for the doorbell,
+    // or false if data arrived in the meantime
+    bool prepareWait() {
+        inbound.readerWaiting().store(true, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!inbound.empty()) {
+            inbound.readerWaiting().store(false, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+    // called by the writer after writing, returns true if the doorbell must be rung
+    bool needsDoorbell() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return outbound.readerWaiting().load(std::memory_order_relaxed) && outbound.readerWaiting().exchange(false);
+    }
+};
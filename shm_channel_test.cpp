@@ -0,0 +1,166 @@
+#define BOOST_TEST_MODULE shm_channel_test
+#include <boost/test/included/unit_test.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shm_channel.h"
+
+static const size_t CAPACITY = 1024;
+
+// a ring and its data in private memory, with both ends
+struct TestRing {
+    std::vector<char> memory = std::vector<char>(sizeof(ShmRing) + CAPACITY + 64);
+    ShmRing* ring;
+    ShmRingView producer;
+    ShmRingView consumer;
+    TestRing() {
+        // the data follows the 64 byte aligned header
+        auto aligned = (reinterpret_cast<uintptr_t>(memory.data()) + 63) & ~uintptr_t(63);
+        ring = new (reinterpret_cast<void*>(aligned)) ShmRing();
+        ring->capacity = CAPACITY;
+        producer = ShmRingView(ring, CAPACITY, true);
+        consumer = ShmRingView(ring, CAPACITY, false);
+    }
+};
+
+BOOST_AUTO_TEST_CASE( wrap_around ) {
+    TestRing test;
+    std::string chunk(300, 'x');
+    std::string received(300, 0);
+    // 300 does not divide the capacity, so the writes and reads wrap at different offsets
+    for (int i = 0; i < 20; i++) {
+        for (auto& c : chunk) c = char('a' + (i + (&c - chunk.data())) % 26);
+        BOOST_TEST(test.producer.write(chunk.data(), chunk.size()) == chunk.size());
+        BOOST_TEST(test.consumer.size() == chunk.size());
+        BOOST_TEST(test.consumer.read(received.data(), received.size()) == chunk.size());
+        BOOST_TEST(received == chunk);
+        BOOST_TEST(test.consumer.empty());
+    }
+    BOOST_TEST(test.ring->head.load() == 6000u);
+}
+
+BOOST_AUTO_TEST_CASE( full_ring ) {
+    TestRing test;
+    std::string data(CAPACITY + 100, 'x');
+    BOOST_TEST(test.producer.write(data.data(), data.size()) == CAPACITY);
+    BOOST_TEST(test.producer.write(data.data(), 1) == 0u);
+    struct iovec iov[1] = {{data.data(), 1}};
+    BOOST_TEST(!test.producer.writeAll(iov, 1));
+    std::vector<char> received(100);
+    BOOST_TEST(test.consumer.read(received.data(), received.size()) == 100u);
+    iov[0].iov_len = 100;
+    BOOST_TEST(test.producer.writeAll(iov, 1));
+    BOOST_TEST(test.consumer.size() == CAPACITY);
+    BOOST_TEST(!test.producer.broken());
+    BOOST_TEST(!test.consumer.broken());
+}
+
+BOOST_AUTO_TEST_CASE( hostile_peer ) {
+    // the views keep the capacity they attached with
+    TestRing test;
+    test.ring->capacity = 1 << 30;
+    std::vector<char> buffer(4096);
+    BOOST_TEST(test.producer.write(buffer.data(), buffer.size()) == CAPACITY);
+
+    // a producer moving the head more than the capacity ahead breaks the ring
+    TestRing ahead;
+    ahead.ring->head = CAPACITY + 1;
+    BOOST_TEST(ahead.consumer.read(buffer.data(), buffer.size()) == 0u);
+    BOOST_TEST(ahead.consumer.broken());
+    ahead.ring->head = 1;
+    BOOST_TEST(ahead.consumer.read(buffer.data(), buffer.size()) == 0u);
+
+    // as does a consumer moving the tail past the head
+    TestRing behind;
+    behind.ring->tail = 10;
+    BOOST_TEST(behind.producer.write(buffer.data(), 1) == 0u);
+    BOOST_TEST(behind.producer.broken());
+}
+
+static std::string segmentName() {
+    return ShmChannel::uniqueName();
+}
+
+BOOST_AUTO_TEST_CASE( channel ) {
+    auto name = segmentName();
+    std::unique_ptr<ShmChannel> initiator(ShmChannel::create(name, CAPACITY));
+    std::unique_ptr<ShmChannel> acceptor(ShmChannel::open(name));
+    // the name is removed once opened
+    BOOST_CHECK_THROW(ShmChannel::open(name), std::runtime_error);
+
+    char buffer[16];
+    BOOST_TEST(initiator->out().write("ping", 4) == 4u);
+    BOOST_TEST(acceptor->in().read(buffer, sizeof(buffer)) == 4u);
+    BOOST_TEST(std::string(buffer, 4) == "ping");
+    BOOST_TEST(acceptor->out().write("pong", 4) == 4u);
+    BOOST_TEST(initiator->in().read(buffer, sizeof(buffer)) == 4u);
+    BOOST_TEST(std::string(buffer, 4) == "pong");
+    BOOST_TEST(!initiator->broken());
+    BOOST_TEST(!acceptor->broken());
+}
+
+BOOST_AUTO_TEST_CASE( doorbell ) {
+    auto name = segmentName();
+    std::unique_ptr<ShmChannel> initiator(ShmChannel::create(name, CAPACITY));
+    std::unique_ptr<ShmChannel> acceptor(ShmChannel::open(name));
+
+    // no doorbell while the reader is not waiting
+    BOOST_TEST(!initiator->needsDoorbell());
+    // the reader waits on an empty ring, and the writer then rings once
+    BOOST_TEST(acceptor->prepareWait());
+    BOOST_TEST(initiator->out().write("x", 1) == 1u);
+    BOOST_TEST(initiator->needsDoorbell());
+    BOOST_TEST(!initiator->needsDoorbell());
+    // with data pending the reader does not wait
+    BOOST_TEST(!acceptor->prepareWait());
+    BOOST_TEST(!initiator->needsDoorbell());
+}
+
+BOOST_AUTO_TEST_CASE( hello ) {
+    char hello[ShmChannel::HELLO_LENGTH];
+    ShmChannel::hello(hello, "/cppfix.1.2");
+    BOOST_TEST(std::string(hello) == std::string(ShmChannel::HELLO_PREFIX) + "/cppfix.1.2");
+    BOOST_TEST(hello[ShmChannel::HELLO_LENGTH - 1] == 0);
+    // a name too long is truncated rather than overflowing
+    ShmChannel::hello(hello, std::string(100, 'x'));
+    BOOST_TEST(strlen(hello) == size_t(ShmChannel::HELLO_LENGTH - 1));
+}
+
+BOOST_AUTO_TEST_CASE( invalid_segment ) {
+    auto name = segmentName();
+    BOOST_CHECK_THROW(ShmChannel::open(name), std::runtime_error);
+    for (uint64_t capacity : {uint64_t(0), uint64_t(1000), uint64_t(1) << 62}) {
+        std::unique_ptr<ShmChannel> channel(ShmChannel::create(name, CAPACITY));
+        int fd = shm_open(name.c_str(), O_RDWR, 0600);
+        BOOST_REQUIRE(fd >= 0);
+        auto ring = static_cast<ShmRing*>(mmap(nullptr, sizeof(ShmRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+        ::close(fd);
+        ring->capacity = capacity;
+        munmap(ring, sizeof(ShmRing));
+        BOOST_CHECK_THROW(ShmChannel::open(name), std::runtime_error);
+        // only a valid segment is unlinked
+        BOOST_TEST(shm_unlink(name.c_str()) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( segment_names ) {
+    BOOST_TEST(ShmChannel::isUniqueName(ShmChannel::uniqueName()));
+    BOOST_TEST(ShmChannel::isUniqueName("/cppfix.123.0"));
+    for (auto name : {"/cppfix.replica", "/fix.replica", "/cppfix.123", "/cppfix.123.", "/cppfix..1", "/cppfix.1.2.3", "/cppfix.1/../x.2"}) {
+        BOOST_TEST(!ShmChannel::isUniqueName(name));
+    }
+    // another segment of the acceptor, e.g. a Replicator's, is neither opened nor unlinked
+    std::string name = "/cppfix.shm_channel_test." + std::to_string(getpid());
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+    BOOST_REQUIRE(fd >= 0);
+    ::close(fd);
+    BOOST_CHECK_THROW(ShmChannel::open(name), std::runtime_error);
+    BOOST_TEST(shm_unlink(name.c_str()) == 0);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86 1
+#endif
+
+// Byte scanning kernels for the framing and checksum of messages, with a scalar version, an SSE2 version (part of the
+// x86-64 baseline) and an AVX2 version selected at runtime if the cpu supports it. Other architectures use the scalar
+// versions. SSE4.2 string instructions (pcmpestri) are slower than SSE2 compares for a single byte, so are not used.
+namespace simd {
+
+enum class Level { Scalar, SSE2, AVX2 };
+
+inline const char* name(Level level) {
+    switch (level) {
+        case Level::SSE2: return "sse2";
+        case Level::AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+namespace scalar {
+// the offset of the first c in p, or len if not found
+inline size_t find(const char* p, size_t len, char c) {
+    for (size_t i = 0; i < len; i++) {
+        if (p[i] == c) return i;
+    }
+    return len;
+}
+// the sum of the bytes, the FIX CheckSum is the sum modulo 256
+inline uint32_t sum(const char* p, size_t len) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < len; i++) sum += uint8_t(p[i]);
+    return sum;
+}
+}  // namespace scalar
+
+#ifdef SIMD_X86
+namespace sse2 {
+__attribute__((target("sse2"))) inline size_t find(const char* p, size_t len, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        auto mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)), needle));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + scalar::find(p + i, len - i, c);
+}
+__attribute__((target("sse2"))) inline uint32_t sum(const char* p, size_t len) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    size_t i = 0;
+    // psadbw sums each 8 bytes into a 64 bit lane
+    for (; i + 16 <= len; i += 16) acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)), zero));
+    uint32_t sum = _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+    return sum + scalar::sum(p + i, len - i);
+}
+}  // namespace sse2
+
+namespace avx2 {
+__attribute__((target("avx2"))) inline size_t find(const char* p, size_t len, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)), needle));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + sse2::find(p + i, len - i, c);
+}
+__attribute__((target("avx2"))) inline uint32_t sum(const char* p, size_t len) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = zero;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)), zero));
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    uint32_t sum = _mm_cvtsi128_si32(half) + _mm_cvtsi128_si32(_mm_srli_si128(half, 8));
+    return sum + sse2::sum(p + i, len - i);
+}
+}  // namespace avx2
+#endif
+
+// the best level supported by the cpu
+inline Level detect() {
+#ifdef SIMD_X86
+    if (__builtin_cpu_supports("avx2")) return Level::AVX2;
+    return Level::SSE2;
+#else
+    return Level::Scalar;
+#endif
+}
+
+// the kernels for a level, those for the cpu are selected once by kernels()
+struct Kernels {
+    size_t (*find)(const char*, size_t, char);
+    uint32_t (*sum)(const char*, size_t);
+
+    static Kernels of(Level level) {
+#ifdef SIMD_X86
+        if (level == Level::AVX2) return {avx2::find, avx2::sum};
+        if (level == Level::SSE2) return {sse2::find, sse2::sum};
+#endif
+        return {scalar::find, scalar::sum};
+    }
+};
+
+inline const Kernels& kernels() {
+    static const Kernels kernels = Kernels::of(detect());
+    return kernels;
+}
+
+// the offset of the first c in p, or len if not found
+inline size_t find(const char* p, size_t len, char c) { return kernels().find(p, len, c); }
+// the sum of the bytes
+inline uint32_t sum(const char* p, size_t len) { return kernels().sum(p, len); }
+
+}  // namespace simd
@@ -1,61 +1,337 @@
 #pragma once
 
 #include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <boost/fiber/all.hpp>
 
+#include "audit.h"
+#include "replication.h"
+#include "buffer_pool.h"
 #include "park_unpark.h"
+#include "shm_channel.h"
+#include "simd.h"
 
+// The Socketbuf is the single owner of the socket, and closes it when destroyed. The input and
+// output buffers are taken from the pool on first use. In borrow mode they are returned to the
+// pool whenever they are drained, i.e. before parking on a read and after each flush.
+//
+// By default a write parks until the socket is writable. In non-blocking mode a write never parks,
+// the bytes the socket does not accept are held in the outbound buffer until drain() is called.
+//
+// Once a ShmChannel is attached the data is read and written using its rings, and the socket is only
+// used for the doorbell. Writes to a full ring always wait for the reader, regardless of the mode.
 class Socketbuf : public std::streambuf {
 public:
-    Socketbuf(int fd,ParkSupport& ps) : sockfd(fd), ps(ps) {
-        setp(buffer, buffer + sizeof(buffer));
+    Socketbuf(int fd,ParkSupport& ps,BufferPool& pool=BufferPool::shared(),bool borrow=false) : sockfd(fd), ps(ps), pool(pool), borrow(borrow) {}
+    ~Socketbuf() {
+        if(in) pool.release(in);
+        if(out) pool.release(out);
+        delete shm;
+        close(sockfd);
     }
-    ~Socketbuf() { 
-        close(sockfd); 
+    // switch to the shared memory transport, the Socketbuf takes ownership of the channel
+    void attach(ShmChannel* channel) {
+        shm = channel;
+    }
+    void setNonBlocking(bool nonBlocking) {
+        this->nonBlocking = nonBlocking;
+    }
+    // true if a write never parks, which a full shared memory ring can still do
+    bool isNonBlocking() const {
+        return nonBlocking && !shm;
+    }
+    // record the bytes read and written in the audit trail
+    void setAudit(AuditTrail* trail) {
+        if (trail) audit = std::make_unique<AuditTrail::Connection>(*trail);
+    }
+    // stream the bytes written to a standby, see Replicator
+    void setReplica(Replicator::Connection* connection) {
+        replica = connection;
+    }
+    // request kernel software receive timestamps for the socket, see receiveTime(), returns false if not supported
+    bool enableTimestamps() {
+#ifdef SO_TIMESTAMPNS
+        int on = 1;
+        timestamps = setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+#endif
+        return timestamps;
+    }
+    // the time the kernel received the data of the last read from the socket, in nanoseconds since the epoch
+    // (CLOCK_REALTIME), or 0 if timestamps are not enabled
+    uint64_t receiveTime() const {
+        return lastReceive;
+    }
+    // read from the socket, recording the receive time if timestamps are enabled
+    ssize_t receive(char* p, size_t len) {
+#ifdef SO_TIMESTAMPNS
+        if (timestamps) {
+            struct iovec iov = {p, len};
+            alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(struct timespec))];
+            struct msghdr msg = {};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            auto n = ::recvmsg(sockfd, &msg, 0);
+            if (n <= 0) return n;
+            for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                    struct timespec ts;
+                    memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                    lastReceive = uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+                }
+            }
+            return n;
+        }
+#endif
+        return ::read(sockfd, p, len);
+    }
+    // record bytes read from the socket without the Socketbuf, see Session::run()
+    void auditInbound(const char* p, size_t len) {
+        if (audit) audit->record(AuditTrail::INBOUND, p, len);
+    }
+    // number of bytes written but not yet accepted by the socket
+    size_t outbound() const {
+        return pending.size();
+    }
+    // write as much of the outbound buffer as the socket accepts, returns false on a socket error
+    bool drain() {
+        size_t offset = 0;
+        while (offset < pending.size()) {
+            int sent = write(sockfd, pending.data() + offset, pending.size() - offset);
+            if (sent < 0) {
+                if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+                return false;
+            }
+            offset += sent;
+        }
+        pending.erase(0, offset);
+        return true;
+    }
+    // write the buffers in a single system call if possible, with the same blocking behavior as a flush.
+    // The put area must be empty, i.e. previous writes flushed.
+    int writev(struct iovec* iov, int count) {
+        if (audit) audit->record(AuditTrail::OUTBOUND, iov, count);
+        if (replica) replica->outbound(iov, count);
+        if (shm) {
+            for (int i = 0; i < count; i++) shmWrite(static_cast<char*>(iov[i].iov_base), iov[i].iov_len, i == count - 1);
+            return 0;
+        }
+        if (nonBlocking && !pending.empty()) {
+            appendPending(iov, count);
+            return 0;
+        }
+        while (count > 0) {
+            auto sent = ::writev(sockfd, iov, count);
+            if (sent < 0) {
+                if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                    if(nonBlocking) {
+                        appendPending(iov, count);
+                        return 0;
+                    }
+                    ps.park();
+                    continue;
+                }
+                return -1;
+            }
+            // advance past the bytes written
+            while (count > 0 && size_t(sent) >= iov->iov_len) {
+                sent -= iov->iov_len;
+                iov++;
+                count--;
+            }
+            if (count > 0) {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + sent;
+                iov->iov_len -= sent;
+            }
+        }
+        return 0;
+    }
+    // the received bytes not yet read from the stream
+    std::string_view available() const {
+        return std::string_view(gptr(), egptr() - gptr());
+    }
+    // the sum of the bytes read from the stream so far, modulo 2^32, so the difference of two calls is the sum of
+    // the bytes read between them, e.g. of a parsed message for its CheckSum
+    uint32_t inboundSum() {
+        if (summed != gptr()) {
+            inSum += simd::sum(summed, gptr() - summed);
+            summed = gptr();
+        }
+        return inSum;
+    }
+    // drop the outbound buffer
+    void discard() {
+        pending.clear();
+        pending.shrink_to_fit();
     }
 
 protected:
     int underflow() override {
+        // the get area is replaced, so add the bytes read from it
+        inboundSum();
+        if(!in) in = pool.acquire();
+        if(shm) return underflowShm();
     again:
-        int bytesRead = read(sockfd, buffer, sizeof(buffer));
+        int bytesRead = receive(in, pool.size());
         if (bytesRead <= 0) {
-            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+            if(bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if(borrow) {
+                    setg(nullptr, nullptr, nullptr);
+                    summed = nullptr;
+                    pool.release(in);
+                    in = nullptr;
+                }
                 ps.park();
+                if(!in) in = pool.acquire();
                 goto again;
             }
-            return std::char_traits<char>::eof();
+            return traits_type::eof();
         }
-        setg(buffer, buffer, buffer + bytesRead);
-        return *gptr();
+        setg(in, in, in + bytesRead);
+        summed = in;
+        auditInbound(in, bytesRead);
+        return traits_type::to_int_type(*gptr());
     }
 
     int overflow(int c) override {
-        if (c != EOF) {
+        if (pptr() != pbase() && flush() != 0) {
+            return traits_type::eof();
+        }
+        if (!out) {
+            out = pool.acquire();
+            setp(out, out + pool.size());
+        }
+        if (c != traits_type::eof()) {
             *pptr() = c;
             pbump(1);
         }
-        return sync() == 0 ? c : EOF;
+        return traits_type::not_eof(c);
     }
 
     int sync() override {
+        if (flush() != 0) return -1;
+        if (borrow && out) {
+            setp(nullptr, nullptr);
+            pool.release(out);
+            out = nullptr;
+        }
+        return 0;
+    }
+
+private:
+    int underflowShm() {
+        for (int spins = 0;; spins++) {
+            auto bytesRead = shm->in().read(in, pool.size());
+            if (bytesRead > 0) {
+                setg(in, in, in + bytesRead);
+                summed = in;
+                auditInbound(in, bytesRead);
+                return traits_type::to_int_type(*gptr());
+            }
+            // the peer corrupted the ring
+            if (shm->broken()) return traits_type::eof();
+            if (spins < ShmChannel::spinCount() || !shm->prepareWait()) continue;
+            if (!waitDoorbell()) return traits_type::eof();
+            spins = 0;
+        }
+    }
+    // wait for the peer to ring the doorbell, returns false if the socket reached the end of stream
+    bool waitDoorbell() {
+        char doorbell[64];
+        int bytesRead = read(sockfd, doorbell, sizeof(doorbell));
+        if (bytesRead > 0) return true;
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            ps.park();
+            return true;
+        }
+        return false;
+    }
+    // write all bytes to the ring, yielding while it is full. The doorbell is rung if the reader is waiting
+    // when the ring is full, or if ring is true after the last byte is written.
+    void shmWrite(const char *p, size_t len, bool ring) {
+        while (true) {
+            auto written = shm->out().write(p, len);
+            p += written;
+            len -= written;
+            if (len == 0) break;
+            if (shm->out().broken()) {
+                // the peer corrupted the ring, the reader sees the end of stream on the socket
+                ::shutdown(sockfd, SHUT_RDWR);
+                return;
+            }
+            doorbell();
+            boost::this_fiber::yield();
+        }
+        if (ring) doorbell();
+    }
+    void doorbell() {
+        if (shm->needsDoorbell()) {
+            char doorbell = 0;
+            (void)!write(sockfd, &doorbell, 1);
+        }
+    }
+    void appendPending(struct iovec* iov, int count) {
+        for (int i = 0; i < count; i++) pending.append(static_cast<char*>(iov[i].iov_base), iov[i].iov_len);
+    }
+    // write the put area, parking while the socket is not writable unless in non-blocking mode
+    int flush() {
+        char *p = pbase();
         int len = pptr() - pbase();
-    again:
-        int sent = write(sockfd, buffer, len);
-        if (sent < 0) {
-            if(errno == EAGAIN || errno == EWOULDBLOCK) {
-                ps.park();
-                goto again;
+        if (audit && len > 0) audit->record(AuditTrail::OUTBOUND, p, len);
+        if (replica && len > 0) replica->outbound(p, len);
+        if (shm) {
+            if (len > 0) shmWrite(p, len, true);
+            len = 0;
+        }
+        if (nonBlocking && !pending.empty()) {
+            // preserve the order of the outbound bytes
+            pending.append(p, len);
+            len = 0;
+        }
+        while (len > 0) {
+            int sent = write(sockfd, p, len);
+            if (sent < 0) {
+                if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                    if(nonBlocking) {
+                        pending.append(p, len);
+                        break;
+                    }
+                    ps.park();
+                    continue;
+                }
+                return -1;
             }
-            return -1;
+            p += sent;
+            len -= sent;
         }
-        pbump(-len);
+        setp(pbase(), epptr());
         return 0;
     }
 
-private:
     int sockfd;
     ParkSupport& ps;
-    char buffer[4096];
+    BufferPool& pool;
+    const bool borrow;
+    char *in = nullptr;
+    char *out = nullptr;
+    bool nonBlocking = false;
+    bool timestamps = false;
+    uint64_t lastReceive = 0;
+    // the sum of the bytes read up to summed, see inboundSum()
+    uint32_t inSum = 0;
+    const char *summed = nullptr;
+    std::string pending;
+    ShmChannel *shm = nullptr;
+    std::unique_ptr<AuditTrail::Connection> audit;
+    Replicator::Connection* replica = nullptr;
 };
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <boost/context/stack_context.hpp>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "affinity.h"
+
+// Fixed size fiber stacks which are recycled across sessions rather than returned to the OS.
+// Stacks are mmap'd so only the touched pages count towards RSS, with a guard page below
+// each stack. When huge pages are requested (and available) the stacks are instead carved out of
+// huge page slabs, each holding as many stacks as fit. A huge page cannot be partially protected, so the
+// guard below each stack in a slab is an unused gap rather than an inaccessible page. The stacks of a pool
+// for a NUMA node are bound to the node.
+class StackPool {
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    const size_t stackSize;
+    const bool hugePages;
+    const int node;
+    size_t guardSize = 0;
+    // a stack and the guard below it
+    size_t slotSize = 0;
+    std::mutex lock;
+    std::vector<void*> available;
+    // the huge page slabs, the stacks in them are never unmapped individually
+    std::vector<std::pair<void*, size_t>> slabs;
+    bool noHugePages = false;
+
+    // map a huge page slab and add its stacks to the available stacks, with the lock held.
+    // Returns false if the OS has no huge pages reserved.
+    bool mapSlab() {
+#ifdef MAP_HUGETLB
+        size_t len = (slotSize + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        void* vp = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (vp == MAP_FAILED) return false;
+        Affinity::bindToNode(vp, len, node);
+        slabs.emplace_back(vp, len);
+        for (size_t offset = 0; offset + slotSize <= len; offset += slotSize) available.push_back(static_cast<char*>(vp) + offset);
+        return true;
+#else
+        return false;
+#endif
+    }
+    void* map() {
+        void* vp = ::mmap(nullptr, slotSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (vp == MAP_FAILED) throw std::bad_alloc();
+        ::mprotect(vp, guardSize, PROT_NONE);
+        Affinity::bindToNode(vp, slotSize, node);
+        return vp;
+    }
+    bool inSlab(void* vp) const {
+        return std::any_of(slabs.begin(), slabs.end(), [vp](auto& slab) {
+            return vp >= slab.first && vp < static_cast<char*>(slab.first) + slab.second;
+        });
+    }
+
+   public:
+    StackPool(size_t stackSize = 64 * 1024, bool hugePages = false, int node = -1) : stackSize(stackSize), hugePages(hugePages), node(node) {
+        guardSize = ::sysconf(_SC_PAGESIZE);
+        slotSize = (stackSize + guardSize - 1) / guardSize * guardSize + guardSize;
+    }
+    ~StackPool() {
+        for (auto vp : available) {
+            if (!inSlab(vp)) ::munmap(vp, slotSize);
+        }
+        for (auto& slab : slabs) ::munmap(slab.first, slab.second);
+    }
+    StackPool(const StackPool&) = delete;
+    StackPool& operator=(const StackPool&) = delete;
+
+    boost::context::stack_context allocate() {
+        void* vp = nullptr;
+        {
+            std::lock_guard<std::mutex> mu(lock);
+            // without huge pages reserved, fall back to regular pages
+            if (available.empty() && hugePages && !noHugePages && !mapSlab()) noHugePages = true;
+            if (!available.empty()) {
+                vp = available.back();
+                available.pop_back();
+            }
+        }
+        if (!vp) vp = map();
+        boost::context::stack_context sctx;
+        sctx.size = slotSize - guardSize;
+        sctx.sp = static_cast<char*>(vp) + slotSize;
+        return sctx;
+    }
+    void deallocate(boost::context::stack_context& sctx) noexcept {
+        void* vp = static_cast<char*>(sctx.sp) - slotSize;
+        std::lock_guard<std::mutex> mu(lock);
+        available.push_back(vp);
+    }
+    // the stacks mapped in huge page slabs
+    size_t slabStacks() {
+        std::lock_guard<std::mutex> mu(lock);
+        size_t count = 0;
+        for (auto& slab : slabs) count += slab.second / slotSize;
+        return count;
+    }
+};
+
+// StackAllocator passed by value to each fiber, referencing the shared pool
+struct PooledStack {
+    StackPool& pool;
+    boost::context::stack_context allocate() { return pool.allocate(); }
+    void deallocate(boost::context::stack_context& sctx) noexcept { pool.deallocate(sctx); }
+};
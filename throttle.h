@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// A cheap monotonic clock, the time stamp counter on x86 (assumed invariant, as on all recent cpus) and the steady
+// clock elsewhere. The tick rate is calibrated against the steady clock on first use, which takes 10 msec.
+struct Tsc {
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+    static double ticksPerSecond() {
+        static const double rate = [] {
+#if defined(__x86_64__) || defined(__i386__)
+            auto start = std::chrono::steady_clock::now();
+            auto ticks = now();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return (now() - ticks) / elapsed;
+#else
+            return 1e9;
+#endif
+        }();
+        return rate;
+    }
+};
+
+// what a session does with a message over its rate limit, see ThrottleConfig
+enum class ThrottleAction {
+    // delay the message until within the limit, which also stops reading the socket so the client is slowed by
+    // TCP flow control. Coroutine sessions cannot wait, so reject instead
+    Queue,
+    // answer with a session level Reject and drop the message
+    Reject,
+    // send a Logout and disconnect
+    Logout
+};
+
+// a token bucket allowing rate messages per second on average and bursts of up to burst messages, a rate of 0 is
+// unlimited
+struct ThrottleLimit {
+    // the message type limited, empty for all application messages, i.e. not the session level messages (Heartbeat,
+    // TestRequest, ResendRequest, Reject, SequenceReset, Logout and Logon)
+    std::string msgType;
+    double rate;
+    double burst;
+};
+
+// the inbound rate limits of a session, e.g. {{"", 1000, 100}, {"i", 100, 10}} allows 1000 messages per second of
+// which 100 MassQuotes. A message must be within all the limits applying to it. No limits disables throttling.
+struct ThrottleConfig {
+    std::vector<ThrottleLimit> limits;
+    ThrottleAction action = ThrottleAction::Reject;
+};
+
+// the messages of a session over its limits, see Session::throttleStats()
+struct ThrottleStats {
+    uint64_t queued = 0;
+    uint64_t rejected = 0;
+    uint64_t loggedOut = 0;
+};
+
+// The token buckets of a session, used by a single thread.
+class Throttle {
+    struct Bucket {
+        std::string msgType;
+        double tokensPerTick;
+        double burst;
+        double tokens;
+        uint64_t last;
+    };
+    std::vector<Bucket> buckets;
+
+    static bool isSessionLevel(std::string_view msgType) {
+        return msgType.size() == 1 && strchr("012345A", msgType[0]);
+    }
+    bool applies(const Bucket& bucket, std::string_view msgType, bool sessionLevel) const {
+        return bucket.msgType.empty() ? !sessionLevel : bucket.msgType == msgType;
+    }
+
+   public:
+    ThrottleAction action = ThrottleAction::Reject;
+    ThrottleStats stats;
+
+    Throttle() = default;
+    Throttle(const ThrottleConfig& config) : action(config.action) {
+        if (config.limits.empty()) return;
+        auto perTick = 1 / Tsc::ticksPerSecond();
+        auto now = Tsc::now();
+        for (auto& limit : config.limits) {
+            if (limit.rate <= 0) continue;
+            // a burst below one message would never admit a message
+            auto burst = std::max(limit.burst, 1.0);
+            buckets.push_back(Bucket{limit.msgType, limit.rate * perTick, burst, burst, now});
+        }
+    }
+    bool enabled() const { return !buckets.empty(); }
+
+    // Take a token from each bucket applying to the message type, returns 0 if the message is within the limits,
+    // otherwise the nanoseconds until it would be and no tokens are taken.
+    uint64_t acquire(std::string_view msgType) {
+        auto now = Tsc::now();
+        bool sessionLevel = isSessionLevel(msgType);
+        double waitTicks = 0;
+        for (auto& bucket : buckets) {
+            if (!applies(bucket, msgType, sessionLevel)) continue;
+            // the counters of the cpus may differ slightly, and the session may have moved to another cpu
+            if (now > bucket.last) {
+                bucket.tokens = std::min(bucket.burst, bucket.tokens + (now - bucket.last) * bucket.tokensPerTick);
+                bucket.last = now;
+            }
+            if (bucket.tokens < 1) waitTicks = std::max(waitTicks, (1 - bucket.tokens) / bucket.tokensPerTick);
+        }
+        if (waitTicks > 0) return uint64_t(waitTicks * 1e9 / Tsc::ticksPerSecond()) + 1;
+        for (auto& bucket : buckets) {
+            if (applies(bucket, msgType, sessionLevel)) bucket.tokens -= 1;
+        }
+        return 0;
+    }
+};